@@ -0,0 +1,575 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * Benchmarks for the hot paths of libevdev. Each benchmark runs a fixed
+ * number of iterations a number of times and prints one line per
+ * benchmark and parameter, tab-separated:
+ *
+ *   benchmark	param	iterations	median_ns	min_ns
+ *
+ * where median_ns and min_ns are the time per iteration over all runs.
+ * Lines starting with # are comments. Benchmarks that need uinput are
+ * skipped if /dev/uinput is not accessible.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libevdev/libevdev.h>
+#include <libevdev/libevdev-uinput.h>
+#include "test-common-uinput.h"
+
+#define MAX_REPEAT 100
+
+struct bench {
+	const char *name;
+	bool needs_uinput;
+	const unsigned int *params; /* terminated by 0, NULL for none */
+	unsigned long iterations;
+	/* run the benchmark once, returns the time in ns or a negative
+	 * errno */
+	int64_t (*run)(unsigned int param, unsigned long iterations);
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double*)a,
+	       y = *(const double*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* lookups of all event code names */
+static int64_t
+bench_code_get_name(unsigned int param, unsigned long iterations)
+{
+	uint64_t start = now_ns();
+	unsigned long n = 0;
+	size_t len = 0;
+
+	while (n < iterations) {
+		unsigned int type;
+
+		for (type = 0; type <= EV_MAX && n < iterations; type++) {
+			int max = libevdev_event_type_get_max(type);
+			int code;
+
+			for (code = 0; code <= max && n < iterations; code++, n++) {
+				const char *name = libevdev_event_code_get_name(type, code);
+				if (name)
+					len += name[0];
+			}
+		}
+	}
+
+	/* make sure the lookups aren't optimized away */
+	if (len == 0)
+		return -EINVAL;
+
+	return now_ns() - start;
+}
+
+/* resolve event code names back to codes */
+static int64_t
+bench_code_from_name(unsigned int param, unsigned long iterations)
+{
+	static const unsigned int types[] = { EV_KEY, EV_REL, EV_ABS, EV_LED, EV_SW };
+	const char **names;
+	unsigned int *name_types;
+	size_t nnames = 0, i;
+	unsigned long n;
+	uint64_t start;
+	int64_t rc;
+	int sum = 0;
+
+	names = calloc(KEY_CNT + REL_CNT + ABS_CNT + LED_CNT + SW_CNT, sizeof(*names));
+	name_types = calloc(KEY_CNT + REL_CNT + ABS_CNT + LED_CNT + SW_CNT, sizeof(*name_types));
+	if (!names || !name_types) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < sizeof(types)/sizeof(types[0]); i++) {
+		int code, max = libevdev_event_type_get_max(types[i]);
+
+		for (code = 0; code <= max; code++) {
+			const char *name = libevdev_event_code_get_name(types[i], code);
+
+			if (!name)
+				continue;
+			names[nnames] = name;
+			name_types[nnames] = types[i];
+			nnames++;
+		}
+	}
+
+	start = now_ns();
+	for (n = 0, i = 0; n < iterations; n++, i = (i + 1) % nnames)
+		sum += libevdev_event_code_from_name(name_types[i], names[i]);
+	rc = now_ns() - start;
+
+	if (sum == 0)
+		rc = -EINVAL;
+out:
+	free(names);
+	free(name_types);
+	return rc;
+}
+
+/* enumeration of the key codes of a keyboard-like device, one
+ * iteration is one full enumeration */
+static int64_t
+bench_code_iterate(unsigned int param, unsigned long iterations)
+{
+	struct libevdev *dev;
+	unsigned long n;
+	uint64_t start;
+	int64_t rc;
+	int code, sum = 0;
+
+	dev = libevdev_new();
+	if (!dev)
+		return -ENOMEM;
+
+	for (code = KEY_ESC; code <= KEY_MICMUTE; code++)
+		libevdev_enable_event_code(dev, EV_KEY, code, NULL);
+	libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, NULL);
+
+	start = now_ns();
+	for (n = 0; n < iterations; n++) {
+		for (code = libevdev_get_next_event_code(dev, EV_KEY, 0);
+		     code != -1;
+		     code = libevdev_get_next_event_code(dev, EV_KEY, code + 1))
+			sum += code;
+	}
+	rc = now_ns() - start;
+
+	if (sum == 0)
+		rc = -EINVAL;
+
+	libevdev_free(dev);
+	return rc;
+}
+
+static int
+open_nonblock(struct uinput_device *uidev)
+{
+	int fd = open(uinput_device_get_devnode(uidev), O_RDONLY|O_NONBLOCK);
+
+	return fd < 0 ? -errno : fd;
+}
+
+/* events per second through libevdev_next_event(), in batches of frames
+ * small enough for the kernel buffer */
+static int64_t
+bench_next_event(unsigned int param, unsigned long iterations)
+{
+	const int frames_per_batch = 16;
+	struct uinput_device *uidev;
+	struct libevdev *dev;
+	struct input_event ev;
+	unsigned long n = 0;
+	uint64_t elapsed = 0;
+	int rc, fd, i;
+
+	rc = uinput_device_new_with_events(&uidev, "bench device", DEFAULT_IDS,
+					   EV_REL, REL_X,
+					   EV_REL, REL_Y,
+					   EV_KEY, BTN_LEFT,
+					   -1);
+	if (rc != 0)
+		return rc;
+
+	fd = open_nonblock(uidev);
+	if (fd < 0) {
+		uinput_device_free(uidev);
+		return fd;
+	}
+
+	rc = libevdev_new_from_fd(fd, &dev);
+	if (rc != 0)
+		goto out;
+
+	while (n < iterations) {
+		uint64_t start;
+
+		for (i = 0; i < frames_per_batch; i++)
+			uinput_device_event_multiple(uidev,
+						     EV_REL, REL_X, 1,
+						     EV_REL, REL_Y, -1,
+						     EV_SYN, SYN_REPORT, 0,
+						     -1, -1);
+
+		start = now_ns();
+		while ((rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev)) ==
+		       LIBEVDEV_READ_STATUS_SUCCESS)
+			n++;
+		elapsed += now_ns() - start;
+
+		if (rc != -EAGAIN)
+			break;
+	}
+
+	libevdev_free(dev);
+	rc = rc == -EAGAIN ? 0 : -EIO;
+out:
+	close(fd);
+	uinput_device_free(uidev);
+
+	if (rc == 0 && n == 0)
+		rc = -EIO;
+
+	/* scale to the requested number of iterations, the last batch may
+	 * overshoot */
+	return rc < 0 ? rc : (int64_t)(elapsed * iterations / n);
+}
+
+static unsigned int slot_params[] = { 2, 5, 10, 20, 0 };
+
+static struct uinput_device *
+create_mt_device(unsigned int nslots)
+{
+	struct uinput_device *uidev;
+	struct input_absinfo abs = { 0 };
+	int rc;
+
+	uidev = uinput_device_new("bench mt device");
+	if (!uidev)
+		return NULL;
+
+	abs.maximum = 1000;
+	rc = uinput_device_set_abs_bit(uidev, ABS_X, &abs);
+	rc |= uinput_device_set_abs_bit(uidev, ABS_Y, &abs);
+	rc |= uinput_device_set_abs_bit(uidev, ABS_MT_POSITION_X, &abs);
+	rc |= uinput_device_set_abs_bit(uidev, ABS_MT_POSITION_Y, &abs);
+	abs.maximum = 0xffff;
+	rc |= uinput_device_set_abs_bit(uidev, ABS_MT_TRACKING_ID, &abs);
+	abs.maximum = nslots - 1;
+	rc |= uinput_device_set_abs_bit(uidev, ABS_MT_SLOT, &abs);
+	rc |= uinput_device_set_event_bits(uidev,
+					   EV_KEY, BTN_TOUCH,
+					   EV_SYN, SYN_REPORT,
+					   -1);
+	if (rc == 0)
+		rc = uinput_device_create(uidev);
+
+	if (rc != 0) {
+		uinput_device_free(uidev);
+		return NULL;
+	}
+
+	return uidev;
+}
+
+static void
+move_touches(struct uinput_device *uidev, unsigned int nslots, int pos)
+{
+	unsigned int slot;
+
+	for (slot = 0; slot < nslots; slot++) {
+		uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, slot);
+		uinput_device_event(uidev, EV_ABS, ABS_MT_TRACKING_ID, slot + 1);
+		uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_X, pos + slot);
+		uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_Y, pos + slot);
+	}
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+}
+
+/* cost of a SYN_DROPPED resync with all touches moved, by slot count */
+static int64_t
+bench_sync(unsigned int nslots, unsigned long iterations)
+{
+	struct uinput_device *uidev;
+	struct libevdev *dev;
+	struct input_event ev;
+	uint64_t elapsed = 0;
+	unsigned long n;
+	int rc, fd;
+
+	uidev = create_mt_device(nslots);
+	if (!uidev)
+		return -ENODEV;
+
+	fd = open_nonblock(uidev);
+	if (fd < 0) {
+		uinput_device_free(uidev);
+		return fd;
+	}
+
+	rc = libevdev_new_from_fd(fd, &dev);
+	if (rc != 0)
+		goto out;
+
+	for (n = 0; n < iterations; n++) {
+		uint64_t start;
+
+		move_touches(uidev, nslots, n % 500);
+
+		start = now_ns();
+		rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_FORCE_SYNC, &ev);
+		if (rc != LIBEVDEV_READ_STATUS_SYNC)
+			break;
+		while ((rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_SYNC, &ev)) ==
+		       LIBEVDEV_READ_STATUS_SYNC)
+			;
+		elapsed += now_ns() - start;
+
+		if (rc != -EAGAIN)
+			break;
+	}
+
+	libevdev_free(dev);
+	rc = rc == -EAGAIN ? 0 : -EIO;
+out:
+	close(fd);
+	uinput_device_free(uidev);
+
+	return rc < 0 ? rc : (int64_t)elapsed;
+}
+
+static unsigned int init_params[] = { 1, 10, 0 };
+
+/* libevdev_set_fd() on a device with the given number of slots, 1 is a
+ * mouse */
+static int64_t
+bench_set_fd(unsigned int nslots, unsigned long iterations)
+{
+	struct uinput_device *uidev;
+	uint64_t start;
+	unsigned long n;
+	int64_t rc = 0;
+	int fd;
+
+	if (nslots > 1)
+		uidev = create_mt_device(nslots);
+	else if (uinput_device_new_with_events(&uidev, "bench device", DEFAULT_IDS,
+					       EV_REL, REL_X,
+					       EV_REL, REL_Y,
+					       EV_KEY, BTN_LEFT,
+					       EV_KEY, BTN_RIGHT,
+					       -1) != 0)
+		uidev = NULL;
+	if (!uidev)
+		return -ENODEV;
+
+	fd = open_nonblock(uidev);
+	if (fd < 0) {
+		uinput_device_free(uidev);
+		return fd;
+	}
+
+	start = now_ns();
+	for (n = 0; n < iterations && rc == 0; n++) {
+		struct libevdev *dev = libevdev_new();
+
+		rc = libevdev_set_fd(dev, fd);
+		libevdev_free(dev);
+	}
+	if (rc == 0)
+		rc = now_ns() - start;
+
+	close(fd);
+	uinput_device_free(uidev);
+
+	return rc;
+}
+
+/* libevdev_uinput_write_event() with no client reading the device */
+static int64_t
+bench_uinput_write(unsigned int param, unsigned long iterations)
+{
+	struct libevdev *dev;
+	struct libevdev_uinput *uidev;
+	uint64_t start;
+	unsigned long n;
+	int64_t rc;
+
+	dev = libevdev_new();
+	libevdev_set_name(dev, "bench uinput device");
+	libevdev_enable_event_code(dev, EV_REL, REL_X, NULL);
+	libevdev_enable_event_code(dev, EV_REL, REL_Y, NULL);
+	libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, NULL);
+
+	rc = libevdev_uinput_create_from_device(dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
+	if (rc != 0)
+		goto out;
+
+	start = now_ns();
+	for (n = 0; n < iterations && rc == 0; n += 2) {
+		rc = libevdev_uinput_write_event(uidev, EV_REL, REL_X, 1);
+		if (rc == 0)
+			rc = libevdev_uinput_write_event(uidev, EV_SYN, SYN_REPORT, 0);
+	}
+	if (rc == 0)
+		rc = now_ns() - start;
+
+	libevdev_uinput_destroy(uidev);
+out:
+	libevdev_free(dev);
+	return rc;
+}
+
+static const struct bench benchmarks[] = {
+	{ "code_get_name", false, NULL, 1000000, bench_code_get_name },
+	{ "code_from_name", false, NULL, 1000000, bench_code_from_name },
+	{ "code_iterate", false, NULL, 100000, bench_code_iterate },
+	{ "next_event", true, NULL, 200000, bench_next_event },
+	{ "sync", true, slot_params, 1000, bench_sync },
+	{ "set_fd", true, init_params, 1000, bench_set_fd },
+	{ "uinput_write", true, NULL, 200000, bench_uinput_write },
+};
+
+static int
+run_bench(const struct bench *b, unsigned int param, int repeat)
+{
+	double ns[MAX_REPEAT];
+	int i;
+
+	for (i = 0; i < repeat; i++) {
+		int64_t rc = b->run(param, b->iterations);
+
+		if (rc < 0) {
+			fprintf(stderr, "%s(%u) failed: %s\n", b->name, param,
+				strerror(-rc));
+			return -1;
+		}
+		ns[i] = (double)rc / b->iterations;
+	}
+
+	qsort(ns, repeat, sizeof(ns[0]), cmp_double);
+	printf("%s\t%u\t%lu\t%.1f\t%.1f\n", b->name, param, b->iterations,
+	       ns[repeat/2], ns[0]);
+	fflush(stdout);
+
+	return 0;
+}
+
+static void
+usage(const char *progname)
+{
+	size_t i;
+
+	printf("Usage: %s [--repeat N] [--list] [benchmark ...]\n"
+	       "\tRun the given benchmarks, or all of them\n",
+	       progname);
+	printf("Benchmarks:");
+	for (i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++)
+		printf(" %s", benchmarks[i].name);
+	printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	int repeat = 5;
+	bool have_uinput;
+	int rc = 0;
+	size_t i;
+	const struct option opts[] = {
+		{ "repeat", 1, 0, 'r' },
+		{ "list", 0, 0, 'l' },
+		{ "help", 0, 0, 'h' },
+		{ NULL, 0, 0, 0 },
+	};
+
+	while (1) {
+		int c = getopt_long(argc, argv, "r:lh", opts, NULL);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+			case 'r':
+				repeat = atoi(optarg);
+				if (repeat < 1 || repeat > MAX_REPEAT) {
+					fprintf(stderr, "repeat must be within 1..%d\n",
+						MAX_REPEAT);
+					return 1;
+				}
+				break;
+			case 'l':
+				for (i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++)
+					printf("%s\n", benchmarks[i].name);
+				return 0;
+			case 'h':
+				usage(argv[0]);
+				return 0;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	have_uinput = access("/dev/uinput", R_OK|W_OK) == 0;
+
+	printf("# libevdev %s, %d runs per benchmark\n", PACKAGE_VERSION, repeat);
+	printf("# benchmark\tparam\titerations\tmedian_ns\tmin_ns\n");
+
+	for (i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++) {
+		const struct bench *b = &benchmarks[i];
+		const unsigned int *param;
+		int j;
+
+		if (optind < argc) {
+			for (j = optind; j < argc; j++)
+				if (strcmp(argv[j], b->name) == 0)
+					break;
+			if (j == argc)
+				continue;
+		}
+
+		if (b->needs_uinput && !have_uinput) {
+			printf("# %s skipped, /dev/uinput is not accessible\n", b->name);
+			continue;
+		}
+
+		if (!b->params) {
+			rc |= run_bench(b, 0, repeat);
+			continue;
+		}
+
+		for (param = b->params; *param; param++)
+			rc |= run_bench(b, *param, repeat);
+	}
+
+	return rc ? 1 : 0;
+}
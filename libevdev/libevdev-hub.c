@@ -0,0 +1,640 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "libevdev.h"
+#include "libevdev-int.h"
+#include "libevdev-hub.h"
+#include "libevdev-util.h"
+
+#define HUB_MAXEVENTS 32
+
+struct hub_device {
+	struct libevdev *dev;
+	int fd;				/**< fd registered with epoll */
+	bool ready;			/**< in the ready list */
+	bool syncing;			/**< reading with LIBEVDEV_READ_FLAG_SYNC */
+	int read_error;			/**< returned once the queue is empty */
+	struct hub_device *prev, *next;	/**< all devices */
+	struct hub_device *ready_prev, *ready_next;
+};
+
+#ifdef HAVE_IO_URING
+/**
+ * The mapped submission and completion rings. Reads are only ever in
+ * flight within fetch_ready_devices(), so the rings are sized for one
+ * epoll_wait(2) worth of devices.
+ */
+struct hub_uring {
+	int fd;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+#endif
+
+struct libevdev_hub {
+	int epoll_fd;
+	struct hub_device *devices;
+	struct hub_device *ready_head;	/**< devices that may have events */
+	struct hub_device *ready_tail;
+	enum libevdev_hub_backend backend;
+#ifdef HAVE_IO_URING
+	struct hub_uring uring;
+#endif
+};
+
+static void
+ready_append(struct libevdev_hub *hub, struct hub_device *d)
+{
+	d->ready = true;
+	d->ready_next = NULL;
+	d->ready_prev = hub->ready_tail;
+	if (hub->ready_tail)
+		hub->ready_tail->ready_next = d;
+	else
+		hub->ready_head = d;
+	hub->ready_tail = d;
+}
+
+static void
+ready_remove(struct libevdev_hub *hub, struct hub_device *d)
+{
+	if (!d->ready)
+		return;
+
+	if (d->ready_prev)
+		d->ready_prev->ready_next = d->ready_next;
+	else
+		hub->ready_head = d->ready_next;
+	if (d->ready_next)
+		d->ready_next->ready_prev = d->ready_prev;
+	else
+		hub->ready_tail = d->ready_prev;
+
+	d->ready = false;
+	d->ready_prev = NULL;
+	d->ready_next = NULL;
+}
+
+static struct hub_device *
+find_device(const struct libevdev_hub *hub, const struct libevdev *dev)
+{
+	struct hub_device *d;
+
+	for (d = hub->devices; d; d = d->next) {
+		if (d->dev == dev)
+			return d;
+	}
+
+	return NULL;
+}
+
+#ifdef HAVE_IO_URING
+static void
+uring_fini(struct hub_uring *ring)
+{
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	close(ring->fd);
+	memset(ring, 0, sizeof(*ring));
+}
+
+static void *
+uring_map(int fd, size_t size, off_t offset)
+{
+	void *p = mmap(NULL, size, PROT_READ|PROT_WRITE,
+		       MAP_SHARED|MAP_POPULATE, fd, offset);
+
+	return p == MAP_FAILED ? NULL : p;
+}
+
+static int
+uring_init(struct hub_uring *ring)
+{
+	struct io_uring_params params;
+	char *sq, *cq;
+	int rc;
+
+	memset(&params, 0, sizeof(params));
+	memset(ring, 0, sizeof(*ring));
+
+	ring->fd = syscall(__NR_io_uring_setup, HUB_MAXEVENTS, &params);
+	if (ring->fd < 0)
+		return -errno;
+
+	ring->sq_ring_size = params.sq_off.array +
+			     params.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size = params.cq_off.cqes +
+			     params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		ring->sq_ring_size = ring->cq_ring_size =
+			max(ring->sq_ring_size, ring->cq_ring_size);
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sq_ring = uring_map(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+	if (ring->sq_ring && (params.features & IORING_FEAT_SINGLE_MMAP))
+		ring->cq_ring = ring->sq_ring;
+	else if (ring->sq_ring)
+		ring->cq_ring = uring_map(ring->fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+	if (ring->cq_ring)
+		ring->sqes = uring_map(ring->fd, ring->sqes_size, IORING_OFF_SQES);
+	if (!ring->sqes) {
+		rc = -errno;
+		uring_fini(ring);
+		return rc;
+	}
+
+	sq = ring->sq_ring;
+	cq = ring->cq_ring;
+	ring->sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned int*)(sq + params.sq_off.array);
+	ring->cq_head = (unsigned int*)(cq + params.cq_off.head);
+	ring->cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	return 0;
+}
+
+/**
+ * Queue a read into the contiguous free space of the device's event
+ * queue, like read_more_events() does for a single device.
+ *
+ * @return 1 if a read was queued, 0 if the queue is full
+ */
+static int
+uring_queue_read(struct hub_uring *ring, struct hub_device *d)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail = *ring->sq_tail;
+	unsigned int idx = tail & *ring->sq_mask;
+	size_t free_elem = queue_num_free_elements_contiguous(d->dev);
+
+	if (free_elem == 0)
+		return 0;
+
+	sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = d->fd;
+	sqe->off = (uint64_t)-1; /* the current file position */
+	sqe->addr = (uintptr_t)queue_next_element(d->dev);
+	sqe->len = free_elem * sizeof(struct input_event);
+	sqe->user_data = (uintptr_t)d;
+	ring->sq_array[idx] = idx;
+
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/**
+ * Hand all completed reads to their devices.
+ *
+ * @return the number of reads completed
+ */
+static int
+uring_reap(struct libevdev_hub *hub)
+{
+	struct hub_uring *ring = &hub->uring;
+	unsigned int head = *ring->cq_head;
+	unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	int n = 0;
+
+	for (; head != tail; head++, n++) {
+		const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+		struct hub_device *d = (struct hub_device*)(uintptr_t)cqe->user_data;
+		int rc;
+
+		rc = _libevdev_queue_commit_read(d->dev, cqe->res);
+		if (rc < 0 && rc != -EAGAIN)
+			d->read_error = rc;
+
+		if (!d->ready && (cqe->res > 0 || d->read_error))
+			ready_append(hub, d);
+	}
+
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/**
+ * Read from all devices epoll reported with a single io_uring_enter(2).
+ * The device fds are non-blocking, so the reads complete right away and
+ * none are in flight once this function returns.
+ */
+static int
+uring_read_devices(struct libevdev_hub *hub,
+		   const struct epoll_event *events, int n)
+{
+	int i, rc;
+	int to_submit = 0, pending;
+
+	for (i = 0; i < n; i++) {
+		struct hub_device *d = events[i].data.ptr;
+
+		if (uring_queue_read(&hub->uring, d))
+			to_submit++;
+		else if (!d->ready)
+			ready_append(hub, d);
+	}
+
+	pending = to_submit;
+	while (pending > 0) {
+		rc = syscall(__NR_io_uring_enter, hub->uring.fd, to_submit,
+			     pending, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (rc < 0 && errno != EINTR)
+			return -errno;
+		else if (rc > 0)
+			to_submit -= rc;
+
+		pending -= uring_reap(hub);
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * Move all devices epoll reports as readable to the ready list. With the
+ * io_uring backend, the devices are read from here too and only those
+ * with new events are added.
+ */
+static int
+fetch_ready_devices(struct libevdev_hub *hub)
+{
+	struct epoll_event events[HUB_MAXEVENTS];
+	int i, n;
+
+	n = epoll_wait(hub->epoll_fd, events, ARRAY_LENGTH(events), 0);
+	if (n < 0)
+		return -errno;
+
+#ifdef HAVE_IO_URING
+	if (hub->backend == LIBEVDEV_HUB_BACKEND_IO_URING) {
+		int rc = uring_read_devices(hub, events, n);
+		return rc < 0 ? rc : n;
+	}
+#endif
+
+	for (i = 0; i < n; i++) {
+		struct hub_device *d = events[i].data.ptr;
+
+		if (!d->ready)
+			ready_append(hub, d);
+	}
+
+	return n;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_hub_new(struct libevdev_hub **hub)
+{
+	struct libevdev_hub *h;
+
+	*hub = NULL;
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+		return -ENOMEM;
+
+	h->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (h->epoll_fd < 0) {
+		int rc = -errno;
+		free(h);
+		return rc;
+	}
+
+	*hub = h;
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT void
+libevdev_hub_free(struct libevdev_hub *hub)
+{
+	struct hub_device *d, *next;
+
+	if (!hub)
+		return;
+
+	for (d = hub->devices; d; d = next) {
+		next = d->next;
+		d->dev->external_reads = false;
+		free(d);
+	}
+
+#ifdef HAVE_IO_URING
+	if (hub->backend == LIBEVDEV_HUB_BACKEND_IO_URING)
+		uring_fini(&hub->uring);
+#endif
+	close(hub->epoll_fd);
+	free(hub);
+}
+
+LIBEVDEV_EXPORT int
+libevdev_hub_get_fd(const struct libevdev_hub *hub)
+{
+	return hub->epoll_fd;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_hub_set_backend(struct libevdev_hub *hub,
+			 enum libevdev_hub_backend backend)
+{
+	struct hub_device *d;
+
+	if (backend == hub->backend)
+		return 0;
+
+	switch (backend) {
+	case LIBEVDEV_HUB_BACKEND_EPOLL:
+#ifdef HAVE_IO_URING
+		uring_fini(&hub->uring);
+#endif
+		break;
+	case LIBEVDEV_HUB_BACKEND_IO_URING:
+#ifdef HAVE_IO_URING
+		{
+			int rc = uring_init(&hub->uring);
+			if (rc < 0)
+				return rc;
+		}
+		break;
+#else
+		return -ENOTSUP;
+#endif
+	default:
+		return -EINVAL;
+	}
+
+	hub->backend = backend;
+	for (d = hub->devices; d; d = d->next)
+		d->dev->external_reads = backend == LIBEVDEV_HUB_BACKEND_IO_URING;
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT enum libevdev_hub_backend
+libevdev_hub_get_backend(const struct libevdev_hub *hub)
+{
+	return hub->backend;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_hub_add_device(struct libevdev_hub *hub, struct libevdev *dev)
+{
+	struct hub_device *d;
+	struct epoll_event ep = { .events = EPOLLIN };
+	int fd = libevdev_get_fd(dev);
+
+	if (!dev->initialized) {
+		log_bug(dev, "device not initialized. call libevdev_set_fd() first\n");
+		return -EBADF;
+	} else if (fd < 0)
+		return -EBADF;
+
+	d = calloc(1, sizeof(*d));
+	if (!d)
+		return -ENOMEM;
+
+	d->dev = dev;
+	d->fd = fd;
+	/* the caller may have left the device needing a sync */
+	d->syncing = dev->sync_state != SYNC_NONE;
+
+	ep.data.ptr = d;
+	if (epoll_ctl(hub->epoll_fd, EPOLL_CTL_ADD, fd, &ep) < 0) {
+		int rc = -errno;
+		free(d);
+		return rc;
+	}
+
+	d->next = hub->devices;
+	if (hub->devices)
+		hub->devices->prev = d;
+	hub->devices = d;
+
+	dev->external_reads = hub->backend == LIBEVDEV_HUB_BACKEND_IO_URING;
+
+	/* the device may already have events queued that epoll doesn't
+	 * know about */
+	ready_append(hub, d);
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_hub_remove_device(struct libevdev_hub *hub, struct libevdev *dev)
+{
+	struct hub_device *d;
+
+	d = find_device(hub, dev);
+	if (!d)
+		return -ENOENT;
+
+	/* may fail if the caller closed the fd already, the fd is then
+	 * gone from the epoll set anyway */
+	(void)epoll_ctl(hub->epoll_fd, EPOLL_CTL_DEL, d->fd, NULL);
+
+	ready_remove(hub, d);
+	dev->external_reads = false;
+
+	if (d->prev)
+		d->prev->next = d->next;
+	else
+		hub->devices = d->next;
+	if (d->next)
+		d->next->prev = d->prev;
+
+	free(d);
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_hub_next_event(struct libevdev_hub *hub,
+			struct libevdev **dev,
+			struct input_event *ev)
+{
+	bool fetched = false;
+	int rc;
+
+	*dev = NULL;
+
+	while (true) {
+		struct hub_device *d = hub->ready_head;
+		unsigned int flags;
+
+		if (!d) {
+			if (fetched)
+				return -EAGAIN;
+
+			rc = fetch_ready_devices(hub);
+			if (rc < 0)
+				return rc;
+			fetched = true;
+			continue;
+		}
+
+		flags = d->syncing ? LIBEVDEV_READ_FLAG_SYNC : LIBEVDEV_READ_FLAG_NORMAL;
+		rc = libevdev_next_event(d->dev, flags, ev);
+
+		if (rc == -EAGAIN) {
+			/* sync done, continue with the normal events */
+			if (d->syncing) {
+				d->syncing = false;
+				continue;
+			}
+
+			/* epoll re-adds it once the fd is readable again */
+			ready_remove(hub, d);
+
+			/* a failed io_uring read, after the events read
+			 * before it */
+			if (d->read_error) {
+				rc = d->read_error;
+				d->read_error = 0;
+				*dev = d->dev;
+				return rc;
+			}
+			continue;
+		}
+
+		*dev = d->dev;
+
+		if (rc < 0) {
+			ready_remove(hub, d);
+			return rc;
+		}
+
+		/* SYN_DROPPED or a synced event */
+		if (rc == LIBEVDEV_READ_STATUS_SYNC)
+			d->syncing = true;
+
+		/* end of a frame, let the next device have a go */
+		if (ev->type == EV_SYN && ev->code == SYN_REPORT &&
+		    d != hub->ready_tail) {
+			ready_remove(hub, d);
+			ready_append(hub, d);
+		}
+
+		return rc;
+	}
+}
+
+LIBEVDEV_EXPORT int
+libevdev_hub_next_events(struct libevdev_hub *hub,
+			 struct libevdev **dev,
+			 struct input_event *evs,
+			 size_t nevents)
+{
+	bool fetched = false;
+	int rc;
+
+	*dev = NULL;
+
+	if (nevents == 0)
+		return 0;
+
+	while (true) {
+		struct hub_device *d = hub->ready_head;
+		const struct input_event *last;
+		unsigned int flags;
+
+		if (!d) {
+			if (fetched)
+				return -EAGAIN;
+
+			rc = fetch_ready_devices(hub);
+			if (rc < 0)
+				return rc;
+			fetched = true;
+			continue;
+		}
+
+		flags = d->syncing ? LIBEVDEV_READ_FLAG_SYNC : LIBEVDEV_READ_FLAG_NORMAL;
+		rc = libevdev_next_events(d->dev, flags, evs, nevents);
+
+		if (rc == -EAGAIN) {
+			/* see libevdev_hub_next_event() */
+			if (d->syncing) {
+				d->syncing = false;
+				continue;
+			}
+
+			ready_remove(hub, d);
+
+			if (d->read_error) {
+				rc = d->read_error;
+				d->read_error = 0;
+				*dev = d->dev;
+				return rc;
+			}
+			continue;
+		}
+
+		*dev = d->dev;
+
+		if (rc < 0) {
+			ready_remove(hub, d);
+			return rc;
+		}
+
+		last = &evs[rc - 1];
+		if (last->type == EV_SYN && last->code == SYN_DROPPED)
+			d->syncing = true;
+
+		/* one batch per device, let the next device have a go */
+		if (d != hub->ready_tail) {
+			ready_remove(hub, d);
+			ready_append(hub, d);
+		}
+
+		return rc;
+	}
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef LIBEVDEV_HUB_H
+#define LIBEVDEV_HUB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libevdev/libevdev.h>
+
+struct libevdev_hub;
+
+/**
+ * @defgroup hub Reading from multiple devices
+ *
+ * A hub reads events from a set of libevdev devices through a single
+ * epoll fd. The caller only needs to wait for the hub's fd to become
+ * readable and fetch events with libevdev_hub_next_event(). Each event
+ * is returned together with the device it came from. The cost of
+ * fetching events depends on the number of devices with events pending,
+ * not on the number of devices in the hub.
+ *
+ * The hub handles SYN_DROPPED on behalf of the caller. When a device
+ * reports SYN_DROPPED, the next events returned for this device are the
+ * events needed to bring the caller's view of the device up to date.
+ * This matches the behaviour of libevdev_next_event() with @ref
+ * LIBEVDEV_READ_FLAG_SYNC.
+ *
+ * @code
+ * struct libevdev_hub *hub;
+ * struct pollfd fds;
+ * int rc;
+ *
+ * rc = libevdev_hub_new(&hub);
+ * if (rc < 0)
+ *     return rc;
+ *
+ * libevdev_hub_add_device(hub, dev1);
+ * libevdev_hub_add_device(hub, dev2);
+ *
+ * fds.fd = libevdev_hub_get_fd(hub);
+ * fds.events = POLLIN;
+ *
+ * while (poll(&fds, 1, -1) > 0) {
+ *     struct libevdev *dev;
+ *     struct input_event ev;
+ *
+ *     while ((rc = libevdev_hub_next_event(hub, &dev, &ev)) >= 0) {
+ *         if (rc == LIBEVDEV_READ_STATUS_SYNC)
+ *             handle_synced_event(dev, &ev);
+ *         else
+ *             handle_event(dev, &ev);
+ *     }
+ *
+ *     if (rc != -EAGAIN && dev != NULL)
+ *         libevdev_hub_remove_device(hub, dev);
+ * }
+ * @endcode
+ *
+ * By default, the hub reads from each device with read(2). With the
+ * io_uring backend, see libevdev_hub_set_backend(), all devices with
+ * events pending are read with a single io_uring_enter(2) call instead.
+ *
+ * A hub does not own the devices added to it and is not thread-safe.
+ */
+
+/**
+ * @ingroup hub
+ *
+ * How the hub reads events from its devices.
+ *
+ * @see libevdev_hub_set_backend
+ */
+enum libevdev_hub_backend {
+	/**
+	 * Wait for devices with epoll and read from each device with
+	 * read(2). This is the default.
+	 */
+	LIBEVDEV_HUB_BACKEND_EPOLL = 0,
+	/**
+	 * Wait for devices with epoll and read from all devices with
+	 * events pending with a single io_uring_enter(2). The events are
+	 * read directly into each device's event queue.
+	 */
+	LIBEVDEV_HUB_BACKEND_IO_URING
+};
+
+/**
+ * @ingroup hub
+ *
+ * Create a new hub with no devices.
+ *
+ * @param[out] hub Set to the new hub on success, NULL otherwise.
+ *
+ * @return 0 on success or a negative errno on failure.
+ *
+ * @see libevdev_hub_free
+ * @since 1.6
+ */
+int libevdev_hub_new(struct libevdev_hub **hub);
+
+/**
+ * @ingroup hub
+ *
+ * Free the hub and all its resources. The devices in the hub are not
+ * freed, and their file descriptors are not closed.
+ *
+ * @param hub The hub to free, may be NULL.
+ *
+ * @since 1.6
+ */
+void libevdev_hub_free(struct libevdev_hub *hub);
+
+/**
+ * @ingroup hub
+ *
+ * Get the file descriptor of the hub. It becomes readable when any
+ * device in the hub has events pending. Do not read from this fd, use
+ * libevdev_hub_next_event() instead.
+ *
+ * @param hub The hub
+ *
+ * @return The file descriptor of the hub.
+ *
+ * @since 1.6
+ */
+int libevdev_hub_get_fd(const struct libevdev_hub *hub);
+
+/**
+ * @ingroup hub
+ *
+ * Change how the hub reads events from its devices. The backend can be
+ * changed at any time, events already read remain queued in the devices.
+ *
+ * With @ref LIBEVDEV_HUB_BACKEND_IO_URING, a device in the hub is only
+ * read from by the hub. Calling libevdev_next_event() on it directly only
+ * returns the events the hub has already read. Once the device is
+ * removed from the hub, libevdev_next_event() reads from the fd again.
+ *
+ * @param hub The hub
+ * @param backend The new backend
+ *
+ * @return 0 on success or a negative errno on failure. -ENOTSUP means
+ * libevdev was built without io_uring support. Other errors, e.g.
+ * -ENOSYS or -EPERM, mean the kernel does not allow io_uring. The hub
+ * then keeps its current backend.
+ *
+ * @since 1.6
+ */
+int libevdev_hub_set_backend(struct libevdev_hub *hub,
+			     enum libevdev_hub_backend backend);
+
+/**
+ * @ingroup hub
+ *
+ * @param hub The hub
+ *
+ * @return The backend the hub uses to read events.
+ *
+ * @see libevdev_hub_set_backend
+ * @since 1.6
+ */
+enum libevdev_hub_backend libevdev_hub_get_backend(const struct libevdev_hub *hub);
+
+/**
+ * @ingroup hub
+ *
+ * Add a device to the hub. A device can be in at most one hub at a
+ * time. If the device's fd is changed with libevdev_change_fd(), the
+ * device must be removed from the hub and added again.
+ *
+ * @param hub The hub
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ *
+ * @return 0 on success or a negative errno on failure. -EEXIST means the
+ * device's fd is already in the hub.
+ *
+ * @see libevdev_hub_remove_device
+ * @since 1.6
+ */
+int libevdev_hub_add_device(struct libevdev_hub *hub, struct libevdev *dev);
+
+/**
+ * @ingroup hub
+ *
+ * Remove a device from the hub. Any events still queued in the device
+ * remain there and can be read with libevdev_next_event().
+ *
+ * @param hub The hub
+ * @param dev A device previously added with libevdev_hub_add_device()
+ *
+ * @return 0 on success or -ENOENT if the device is not in this hub.
+ *
+ * @since 1.6
+ */
+int libevdev_hub_remove_device(struct libevdev_hub *hub, struct libevdev *dev);
+
+/**
+ * @ingroup hub
+ *
+ * Get the next event from any device in the hub. This function never
+ * blocks. It returns the events of one device until that device has
+ * finished a SYN_REPORT frame or has no more events. Devices with events
+ * pending are served in turn.
+ *
+ * When a device reports SYN_DROPPED, the EV_SYN SYN_DROPPED event is
+ * returned with @ref LIBEVDEV_READ_STATUS_SYNC. The events that follow
+ * for this device are also returned with @ref LIBEVDEV_READ_STATUS_SYNC
+ * until the device is in sync again. See libevdev_next_event() for
+ * details.
+ *
+ * If reading from a device fails, the error is returned and dev is set to
+ * that device. The caller should then remove the device from the hub,
+ * otherwise the error is likely to be returned again.
+ *
+ * @param hub The hub
+ * @param[out] dev Set to the device the event came from, or NULL if no
+ * event is available.
+ * @param[out] ev On success, set to the current event.
+ *
+ * @return On failure, a negative errno is returned.
+ * @retval LIBEVDEV_READ_STATUS_SUCCESS An event is available
+ * @retval LIBEVDEV_READ_STATUS_SYNC The event is a SYN_DROPPED event or
+ * an event synced after SYN_DROPPED
+ * @retval -EAGAIN No events are currently available on any device
+ *
+ * @since 1.6
+ */
+int libevdev_hub_next_event(struct libevdev_hub *hub,
+			    struct libevdev **dev,
+			    struct input_event *ev);
+
+/**
+ * @ingroup hub
+ *
+ * Get up to nevents events from one device in the hub. This is the batch
+ * version of libevdev_hub_next_event() and never blocks. Each call reads
+ * at most once from the device, see libevdev_next_events(), and devices
+ * with events pending are served in turn, one batch each. A batch may
+ * end in the middle of a frame.
+ *
+ * When a device reports SYN_DROPPED, the EV_SYN SYN_DROPPED event is the
+ * last event of the batch. The batches that follow for this device
+ * contain the events synced from the device state, then the device
+ * continues with its normal events.
+ *
+ * If reading from a device fails, the error is returned and dev is set to
+ * that device, as for libevdev_hub_next_event().
+ *
+ * @param hub The hub
+ * @param[out] dev Set to the device the events came from, or NULL if no
+ * event is available.
+ * @param evs Caller-allocated array of at least nevents elements
+ * @param nevents The maximum number of events to return
+ *
+ * @return On success, the number of events copied into evs. On failure, a
+ * negative errno is returned.
+ * @retval -EAGAIN No events are currently available on any device
+ *
+ * @since 1.6
+ */
+int libevdev_hub_next_events(struct libevdev_hub *hub,
+			     struct libevdev **dev,
+			     struct input_event *evs,
+			     size_t nevents);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBEVDEV_HUB_H */
@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <errno.h>
 #include "libevdev.h"
 #include "libevdev-util.h"
@@ -35,6 +36,20 @@
 #define ABS_MT_MIN ABS_MT_SLOT
 #define ABS_MT_MAX ABS_MT_TOOL_Y
 #define ABS_MT_CNT (ABS_MT_MAX - ABS_MT_MIN + 1)
+/* Bucket 0 is < 1us, bucket n is [2^(n-1), 2^n) us, the last bucket has
+   everything above */
+#define LATENCY_BUCKETS 32
+/* layout of the filter table, one range of codes per event type */
+#define FILTER_OFFSET_KEY 0
+#define FILTER_OFFSET_REL (FILTER_OFFSET_KEY + KEY_CNT)
+#define FILTER_OFFSET_ABS (FILTER_OFFSET_REL + REL_CNT)
+#define FILTER_OFFSET_MSC (FILTER_OFFSET_ABS + ABS_CNT)
+#define FILTER_OFFSET_SW (FILTER_OFFSET_MSC + MSC_CNT)
+#define FILTER_OFFSET_LED (FILTER_OFFSET_SW + SW_CNT)
+#define FILTER_OFFSET_SND (FILTER_OFFSET_LED + LED_CNT)
+#define FILTER_OFFSET_REP (FILTER_OFFSET_SND + SND_CNT)
+#define FILTER_OFFSET_FF (FILTER_OFFSET_REP + REP_CNT)
+#define FILTER_CNT (FILTER_OFFSET_FF + FF_CNT)
 #define LIBEVDEV_EXPORT __attribute__((visibility("default")))
 #define ALIAS(_to) __attribute__((alias(#_to)))
 
@@ -55,11 +70,26 @@ enum SyncState {
 	SYNC_IN_PROGRESS,
 };
 
+enum event_filter_status {
+	EVENT_FILTER_NONE,	/**< Event untouched by filters */
+	EVENT_FILTER_MODIFIED,	/**< Event was modified */
+	EVENT_FILTER_DISCARD,	/**< Discard current event */
+};
+
 struct mt_sync_state {
 	int code;
 	int val[];
 };
 
+#define LOG_MSG_CNT (LIBEVDEV_LOG_MSG_SUPPRESSED + 1)
+
+/* see libevdev_set_device_log_ratelimit() */
+struct log_ratelimit {
+	uint64_t interval_start;	/**< CLOCK_MONOTONIC, in ns */
+	unsigned int nlogged;		/**< messages logged in this interval */
+	unsigned int nsuppressed;	/**< messages suppressed in this interval */
+};
+
 /**
  * Internal only: log data used to send messages to the respective log
  * handler. We re-use the same struct for a global and inside
@@ -74,9 +104,14 @@ struct logdata {
 	void *userdata;					/** user-defined data pointer */
 };
 
-struct libevdev {
-	int fd;
-	bool initialized;
+/**
+ * Internal only: the capabilities of a device. The caps are
+ * reference-counted and shared between devices and snapshots, they must
+ * not be modified while shared. A device copies shared caps before
+ * modifying them, see caps_writable().
+ */
+struct libevdev_caps {
+	int refcount;			/**< 0 for the static empty caps */
 	char *name;
 	char *phys;
 	char *uniq;
@@ -93,24 +128,99 @@ struct libevdev {
 	unsigned long rep_bits[NLONGS(REP_CNT)]; /* convenience, always 1 */
 	unsigned long ff_bits[NLONGS(FF_CNT)];
 	unsigned long snd_bits[NLONGS(SND_CNT)];
+	struct input_absinfo abs_info[ABS_CNT]; /**< the axis ranges, the
+						  value is unused */
+};
+
+/**
+ * Internal only: a reference to the caps of a device, see
+ * libevdev_snapshot_new() and libevdev_set_fd_with_snapshot().
+ */
+struct libevdev_snapshot {
+	struct libevdev_caps *caps;
+};
+
+/**
+ * Internal only: the state of a device, see libevdev_state_new().
+ */
+struct libevdev_state {
+	int num_slots;
+	int current_slot;
+	struct timeval time;		/**< of the last event */
+	unsigned long key_values[NLONGS(KEY_CNT)];
+	unsigned long led_values[NLONGS(LED_CNT)];
+	unsigned long sw_values[NLONGS(SW_CNT)];
+	int abs_values[ABS_CNT];	/**< the ABS_MT codes are in mt_slot_vals */
+	int mt_slot_vals[];		/**< [num_slots * ABS_MT_CNT] */
+};
+
+struct libevdev {
+	int fd;
+	bool initialized;
+	struct libevdev_caps *caps;	/**< never NULL, possibly shared */
 	unsigned long key_values[NLONGS(KEY_CNT)];
 	unsigned long led_values[NLONGS(LED_CNT)];
 	unsigned long sw_values[NLONGS(SW_CNT)];
-	struct input_absinfo abs_info[ABS_CNT];
+	/* [ABS_CNT], the ranges from the caps and the current values, NULL
+	   if the device has no axes. Never moved while the device is set
+	   up, see libevdev_get_abs_info() */
+	struct input_absinfo *abs_info;
 	int *mt_slot_vals; /* [num_slots * ABS_MT_CNT] */
+	/* [num_slots], bit (code - ABS_MT_MIN) is set for each axis changed
+	   in the current frame */
+	uint32_t *mt_slot_changes;
+	bool mt_changes_reset; /* clear mt_slot_changes on the next event */
 	int num_slots; /**< valid slots in mt_slot_vals */
 	int current_slot;
+	int abs_info_slot; /**< slot the MT axes in abs_info are from */
 	int rep_values[REP_CNT];
+	unsigned long filter[NLONGS(FILTER_CNT)]; /**< codes passed on to the
+						    caller, i.e. libevdev_has_event_code() */
+	bool kernel_mask; /**< filter mirrored in the kernel with EVIOCSMASK */
+	bool external_reads; /**< the queue is filled by a hub, see
+			       _libevdev_queue_commit_read() */
 
 	enum SyncState sync_state;
 	enum libevdev_grab_mode grabbed;
 
+	/* sanitizes an event and updates the device state for it,
+	   specialized for the device's capabilities, see
+	   event_processor_select() */
+	enum event_filter_status (*process_event)(struct libevdev *dev,
+						  struct input_event *ev,
+						  enum SyncState sync_state);
+
 	struct input_event *queue;
 	size_t queue_size; /**< size of queue in elements */
-	size_t queue_next; /**< next event index */
+	size_t queue_head; /**< index of the first event */
+	size_t queue_nelem; /**< number of events in the queue */
 	size_t queue_nsync; /**< number of sync events */
 
+	struct {
+		size_t size;		/**< requested by the caller, 0 for
+					  the default */
+		size_t max_size;	/**< grow the queue up to this size,
+					  0 to never grow it */
+		unsigned int full_reads; /**< consecutive reads that filled
+					   the queue */
+	} queue_config;
+
+	struct {
+		size_t nprocessed;	/**< events at the queue head that have
+					  been processed for peeking */
+		bool discard_next;	/**< the event after those is to be
+					  discarded */
+		bool syn_dropped;	/**< the last processed event is a
+					  SYN_DROPPED */
+	} peek;
+
 	struct timeval last_event_time;
+	int clock_id;			/**< clock of the event timestamps */
+
+	struct {
+		bool enabled;
+		uint64_t buckets[LATENCY_BUCKETS];
+	} latency;
 
 	struct {
 		struct mt_sync_state *mt_state;
@@ -121,7 +231,47 @@ struct libevdev {
 		size_t tracking_id_changes_sz;	 /* in bytes */
 	} mt_sync;
 
+	struct {
+		struct input_event *events;
+		size_t size;			 /* in elements */
+		size_t nevents;
+		bool complete;			 /* handed to the caller */
+		struct {
+			unsigned long types[NLONGS(EV_CNT)];
+			unsigned long syn[NLONGS(SYN_CNT)];
+			unsigned long key[NLONGS(KEY_CNT)];
+			unsigned long rel[NLONGS(REL_CNT)];
+			unsigned long abs[NLONGS(ABS_CNT)];
+			unsigned long led[NLONGS(LED_CNT)];
+			unsigned long msc[NLONGS(MSC_CNT)];
+			unsigned long sw[NLONGS(SW_CNT)];
+			unsigned long snd[NLONGS(SND_CNT)];
+		} changed;
+	} frame;
+
+	struct {
+		uint64_t events_read;
+		uint64_t read_calls;
+		uint64_t bytes_read;
+		uint64_t syn_dropped;
+		uint64_t syn_dropped_after_sync;
+		uint64_t syncs;
+		uint64_t sync_time_ns;
+		uint64_t events_discarded;
+		uint64_t events_coalesced;
+		size_t queue_high_water;
+	} stats;
+
 	struct logdata log;
+
+	struct {
+		libevdev_device_log_msg_func_t handler;
+		enum libevdev_log_priority priority;
+		void *userdata;
+		unsigned int burst;
+		uint64_t interval_ns;
+		struct log_ratelimit limits[LOG_MSG_CNT];
+	} log_msgs;
 };
 
 #define log_msg_cond(dev, priority, ...) \
@@ -142,6 +292,22 @@ _libevdev_log_msg(const struct libevdev *dev,
 		  const char *format, ...) LIBEVDEV_ATTRIBUTE_PRINTF(6, 7);
 extern enum libevdev_log_priority
 _libevdev_log_priority(const struct libevdev *dev);
+extern int
+_libevdev_queue_commit_read(struct libevdev *dev, int len);
+
+/**
+ * The event queue is a ring buffer of queue_size elements. queue_head is
+ * the index of the first (oldest) element, queue_nelem the number of
+ * elements currently in the queue. Elements wrap around at queue_size.
+ */
+static inline size_t
+queue_index(const struct libevdev *dev, size_t idx)
+{
+	idx += dev->queue_head;
+	if (idx >= dev->queue_size)
+		idx -= dev->queue_size;
+	return idx;
+}
 
 /**
  * @return a pointer to the next element in the queue, or NULL if the queue
@@ -150,10 +316,10 @@ _libevdev_log_priority(const struct libevdev *dev);
 static inline struct input_event*
 queue_push(struct libevdev *dev)
 {
-	if (dev->queue_next >= dev->queue_size)
+	if (dev->queue_nelem >= dev->queue_size)
 		return NULL;
 
-	return &dev->queue[dev->queue_next++];
+	return &dev->queue[queue_index(dev, dev->queue_nelem++)];
 }
 
 /**
@@ -164,10 +330,10 @@ queue_push(struct libevdev *dev)
 static inline int
 queue_pop(struct libevdev *dev, struct input_event *ev)
 {
-	if (dev->queue_next == 0)
+	if (dev->queue_nelem == 0)
 		return 1;
 
-	*ev = dev->queue[--dev->queue_next];
+	*ev = dev->queue[queue_index(dev, --dev->queue_nelem)];
 
 	return 0;
 }
@@ -175,9 +341,9 @@ queue_pop(struct libevdev *dev, struct input_event *ev)
 static inline int
 queue_peek(struct libevdev *dev, size_t idx, struct input_event *ev)
 {
-	if (dev->queue_next == 0 || idx > dev->queue_next)
+	if (dev->queue_nelem == 0 || idx >= dev->queue_nelem)
 		return 1;
-	*ev = dev->queue[idx];
+	*ev = dev->queue[queue_index(dev, idx)];
 	return 0;
 }
 
@@ -192,27 +358,31 @@ queue_peek(struct libevdev *dev, size_t idx, struct input_event *ev)
 static inline int
 queue_shift_multiple(struct libevdev *dev, size_t n, struct input_event *ev)
 {
-	size_t remaining;
+	size_t first;
 
-	if (dev->queue_next == 0)
+	if (dev->queue_nelem == 0)
 		return 0;
 
-	remaining = dev->queue_next;
-	n = min(n, remaining);
-	remaining -= n;
+	n = min(n, dev->queue_nelem);
 
-	if (ev)
-		memcpy(ev, dev->queue, n * sizeof(*ev));
+	if (ev) {
+		/* at most two chunks: up to the end of the buffer, then
+		   from the start of the buffer */
+		first = min(n, dev->queue_size - dev->queue_head);
+		memcpy(ev, &dev->queue[dev->queue_head], first * sizeof(*ev));
+		memcpy(&ev[first], dev->queue, (n - first) * sizeof(*ev));
+	}
 
-	memmove(dev->queue, &dev->queue[n], remaining * sizeof(*dev->queue));
+	dev->queue_nelem -= n;
+	/* An empty queue restarts at index 0 so the next read can use the
+	   whole buffer in one go */
+	dev->queue_head = dev->queue_nelem ? queue_index(dev, n) : 0;
 
-	dev->queue_next = remaining;
 	return n;
 }
 
 /**
- * Set ev to the first element in the queue, shifting everything else
- * forward by one.
+ * Set ev to the first element in the queue, removing it from the queue.
  *
  * @return 0 on success, 1 if the queue is empty.
  */
@@ -233,7 +403,37 @@ queue_alloc(struct libevdev *dev, size_t size)
 		return -ENOMEM;
 
 	dev->queue_size = size;
-	dev->queue_next = 0;
+	dev->queue_head = 0;
+	dev->queue_nelem = 0;
+	return 0;
+}
+
+/**
+ * Reallocate the queue with the given size, keeping all queued events.
+ * The events start at index 0 of the new buffer.
+ */
+static inline int
+queue_resize(struct libevdev *dev, size_t size)
+{
+	struct input_event *queue;
+	size_t first;
+
+	if (size == 0 || size < dev->queue_nelem)
+		return -EINVAL;
+
+	queue = calloc(size, sizeof(struct input_event));
+	if (!queue)
+		return -ENOMEM;
+
+	first = min(dev->queue_nelem, dev->queue_size - dev->queue_head);
+	memcpy(queue, &dev->queue[dev->queue_head], first * sizeof(*queue));
+	memcpy(&queue[first], dev->queue, (dev->queue_nelem - first) * sizeof(*queue));
+
+	free(dev->queue);
+	dev->queue = queue;
+	dev->queue_size = size;
+	dev->queue_head = 0;
+
 	return 0;
 }
 
@@ -242,13 +442,14 @@ queue_free(struct libevdev *dev)
 {
 	free(dev->queue);
 	dev->queue_size = 0;
-	dev->queue_next = 0;
+	dev->queue_head = 0;
+	dev->queue_nelem = 0;
 }
 
 static inline size_t
 queue_num_elements(struct libevdev *dev)
 {
-	return dev->queue_next;
+	return dev->queue_nelem;
 }
 
 static inline size_t
@@ -263,16 +464,58 @@ queue_num_free_elements(struct libevdev *dev)
 	if (dev->queue_size == 0)
 		return 0;
 
-	return dev->queue_size - dev->queue_next;
+	return dev->queue_size - dev->queue_nelem;
+}
+
+/**
+ * @return the number of free elements that directly follow
+ * queue_next_element() in memory, i.e. the number of elements that can be
+ * written into the queue without wrapping around.
+ */
+static inline size_t
+queue_num_free_elements_contiguous(struct libevdev *dev)
+{
+	size_t tail;
+
+	if (dev->queue_nelem >= dev->queue_size)
+		return 0;
+
+	tail = queue_index(dev, dev->queue_nelem);
+	if (tail >= dev->queue_head)
+		return dev->queue_size - tail;
+	else
+		return dev->queue_head - tail;
+}
+
+/**
+ * @return the number of elements that directly follow the first element
+ * in memory, including the first element, i.e. the number of elements
+ * that can be accessed from the start of the queue without wrapping
+ * around.
+ */
+static inline size_t
+queue_num_elements_contiguous(struct libevdev *dev)
+{
+	return min(dev->queue_nelem, dev->queue_size - dev->queue_head);
+}
+
+/**
+ * @return a pointer to the element at idx in the queue. idx must be less
+ * than queue_num_elements().
+ */
+static inline struct input_event *
+queue_element(struct libevdev *dev, size_t idx)
+{
+	return &dev->queue[queue_index(dev, idx)];
 }
 
 static inline struct input_event *
 queue_next_element(struct libevdev *dev)
 {
-	if (dev->queue_next == dev->queue_size)
+	if (dev->queue_nelem >= dev->queue_size)
 		return NULL;
 
-	return &dev->queue[dev->queue_next];
+	return &dev->queue[queue_index(dev, dev->queue_nelem)];
 }
 
 static inline int
@@ -281,14 +524,14 @@ queue_set_num_elements(struct libevdev *dev, size_t nelem)
 	if (nelem > dev->queue_size)
 		return 1;
 
-	dev->queue_next = nelem;
+	dev->queue_nelem = nelem;
 
 	return 0;
 }
 
 #define max_mask(uc, lc) \
 	case EV_##uc: \
-			*mask = dev->lc##_bits; \
+			*mask = dev->caps->lc##_bits; \
 			max = libevdev_event_type_get_max(type); \
 		break;
 
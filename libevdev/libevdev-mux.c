@@ -0,0 +1,512 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libevdev.h"
+#include "libevdev-int.h"
+#include "libevdev-hub.h"
+#include "libevdev-mux.h"
+#include "libevdev-uinput.h"
+#include "libevdev-util.h"
+
+/* write to the uinput device once this many events are pending, even if
+   the sources have more events */
+#define MUX_BATCH_SIZE 256
+
+struct mux_source {
+	struct libevdev *dev;
+	unsigned long keys_down[NLONGS(KEY_CNT)]; /**< held by this source */
+	struct input_event *frame;	/**< events of the incomplete frame */
+	size_t frame_size;		/**< in elements */
+	size_t nframe;
+	bool dropping;			/**< discard up to the next SYN_REPORT */
+	struct mux_source *next;
+};
+
+struct libevdev_mux {
+	struct libevdev_hub *hub;
+	const struct libevdev_uinput *uinput;
+	struct mux_source *sources;
+	struct mux_source *last;	/**< source of the last event */
+	uint16_t key_count[KEY_CNT];	/**< sources holding each key */
+	/* the events to write: less than a batch, plus a frame of up to a
+	   batch or the key releases of a source, and a SYN_REPORT. KEY_CNT
+	   is larger than a batch. */
+	struct input_event out[MUX_BATCH_SIZE + KEY_CNT + 1];
+	size_t nout;
+	struct input_event in[MUX_BATCH_SIZE];	/**< read from a source */
+};
+
+static struct mux_source *
+find_source(struct libevdev_mux *mux, const struct libevdev *dev)
+{
+	struct mux_source *s;
+
+	if (mux->last && mux->last->dev == dev)
+		return mux->last;
+
+	for (s = mux->sources; s; s = s->next) {
+		if (s->dev == dev) {
+			mux->last = s;
+			return s;
+		}
+	}
+
+	return NULL;
+}
+
+static int
+mux_flush(struct libevdev_mux *mux)
+{
+	size_t written = 0;
+	int rc = 0;
+
+	if (!mux->uinput) {
+		mux->nout = 0;
+		return 0;
+	}
+
+	while (written < mux->nout) {
+		rc = libevdev_uinput_write_events(mux->uinput,
+						  &mux->out[written],
+						  mux->nout - written);
+		if (rc <= 0)
+			break;
+		written += rc;
+	}
+
+	mux->nout = 0;
+
+	return rc < 0 ? rc : (int)written;
+}
+
+static inline void
+mux_push(struct libevdev_mux *mux, const struct input_event *ev)
+{
+	mux->out[mux->nout++] = *ev;
+}
+
+/**
+ * Apply the key reference counts to a key event of a source.
+ *
+ * @return true if the event is to be forwarded
+ */
+static bool
+mux_merge_key(struct libevdev_mux *mux, struct mux_source *s,
+	      const struct input_event *ev)
+{
+	bool down = bit_is_set(s->keys_down, ev->code);
+
+	switch (ev->value) {
+	case 0:
+		if (!down)
+			return false;
+		clear_bit(s->keys_down, ev->code);
+		return --mux->key_count[ev->code] == 0;
+	case 1:
+		if (down)
+			return false;
+		set_bit(s->keys_down, ev->code);
+		return mux->key_count[ev->code]++ == 0;
+	default:
+		/* autorepeat */
+		return down;
+	}
+}
+
+/**
+ * Forward the buffered frame of a source, ended by the given SYN_REPORT.
+ * A frame that is empty after merging is dropped.
+ */
+static void
+mux_forward_frame(struct libevdev_mux *mux, struct mux_source *s,
+		  const struct input_event *syn)
+{
+	size_t start = mux->nout;
+	size_t i;
+
+	for (i = 0; i < s->nframe; i++) {
+		const struct input_event *ev = &s->frame[i];
+
+		if (ev->type == EV_KEY && ev->code < KEY_CNT &&
+		    !mux_merge_key(mux, s, ev))
+			continue;
+
+		mux_push(mux, ev);
+	}
+
+	if (mux->nout > start)
+		mux_push(mux, syn);
+
+	s->nframe = 0;
+}
+
+static int
+mux_buffer_event(struct mux_source *s, const struct input_event *ev)
+{
+	if (s->nframe == s->frame_size) {
+		size_t size = s->frame_size ? s->frame_size * 2 : 64;
+		struct input_event *frame;
+
+		/* a frame can't be larger than the batch, see mux->out */
+		if (s->frame_size >= MUX_BATCH_SIZE)
+			return -E2BIG;
+
+		frame = realloc(s->frame, size * sizeof(*frame));
+		if (!frame)
+			return -ENOMEM;
+		s->frame = frame;
+		s->frame_size = size;
+	}
+
+	s->frame[s->nframe++] = *ev;
+
+	return 0;
+}
+
+/**
+ * Release all keys held by a source and discard its incomplete frame.
+ */
+static void
+mux_release_keys(struct libevdev_mux *mux, struct mux_source *s)
+{
+	struct input_event ev = {
+		.type = EV_KEY,
+		.value = 0,
+	};
+	size_t start = mux->nout;
+	unsigned int code;
+
+	s->nframe = 0;
+	s->dropping = false;
+
+	for (code = bits_find_next(s->keys_down, KEY_CNT, 0);
+	     code < KEY_CNT;
+	     code = bits_find_next(s->keys_down, KEY_CNT, code + 1)) {
+		ev.code = code;
+		if (mux_merge_key(mux, s, &ev))
+			mux_push(mux, &ev);
+	}
+
+	if (mux->nout > start) {
+		ev.type = EV_SYN;
+		ev.code = SYN_REPORT;
+		mux_push(mux, &ev);
+	}
+}
+
+static void
+mux_unlink_source(struct libevdev_mux *mux, struct mux_source *s)
+{
+	struct mux_source **p;
+
+	for (p = &mux->sources; *p; p = &(*p)->next) {
+		if (*p == s) {
+			*p = s->next;
+			break;
+		}
+	}
+
+	if (mux->last == s)
+		mux->last = NULL;
+
+	free(s->frame);
+	free(s);
+}
+
+LIBEVDEV_EXPORT int
+libevdev_mux_new(struct libevdev_mux **mux)
+{
+	struct libevdev_mux *m;
+	int rc;
+
+	*mux = NULL;
+
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return -ENOMEM;
+
+	rc = libevdev_hub_new(&m->hub);
+	if (rc < 0) {
+		free(m);
+		return rc;
+	}
+
+	*mux = m;
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT void
+libevdev_mux_free(struct libevdev_mux *mux)
+{
+	struct mux_source *s, *next;
+
+	if (!mux)
+		return;
+
+	for (s = mux->sources; s; s = next) {
+		next = s->next;
+		free(s->frame);
+		free(s);
+	}
+
+	libevdev_hub_free(mux->hub);
+	free(mux);
+}
+
+LIBEVDEV_EXPORT int
+libevdev_mux_get_fd(const struct libevdev_mux *mux)
+{
+	return libevdev_hub_get_fd(mux->hub);
+}
+
+LIBEVDEV_EXPORT int
+libevdev_mux_add_device(struct libevdev_mux *mux, struct libevdev *dev)
+{
+	struct mux_source *s, **tail;
+	int rc;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -ENOMEM;
+
+	rc = libevdev_hub_add_device(mux->hub, dev);
+	if (rc < 0) {
+		free(s);
+		return rc;
+	}
+
+	/* keep the sources in the order they were added, the first one is
+	   used for the name and ids of the union device */
+	for (tail = &mux->sources; *tail; tail = &(*tail)->next)
+		;
+	s->dev = dev;
+	*tail = s;
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_mux_remove_device(struct libevdev_mux *mux, struct libevdev *dev)
+{
+	struct mux_source *s = find_source(mux, dev);
+	int rc;
+
+	if (!s)
+		return -ENOENT;
+
+	libevdev_hub_remove_device(mux->hub, dev);
+
+	/* forward what's pending first, the releases must not be
+	   inserted into the middle of a batch */
+	rc = mux_flush(mux);
+	mux_release_keys(mux, s);
+	mux_unlink_source(mux, s);
+
+	if (rc >= 0)
+		rc = mux_flush(mux);
+
+	return rc < 0 ? rc : 0;
+}
+
+static int
+mux_union_type(struct libevdev *to, const struct libevdev *from,
+	       unsigned int type)
+{
+	int code;
+
+	if (libevdev_enable_event_type(to, type) < 0)
+		return -ENOMEM;
+
+	if (type == EV_SYN)
+		return 0;
+
+	for (code = libevdev_get_next_event_code(from, type, 0);
+	     code != -1;
+	     code = libevdev_get_next_event_code(from, type, code + 1)) {
+		const void *data = NULL;
+		int value;
+
+		if (libevdev_has_event_code(to, type, code))
+			continue;
+
+		if (type == EV_ABS) {
+			data = libevdev_get_abs_info(from, code);
+		} else if (type == EV_REP) {
+			libevdev_get_repeat(from,
+					    code == REP_DELAY ? &value : NULL,
+					    code == REP_PERIOD ? &value : NULL);
+			data = &value;
+		}
+
+		if (libevdev_enable_event_code(to, type, code, data) < 0)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_mux_new_device(const struct libevdev_mux *mux, struct libevdev **dev)
+{
+	const struct mux_source *s;
+	struct libevdev *d;
+	unsigned int type, prop;
+	int rc = 0;
+
+	d = libevdev_new();
+	if (!d)
+		return -ENOMEM;
+
+	if (mux->sources) {
+		const struct libevdev *first = mux->sources->dev;
+
+		libevdev_set_name(d, libevdev_get_name(first));
+		libevdev_set_id_bustype(d, libevdev_get_id_bustype(first));
+		libevdev_set_id_vendor(d, libevdev_get_id_vendor(first));
+		libevdev_set_id_product(d, libevdev_get_id_product(first));
+		libevdev_set_id_version(d, libevdev_get_id_version(first));
+	}
+
+	for (s = mux->sources; s && rc == 0; s = s->next) {
+		for (type = 0; type <= EV_MAX && rc == 0; type++) {
+			if (libevdev_has_event_type(s->dev, type))
+				rc = mux_union_type(d, s->dev, type);
+		}
+
+		for (prop = 0; prop <= INPUT_PROP_MAX && rc == 0; prop++) {
+			if (libevdev_has_property(s->dev, prop) &&
+			    libevdev_enable_property(d, prop) < 0)
+				rc = -ENOMEM;
+		}
+	}
+
+	if (rc < 0) {
+		libevdev_free(d);
+		return rc;
+	}
+
+	*dev = d;
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT void
+libevdev_mux_set_uinput(struct libevdev_mux *mux,
+			const struct libevdev_uinput *uinput_dev)
+{
+	mux->uinput = uinput_dev;
+}
+
+/**
+ * Buffer, merge and forward one event of a source.
+ *
+ * @return the number of events written to the uinput device, or a
+ * negative errno
+ */
+static int
+mux_process_event(struct libevdev_mux *mux, struct mux_source *s,
+		  const struct input_event *ev)
+{
+	if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+		/* the kernel dropped the rest of the frame, the hub syncs
+		   the device next */
+		s->nframe = 0;
+		s->dropping = false;
+		return 0;
+	}
+
+	if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+		if (s->dropping)
+			s->dropping = false;
+		else
+			mux_forward_frame(mux, s, ev);
+	} else if (s->dropping) {
+		return 0;
+	} else if (mux_buffer_event(s, ev) < 0) {
+		/* drop oversized frames as a whole, like the kernel would */
+		s->nframe = 0;
+		s->dropping = true;
+		return 0;
+	}
+
+	if (mux->nout >= MUX_BATCH_SIZE)
+		return mux_flush(mux);
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_mux_dispatch(struct libevdev_mux *mux, struct libevdev **dev)
+{
+	struct libevdev *from;
+	int written = 0;
+	int rc, err;
+
+	*dev = NULL;
+
+	/* a batch per read from each source, not an event */
+	while ((rc = libevdev_hub_next_events(mux->hub, &from, mux->in,
+					      ARRAY_LENGTH(mux->in))) > 0) {
+		struct mux_source *s = find_source(mux, from);
+		int i;
+
+		if (!s)
+			continue;
+
+		for (i = 0; i < rc; i++) {
+			err = mux_process_event(mux, s, &mux->in[i]);
+			if (err < 0)
+				return err;
+			written += err;
+		}
+	}
+
+	err = mux_flush(mux);
+	if (err < 0)
+		return err;
+	written += err;
+
+	if (rc == -EAGAIN)
+		return written;
+
+	if (from) {
+		struct mux_source *s = find_source(mux, from);
+
+		if (s) {
+			libevdev_hub_remove_device(mux->hub, from);
+			mux_release_keys(mux, s);
+			mux_unlink_source(mux, s);
+			mux_flush(mux);
+		}
+		*dev = from;
+	}
+
+	return rc;
+}
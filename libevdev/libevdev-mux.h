@@ -0,0 +1,225 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef LIBEVDEV_MUX_H
+#define LIBEVDEV_MUX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libevdev/libevdev.h>
+#include <libevdev/libevdev-uinput.h>
+
+struct libevdev_mux;
+
+/**
+ * @defgroup mux Merging multiple devices into one
+ *
+ * A multiplexer forwards the events of several source devices to a
+ * single uinput device, e.g. to present a keyboard and a macro pad as
+ * one keyboard. The sources are read through a @ref hub, so the caller
+ * only needs to wait for the multiplexer's fd to become readable and call
+ * libevdev_mux_dispatch().
+ *
+ * Events are forwarded one SYN_REPORT frame at a time, a frame of one
+ * source is never interleaved with the events of another source. Keys
+ * and buttons are reference-counted across the sources: a key is pressed
+ * when the first source presses it and released when the last source
+ * releases it. All other events are forwarded unchanged. SYN_DROPPED is
+ * handled by the hub, the events that bring a source back in sync are
+ * forwarded like any other frame.
+ *
+ * Each source is read in batches of events, and all events read by one
+ * call to libevdev_mux_dispatch() are written to the uinput device with
+ * as few write(2) calls as possible. Within one call, the frames of a
+ * source may therefore be forwarded ahead of earlier frames of another
+ * source.
+ *
+ * @code
+ * struct libevdev_mux *mux;
+ * struct libevdev *merged;
+ * struct libevdev_uinput *uidev;
+ * struct pollfd fds;
+ *
+ * libevdev_mux_new(&mux);
+ * libevdev_mux_add_device(mux, keyboard);
+ * libevdev_mux_add_device(mux, macropad);
+ *
+ * libevdev_mux_new_device(mux, &merged);
+ * libevdev_set_name(merged, "merged keyboard");
+ * libevdev_uinput_create_from_device(merged, LIBEVDEV_UINPUT_OPEN_MANAGED, &uidev);
+ * libevdev_free(merged);
+ * libevdev_mux_set_uinput(mux, uidev);
+ *
+ * fds.fd = libevdev_mux_get_fd(mux);
+ * fds.events = POLLIN;
+ *
+ * while (poll(&fds, 1, -1) > 0) {
+ *     struct libevdev *dev;
+ *     int rc = libevdev_mux_dispatch(mux, &dev);
+ *     if (rc < 0 && dev)
+ *         libevdev_free(dev); // removed from the multiplexer
+ * }
+ * @endcode
+ *
+ * Multitouch events are forwarded unchanged, merging the slots of several
+ * multitouch sources is not supported. A multiplexer does not own its
+ * sources or the uinput device and is not thread-safe.
+ */
+
+/**
+ * @ingroup mux
+ *
+ * Create a new multiplexer with no sources.
+ *
+ * @param[out] mux Set to the new multiplexer on success, NULL otherwise.
+ *
+ * @return 0 on success or a negative errno on failure.
+ *
+ * @see libevdev_mux_free
+ * @since 1.6
+ */
+int libevdev_mux_new(struct libevdev_mux **mux);
+
+/**
+ * @ingroup mux
+ *
+ * Free the multiplexer. The sources and the uinput device are not freed.
+ * Keys still held by a source are not released on the uinput device.
+ *
+ * @param mux The multiplexer to free, may be NULL.
+ *
+ * @since 1.6
+ */
+void libevdev_mux_free(struct libevdev_mux *mux);
+
+/**
+ * @ingroup mux
+ *
+ * Get the file descriptor of the multiplexer. It becomes readable when
+ * any source has events pending.
+ *
+ * @param mux The multiplexer
+ *
+ * @return The file descriptor of the multiplexer.
+ *
+ * @since 1.6
+ */
+int libevdev_mux_get_fd(const struct libevdev_mux *mux);
+
+/**
+ * @ingroup mux
+ *
+ * Add a source device. The device is added to the multiplexer's hub, it
+ * must not be in another hub. Keys the device holds down when it is
+ * added are ignored until they are pressed again.
+ *
+ * @param mux The multiplexer
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ *
+ * @return 0 on success or a negative errno on failure.
+ *
+ * @see libevdev_hub_add_device
+ * @since 1.6
+ */
+int libevdev_mux_add_device(struct libevdev_mux *mux, struct libevdev *dev);
+
+/**
+ * @ingroup mux
+ *
+ * Remove a source device. Keys held only by this source are released on
+ * the uinput device, events of an incomplete frame are discarded.
+ *
+ * @param mux The multiplexer
+ * @param dev A device previously added with libevdev_mux_add_device()
+ *
+ * @return 0 on success, -ENOENT if the device is not a source of this
+ * multiplexer or a negative errno if releasing the keys failed. The
+ * device is removed in any case unless -ENOENT is returned.
+ *
+ * @since 1.6
+ */
+int libevdev_mux_remove_device(struct libevdev_mux *mux, struct libevdev *dev);
+
+/**
+ * @ingroup mux
+ *
+ * Create a device with the union of the capabilities of all sources,
+ * suitable for libevdev_uinput_create_from_device(). The axis ranges and
+ * the repeat settings are taken from the first source that has them, the
+ * name and ids from the first source.
+ *
+ * The device is not backed by a file descriptor and must be freed with
+ * libevdev_free(). Sources added later are not reflected in the device,
+ * the events of their codes are dropped by the kernel unless the uinput
+ * device supports them.
+ *
+ * @param mux The multiplexer
+ * @param[out] dev Set to the new device on success
+ *
+ * @return 0 on success or a negative errno on failure.
+ *
+ * @since 1.6
+ */
+int libevdev_mux_new_device(const struct libevdev_mux *mux, struct libevdev **dev);
+
+/**
+ * @ingroup mux
+ *
+ * Set the uinput device the events are forwarded to. Until a uinput
+ * device is set, libevdev_mux_dispatch() reads and discards the events.
+ *
+ * @param mux The multiplexer
+ * @param uinput_dev The uinput device, or NULL
+ *
+ * @since 1.6
+ */
+void libevdev_mux_set_uinput(struct libevdev_mux *mux,
+			     const struct libevdev_uinput *uinput_dev);
+
+/**
+ * @ingroup mux
+ *
+ * Read all events currently pending on the sources and forward them to
+ * the uinput device. This function never blocks on the sources.
+ *
+ * If reading from a source fails, e.g. because the device was unplugged,
+ * the source is removed from the multiplexer as with
+ * libevdev_mux_remove_device(), the error is returned and dev is set to
+ * the source. The events read before the error are still forwarded.
+ *
+ * @param mux The multiplexer
+ * @param[out] dev Set to the source that failed, or NULL
+ *
+ * @return The number of events written to the uinput device or a
+ * negative errno on failure.
+ *
+ * @since 1.6
+ */
+int libevdev_mux_dispatch(struct libevdev_mux *mux, struct libevdev **dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBEVDEV_MUX_H */
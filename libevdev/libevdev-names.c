@@ -23,6 +23,7 @@
 #include <config.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <strings.h>
 
@@ -31,39 +32,52 @@
 #include "libevdev-util.h"
 #include "event-names.h"
 
-struct name_lookup {
-	const char *name;
-	size_t len;
-};
-
-static int cmp_entry(const void *vlookup, const void *ventry)
+/**
+ * Must match name_hash() in make-event-names.py
+ */
+static inline uint32_t
+name_hash(uint32_t seed, const char *name, size_t len)
 {
-	const struct name_lookup *lookup = vlookup;
-	const struct name_entry *entry = ventry;
-	int r;
-
-	r = strncmp(lookup->name, entry->name, lookup->len);
-	if (!r) {
-		if (entry->name[lookup->len])
-			r = -1;
-		else
-			r = 0;
+	uint32_t h = 0x811c9dc5 ^ seed;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)name[i];
+		h *= 0x01000193;
 	}
 
-	return r;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+
+	return h;
 }
 
-static const struct name_entry*
-lookup_name(const struct name_entry *array, size_t asize,
-	    struct name_lookup *lookup)
+/**
+ * Look up a name in the perfect hash table generated for array. This
+ * costs two hashes of the name and a single string compare.
+ *
+ * @return The index of the name in array, or -1 if not found
+ */
+static int
+lookup_name(const struct name_entry *array, const struct name_hash *hash,
+	    const char *name, size_t len)
 {
 	const struct name_entry *entry;
+	unsigned int slot;
+	int d;
 
-	entry = bsearch(lookup, array, asize, sizeof(*array), cmp_entry);
-	if (!entry)
-		return NULL;
+	d = hash->displacement[name_hash(0, name, len) % hash->size];
+	if (d < 0)
+		slot = -d - 1;
+	else
+		slot = name_hash(d, name, len) % hash->size;
 
-	return entry;
+	entry = &array[hash->slots[slot]];
+	if (strncmp(name, entry->name, len) != 0 || entry->name[len] != '\0')
+		return -1;
+
+	return hash->slots[slot];
 }
 
 LIBEVDEV_EXPORT int
@@ -75,44 +89,11 @@ libevdev_event_type_from_name(const char *name)
 LIBEVDEV_EXPORT int
 libevdev_event_type_from_name_n(const char *name, size_t len)
 {
-	struct name_lookup lookup;
-	const struct name_entry *entry;
+	int idx;
 
-	lookup.name = name;
-	lookup.len = len;
+	idx = lookup_name(ev_names, &ev_names_hash, name, len);
 
-	entry = lookup_name(ev_names, ARRAY_LENGTH(ev_names), &lookup);
-
-	return entry ? (int)entry->value : -1;
-}
-
-static int type_from_prefix(const char *name, ssize_t len)
-{
-	const char *e;
-	size_t i;
-	ssize_t l;
-
-	/* MAX_ is not allowed, even though EV_MAX exists */
-	if (startswith(name, len, "MAX_", 4))
-		return -1;
-	/* BTN_ is special as there is no EV_BTN type */
-	if (startswith(name, len, "BTN_", 4))
-		return EV_KEY;
-	/* FF_STATUS_ is special as FF_ is a prefix of it, so test it first */
-	if (startswith(name, len, "FF_STATUS_", 10))
-		return EV_FF_STATUS;
-
-	for (i = 0; i < ARRAY_LENGTH(ev_names); ++i) {
-		/* skip EV_ prefix so @e is suffix of [EV_]XYZ */
-		e = &ev_names[i].name[3];
-		l = strlen(e);
-
-		/* compare prefix and test for trailing _ */
-		if (len > l && startswith(name, len, e, l) && name[l] == '_')
-			return ev_names[i].value;
-	}
-
-	return -1;
+	return idx >= 0 ? (int)ev_names[idx].value : -1;
 }
 
 LIBEVDEV_EXPORT int
@@ -124,22 +105,17 @@ libevdev_event_code_from_name(unsigned int type, const char *name)
 LIBEVDEV_EXPORT int
 libevdev_event_code_from_name_n(unsigned int type, const char *name, size_t len)
 {
-	struct name_lookup lookup;
-	const struct name_entry *entry;
-	int real_type;
-
-	/* verify that @name is really of type @type */
-	real_type = type_from_prefix(name, len);
-	if (real_type < 0 || (unsigned int)real_type != type)
-		return -1;
+	int idx;
 
-	/* now look up the name @name and return the constant */
-	lookup.name = name;
-	lookup.len = len;
+	idx = lookup_name(code_names, &code_names_hash, name, len);
 
-	entry = lookup_name(code_names, ARRAY_LENGTH(code_names), &lookup);
+	/* verify that @name is really of type @type, code_types follows
+	 * the prefix rules with BTN_ as EV_KEY and FF_STATUS_ as
+	 * EV_FF_STATUS */
+	if (idx < 0 || code_types[idx] != type)
+		return -1;
 
-	return entry ? (int)entry->value : -1;
+	return code_names[idx].value;
 }
 
 LIBEVDEV_EXPORT int
@@ -151,13 +127,9 @@ libevdev_property_from_name(const char *name)
 LIBEVDEV_EXPORT int
 libevdev_property_from_name_n(const char *name, size_t len)
 {
-	struct name_lookup lookup;
-	const struct name_entry *entry;
-
-	lookup.name = name;
-	lookup.len = len;
+	int idx;
 
-	entry = lookup_name(prop_names, ARRAY_LENGTH(prop_names), &lookup);
+	idx = lookup_name(prop_names, &prop_names_hash, name, len);
 
-	return entry ? (int)entry->value : -1;
+	return idx >= 0 ? (int)prop_names[idx].value : -1;
 }
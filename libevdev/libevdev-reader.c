@@ -0,0 +1,323 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libevdev.h"
+#include "libevdev-int.h"
+#include "libevdev-reader.h"
+#include "libevdev-util.h"
+
+#define CACHELINE_SIZE 64
+
+/**
+ * One ring entry. events and slot_values point into the reader's
+ * buffers and are set up once, when the reader is created.
+ */
+struct libevdev_reader_frame {
+	size_t nevents;
+	bool sync;
+	int num_slots;
+	int current_slot;
+	struct input_event *events;	/**< [max_events] */
+	int *slot_values;		/**< [num_slots * ABS_MT_CNT] */
+	unsigned long key_values[NLONGS(KEY_CNT)];
+	unsigned long led_values[NLONGS(LED_CNT)];
+	unsigned long sw_values[NLONGS(SW_CNT)];
+	int abs_values[ABS_CNT];
+};
+
+struct libevdev_reader {
+	struct libevdev *dev;
+	struct libevdev_reader_frame *frames;
+	size_t mask;			/**< number of frames - 1 */
+	size_t max_events;		/**< events per frame */
+	struct input_event *events;
+	int *slot_values;
+
+	/* producer only */
+	bool syncing;
+	bool dropping;			/**< discard up to the next SYN_REPORT */
+	size_t dropped_frames;
+
+	/* head is only written by the producer, tail only by the consumer.
+	   Keep them on separate cache lines so the two threads don't
+	   bounce them. */
+	char pad0[CACHELINE_SIZE];
+	size_t head;			/**< next frame to publish */
+	char pad1[CACHELINE_SIZE - sizeof(size_t)];
+	size_t tail;			/**< next frame to consume */
+	char pad2[CACHELINE_SIZE - sizeof(size_t)];
+};
+
+LIBEVDEV_EXPORT int
+libevdev_reader_new(struct libevdev *dev, size_t nframes,
+		    struct libevdev_reader **reader)
+{
+	struct libevdev_reader *r;
+	size_t nslot_values;
+	size_t n = 1;
+	size_t i;
+
+	*reader = NULL;
+
+	if (!dev->initialized) {
+		log_bug(dev, "device not initialized. call libevdev_set_fd() first\n");
+		return -EBADF;
+	}
+
+	if (nframes == 0)
+		return -EINVAL;
+
+	while (n < nframes)
+		n <<= 1;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return -ENOMEM;
+
+	r->dev = dev;
+	r->mask = n - 1;
+	/* the queue may grow up to its maximum size, and with it the
+	   frames libevdev_next_frame() returns */
+	r->max_events = max(libevdev_get_queue_size(dev),
+			    dev->queue_config.max_size);
+	nslot_values = dev->num_slots > 0 ? dev->num_slots * ABS_MT_CNT : 0;
+
+	r->frames = calloc(n, sizeof(*r->frames));
+	r->events = calloc(n * r->max_events, sizeof(*r->events));
+	if (nslot_values)
+		r->slot_values = calloc(n * nslot_values, sizeof(*r->slot_values));
+
+	if (!r->frames || !r->events || (nslot_values && !r->slot_values)) {
+		libevdev_reader_free(r);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		r->frames[i].events = &r->events[i * r->max_events];
+		if (nslot_values)
+			r->frames[i].slot_values = &r->slot_values[i * nslot_values];
+	}
+
+	/* the caller may have left the device needing a sync */
+	r->syncing = dev->sync_state != SYNC_NONE;
+
+	*reader = r;
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT void
+libevdev_reader_free(struct libevdev_reader *reader)
+{
+	if (!reader)
+		return;
+
+	free(reader->frames);
+	free(reader->events);
+	free(reader->slot_values);
+	free(reader);
+}
+
+/**
+ * Copy the frame and the device state after it into the next ring
+ * entry. The caller has checked that the entry is free.
+ */
+static void
+publish_frame(struct libevdev_reader *reader, size_t head,
+	      const struct input_event *events, size_t nevents, bool sync)
+{
+	const struct libevdev *dev = reader->dev;
+	struct libevdev_reader_frame *frame = &reader->frames[head & reader->mask];
+	unsigned int i;
+
+	frame->nevents = nevents;
+	frame->sync = sync;
+	memcpy(frame->events, events, frame->nevents * sizeof(*events));
+
+	memcpy(frame->key_values, dev->key_values, sizeof(frame->key_values));
+	memcpy(frame->led_values, dev->led_values, sizeof(frame->led_values));
+	memcpy(frame->sw_values, dev->sw_values, sizeof(frame->sw_values));
+	for (i = 0; i < ABS_CNT; i++)
+		frame->abs_values[i] = libevdev_get_event_value(dev, EV_ABS, i);
+
+	frame->num_slots = dev->num_slots;
+	frame->current_slot = dev->current_slot;
+	if (frame->slot_values)
+		memcpy(frame->slot_values, dev->mt_slot_vals,
+		       dev->num_slots * ABS_MT_CNT * sizeof(*frame->slot_values));
+
+	/* pairs with the acquire in libevdev_reader_peek_frame(): the frame
+	   contents are visible before the new head */
+	__atomic_store_n(&reader->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static inline bool
+is_syn_report(const struct input_event *ev)
+{
+	return ev->type == EV_SYN && ev->code == SYN_REPORT;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_reader_dispatch(struct libevdev_reader *reader)
+{
+	const struct input_event *events;
+	size_t nevents;
+	int rc;
+
+	while (true) {
+		size_t head = reader->head;
+		/* pairs with the release in libevdev_reader_release_frame():
+		   the consumer is done with the entry we're about to reuse */
+		size_t tail = __atomic_load_n(&reader->tail, __ATOMIC_ACQUIRE);
+		unsigned int flags;
+
+		if (head - tail > reader->mask)
+			return -ENOSPC;
+
+		flags = reader->syncing ? LIBEVDEV_READ_FLAG_SYNC : LIBEVDEV_READ_FLAG_NORMAL;
+		rc = libevdev_next_frame(reader->dev, flags, &events, &nevents);
+
+		if (rc == -EAGAIN) {
+			/* sync done, continue with the normal events */
+			if (reader->syncing) {
+				reader->syncing = false;
+				continue;
+			}
+			return -EAGAIN;
+		}
+
+		if (rc < 0)
+			return rc;
+
+		if (rc == LIBEVDEV_READ_STATUS_SYNC && !reader->syncing) {
+			/* SYN_DROPPED, the frame so far is garbage */
+			reader->syncing = true;
+			reader->dropping = false;
+			continue;
+		}
+
+		/* Frames that don't fit into a ring entry are dropped as a
+		   whole. libevdev_next_frame() returns frames longer than its
+		   buffer in pieces, only the last ends in a SYN_REPORT. The
+		   sync frames always fit, the queue holds the whole state. */
+		if (!reader->syncing &&
+		    (reader->dropping || nevents > reader->max_events ||
+		     !is_syn_report(&events[nevents - 1]))) {
+			if (!reader->dropping)
+				reader->dropped_frames++;
+			reader->dropping = !is_syn_report(&events[nevents - 1]);
+			continue;
+		}
+
+		publish_frame(reader, head, events, nevents, reader->syncing);
+	}
+}
+
+LIBEVDEV_EXPORT size_t
+libevdev_reader_get_num_dropped_frames(const struct libevdev_reader *reader)
+{
+	return reader->dropped_frames;
+}
+
+LIBEVDEV_EXPORT const struct libevdev_reader_frame *
+libevdev_reader_peek_frame(struct libevdev_reader *reader)
+{
+	size_t tail = reader->tail;
+	/* pairs with the release in publish_frame() */
+	size_t head = __atomic_load_n(&reader->head, __ATOMIC_ACQUIRE);
+
+	if (tail == head)
+		return NULL;
+
+	return &reader->frames[tail & reader->mask];
+}
+
+LIBEVDEV_EXPORT void
+libevdev_reader_release_frame(struct libevdev_reader *reader)
+{
+	size_t tail = reader->tail;
+
+	if (tail == __atomic_load_n(&reader->head, __ATOMIC_ACQUIRE)) {
+		log_bug(reader->dev, "no frame to release\n");
+		return;
+	}
+
+	/* pairs with the acquire in libevdev_reader_dispatch() */
+	__atomic_store_n(&reader->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+LIBEVDEV_EXPORT const struct input_event *
+libevdev_reader_frame_get_events(const struct libevdev_reader_frame *frame,
+				 size_t *nevents)
+{
+	*nevents = frame->nevents;
+	return frame->events;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_reader_frame_is_sync(const struct libevdev_reader_frame *frame)
+{
+	return frame->sync;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_reader_frame_get_event_value(const struct libevdev_reader_frame *frame,
+				      unsigned int type,
+				      unsigned int code)
+{
+	int max = libevdev_event_type_get_max(type);
+
+	if (max == -1 || code > (unsigned int)max)
+		return 0;
+
+	switch (type) {
+		case EV_KEY: return bit_is_set(frame->key_values, code);
+		case EV_LED: return bit_is_set(frame->led_values, code);
+		case EV_SW: return bit_is_set(frame->sw_values, code);
+		case EV_ABS: return frame->abs_values[code];
+		default: return 0;
+	}
+}
+
+LIBEVDEV_EXPORT int
+libevdev_reader_frame_get_slot_value(const struct libevdev_reader_frame *frame,
+				     unsigned int slot,
+				     unsigned int code)
+{
+	if (!frame->slot_values ||
+	    slot >= (unsigned int)frame->num_slots ||
+	    code < ABS_MT_MIN || code > ABS_MT_MAX)
+		return 0;
+
+	return frame->slot_values[slot * ABS_MT_CNT + code - ABS_MT_MIN];
+}
+
+LIBEVDEV_EXPORT int
+libevdev_reader_frame_get_current_slot(const struct libevdev_reader_frame *frame)
+{
+	return frame->current_slot;
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef LIBEVDEV_READER_H
+#define LIBEVDEV_READER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <libevdev/libevdev.h>
+
+struct libevdev_reader;
+struct libevdev_reader_frame;
+
+/**
+ * @defgroup reader Handing frames to another thread
+ *
+ * A reader moves complete frames from a device on one thread, the
+ * producer, to a single other thread, the consumer, through a
+ * fixed-size lock-free ring. The producer calls
+ * libevdev_reader_dispatch() whenever the device's fd is readable. This
+ * reads the events, handles SYN_DROPPED and publishes each complete
+ * frame together with a copy of the device state after that frame. The
+ * consumer fetches frames with libevdev_reader_peek_frame() and
+ * libevdev_reader_release_frame(). Neither side ever blocks or takes a
+ * lock.
+ *
+ * @code
+ * // producer thread
+ * while (poll(&fds, 1, -1) > 0) {
+ *     rc = libevdev_reader_dispatch(reader);
+ *     if (rc == -ENOSPC)
+ *         wait_for_consumer();
+ *     else if (rc < 0 && rc != -EAGAIN)
+ *         break;
+ * }
+ *
+ * // consumer thread
+ * const struct libevdev_reader_frame *frame;
+ * while ((frame = libevdev_reader_peek_frame(reader))) {
+ *     const struct input_event *events;
+ *     size_t nevents;
+ *
+ *     events = libevdev_reader_frame_get_events(frame, &nevents);
+ *     handle_frame(events, nevents,
+ *                  libevdev_reader_frame_get_event_value(frame, EV_ABS, ABS_X));
+ *     libevdev_reader_release_frame(reader);
+ * }
+ * @endcode
+ *
+ * Threading contract:
+ * - Once the reader is created, only the producer thread may call
+ *   libevdev functions on the device, and only the producer calls
+ *   libevdev_reader_dispatch().
+ * - Only the consumer thread calls libevdev_reader_peek_frame(),
+ *   libevdev_reader_release_frame() and the libevdev_reader_frame
+ *   accessors.
+ * - A frame is published with release semantics after its events and
+ *   state have been written, and libevdev_reader_peek_frame() loads it
+ *   with acquire semantics. Everything the accessors return for a frame
+ *   is therefore the device state exactly after that frame's
+ *   SYN_REPORT, regardless of what the producer does meanwhile.
+ * - A frame stays valid until libevdev_reader_release_frame(), which
+ *   hands the slot back to the producer with release semantics. The
+ *   consumer must not access the frame afterwards.
+ *
+ * When a device reports SYN_DROPPED, the incomplete frame before it is
+ * discarded. The producer then publishes a frame with the events
+ * needed to bring the consumer's view up to date and marks it with
+ * libevdev_reader_frame_is_sync().
+ *
+ * If the ring is full, libevdev_reader_dispatch() stops reading and
+ * returns -ENOSPC. Unread events stay in the kernel buffer, which may
+ * eventually overflow and cause a SYN_DROPPED that is handled as above.
+ * A frame too long for a ring entry is dropped and counted, see
+ * libevdev_reader_get_num_dropped_frames(). Frames are never truncated
+ * or dropped silently.
+ */
+
+/**
+ * @ingroup reader
+ *
+ * Create a reader for the given device with room for nframes frames.
+ * Each ring entry holds up to libevdev_get_queue_size() events, or the
+ * maximum queue size set with libevdev_set_queue_max_size() if that is
+ * larger, so both should be set before creating the reader. Longer
+ * frames are dropped.
+ *
+ * The reader does not own the device. The device must not be freed
+ * before the reader.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param nframes The number of frames in the ring, rounded up to a power
+ * of two
+ * @param[out] reader Set to the new reader on success, NULL otherwise.
+ *
+ * @return 0 on success or a negative errno on failure.
+ *
+ * @see libevdev_reader_free
+ * @since 1.6
+ */
+int libevdev_reader_new(struct libevdev *dev, size_t nframes,
+			struct libevdev_reader **reader);
+
+/**
+ * @ingroup reader
+ *
+ * Free the reader. Both threads must have stopped using it.
+ *
+ * @param reader The reader to free, may be NULL.
+ *
+ * @since 1.6
+ */
+void libevdev_reader_free(struct libevdev_reader *reader);
+
+/**
+ * @ingroup reader
+ *
+ * Producer side: read all events available on the device and publish
+ * each complete frame. This function never blocks. It must only be
+ * called from the producer thread.
+ *
+ * @param reader The reader
+ *
+ * @return On failure, a negative errno is returned.
+ * @retval -EAGAIN All available events were read and published
+ * @retval -ENOSPC The ring is full. The remaining events stay queued, call
+ * this function again once the consumer has released frames.
+ *
+ * @since 1.6
+ */
+int libevdev_reader_dispatch(struct libevdev_reader *reader);
+
+/**
+ * @ingroup reader
+ *
+ * Producer side: get the number of frames dropped because they were
+ * longer than a ring entry, see libevdev_reader_new(). It must only be
+ * called from the producer thread.
+ *
+ * @param reader The reader
+ *
+ * @return The number of frames dropped since the reader was created.
+ *
+ * @since 1.6
+ */
+size_t libevdev_reader_get_num_dropped_frames(const struct libevdev_reader *reader);
+
+/**
+ * @ingroup reader
+ *
+ * Consumer side: get the oldest published frame without removing it. The
+ * same frame is returned until libevdev_reader_release_frame() is called.
+ * It must only be called from the consumer thread.
+ *
+ * @param reader The reader
+ *
+ * @return The oldest frame or NULL if no frame is available.
+ *
+ * @since 1.6
+ */
+const struct libevdev_reader_frame *
+libevdev_reader_peek_frame(struct libevdev_reader *reader);
+
+/**
+ * @ingroup reader
+ *
+ * Consumer side: release the frame returned by
+ * libevdev_reader_peek_frame() and hand its slot back to the producer.
+ * Calling this function without a frame available is a bug.
+ *
+ * @param reader The reader
+ *
+ * @since 1.6
+ */
+void libevdev_reader_release_frame(struct libevdev_reader *reader);
+
+/**
+ * @ingroup reader
+ *
+ * @param frame A frame returned by libevdev_reader_peek_frame()
+ * @param[out] nevents Set to the number of events in the frame
+ *
+ * @return The events of the frame. The last event is an EV_SYN
+ * SYN_REPORT.
+ *
+ * @since 1.6
+ */
+const struct input_event *
+libevdev_reader_frame_get_events(const struct libevdev_reader_frame *frame,
+				 size_t *nevents);
+
+/**
+ * @ingroup reader
+ *
+ * @param frame A frame returned by libevdev_reader_peek_frame()
+ *
+ * @return 1 if the frame contains the events synced after a SYN_DROPPED,
+ * 0 otherwise.
+ *
+ * @since 1.6
+ */
+int libevdev_reader_frame_is_sync(const struct libevdev_reader_frame *frame);
+
+/**
+ * @ingroup reader
+ *
+ * The equivalent of libevdev_get_event_value() at the time of this frame.
+ * Only EV_KEY, EV_LED, EV_SW and EV_ABS have a state, any other type
+ * returns 0.
+ *
+ * @param frame A frame returned by libevdev_reader_peek_frame()
+ * @param type The event type for the code to query (EV_SYN, EV_REL, etc.)
+ * @param code The event code to query for, one of ABS_X, REL_X, etc.
+ *
+ * @return The current value of the event.
+ *
+ * @since 1.6
+ */
+int libevdev_reader_frame_get_event_value(const struct libevdev_reader_frame *frame,
+					  unsigned int type,
+					  unsigned int code);
+
+/**
+ * @ingroup reader
+ *
+ * The equivalent of libevdev_get_slot_value() at the time of this frame.
+ *
+ * @param frame A frame returned by libevdev_reader_peek_frame()
+ * @param slot The numerical slot number, must be smaller than the total
+ * number of slots on this device
+ * @param code The event code to query for, one of ABS_MT_POSITION_X, etc.
+ *
+ * @return The current value of the code for the given slot, or 0 if the
+ * slot or code is invalid.
+ *
+ * @since 1.6
+ */
+int libevdev_reader_frame_get_slot_value(const struct libevdev_reader_frame *frame,
+					 unsigned int slot,
+					 unsigned int code);
+
+/**
+ * @ingroup reader
+ *
+ * The equivalent of libevdev_get_current_slot() at the time of this
+ * frame.
+ *
+ * @param frame A frame returned by libevdev_reader_peek_frame()
+ *
+ * @return The current slot, or -1 if the device is not a multitouch
+ * device.
+ *
+ * @since 1.6
+ */
+int libevdev_reader_frame_get_current_slot(const struct libevdev_reader_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBEVDEV_READER_H */
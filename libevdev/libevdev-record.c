@@ -0,0 +1,506 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libevdev.h"
+#include "libevdev-int.h"
+#include "libevdev-record.h"
+#include "libevdev-util.h"
+
+/*
+ * A recording is a header, the device description and the events:
+ *
+ *   struct record_header
+ *   description		[description_size bytes]
+ *   padding		to events_offset, 8-byte aligned
+ *   events		until the end of the file
+ *
+ * Each event is encoded as
+ *
+ *   time delta		signed varint, us since the previous event
+ *			(since 0 for the first event)
+ *   type		1 byte
+ *   code		unsigned varint
+ *   value		signed varint
+ *
+ * where a varint is an LEB128 number and signed numbers are zigzag
+ * encoded first, so small negative values stay small.
+ */
+#define RECORD_MAGIC "EVRC"
+#define RECORD_VERSION 1
+#define RECORD_ALIGN 8
+
+/* type, and 10 bytes for each 64-bit varint */
+#define RECORD_EVENT_MAX_SIZE (1 + 3 * 10)
+
+#define RECORD_BUFFER_SIZE 4096
+#define REPLAY_BATCH_SIZE 64
+
+struct record_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t description_size;
+	uint32_t events_offset;
+};
+
+struct libevdev_recorder {
+	int fd;
+	int64_t last_time;		/**< us, of the last event recorded */
+	size_t len;			/**< bytes in buffer */
+	unsigned char buffer[RECORD_BUFFER_SIZE];
+};
+
+struct libevdev_replay {
+	struct libevdev *dev;
+	const unsigned char *data;	/**< the mapped file */
+	size_t size;
+	size_t events_offset;
+	size_t offset;			/**< of the next event */
+	int64_t time;			/**< us, of the last event returned */
+};
+
+static inline size_t
+record_align(size_t offset)
+{
+	return (offset + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+static inline int64_t
+timeval_to_us(const struct timeval *tv)
+{
+	return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static inline uint64_t
+zigzag_encode(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t
+zigzag_decode(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline size_t
+varint_put(unsigned char *buf, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		buf[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	buf[n++] = v;
+
+	return n;
+}
+
+/**
+ * @return the number of bytes consumed, 0 if the data ends before the
+ * varint or -1 if the varint is too long
+ */
+static inline int
+varint_get(const unsigned char *buf, size_t size, uint64_t *v)
+{
+	size_t i;
+
+	*v = 0;
+	for (i = 0; i < size && i < 10; i++) {
+		*v |= (uint64_t)(buf[i] & 0x7f) << (7 * i);
+		if ((buf[i] & 0x80) == 0)
+			return i + 1;
+	}
+
+	return i == size ? 0 : -1;
+}
+
+static int
+write_all(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+
+	while (size > 0) {
+		ssize_t rc = write(fd, p, size);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		p += rc;
+		size -= rc;
+	}
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_recorder_new(const struct libevdev *dev, int fd,
+		      struct libevdev_recorder **recorder)
+{
+	struct libevdev_recorder *r;
+	struct record_header header;
+	static const char padding[RECORD_ALIGN];
+	void *description;
+	int size;
+	int rc;
+
+	*recorder = NULL;
+
+	size = libevdev_write_description(dev, NULL, 0);
+	if (size < 0)
+		return size;
+
+	description = malloc(size);
+	r = calloc(1, sizeof(*r));
+	if (!description || !r) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	libevdev_write_description(dev, description, size);
+
+	memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+	header.version = RECORD_VERSION;
+	header.description_size = size;
+	header.events_offset = record_align(sizeof(header) + size);
+
+	rc = write_all(fd, &header, sizeof(header));
+	if (rc == 0)
+		rc = write_all(fd, description, size);
+	if (rc == 0)
+		rc = write_all(fd, padding,
+			       header.events_offset - sizeof(header) - size);
+	if (rc < 0)
+		goto out;
+
+	r->fd = fd;
+	*recorder = r;
+	r = NULL;
+out:
+	free(description);
+	free(r);
+	return rc;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_recorder_flush(struct libevdev_recorder *recorder)
+{
+	int rc;
+
+	rc = write_all(recorder->fd, recorder->buffer, recorder->len);
+	recorder->len = 0;
+
+	return rc;
+}
+
+LIBEVDEV_EXPORT void
+libevdev_recorder_free(struct libevdev_recorder *recorder)
+{
+	if (!recorder)
+		return;
+
+	libevdev_recorder_flush(recorder);
+	free(recorder);
+}
+
+LIBEVDEV_EXPORT int
+libevdev_recorder_write_events(struct libevdev_recorder *recorder,
+			       const struct input_event *events,
+			       size_t nevents)
+{
+	size_t i;
+
+	for (i = 0; i < nevents; i++) {
+		const struct input_event *ev = &events[i];
+		unsigned char *buf;
+		int64_t time;
+
+		if (recorder->len + RECORD_EVENT_MAX_SIZE > sizeof(recorder->buffer)) {
+			int rc = libevdev_recorder_flush(recorder);
+			if (rc < 0)
+				return rc;
+		}
+
+		time = timeval_to_us(&ev->time);
+		buf = recorder->buffer + recorder->len;
+
+		buf += varint_put(buf, zigzag_encode(time - recorder->last_time));
+		*buf++ = ev->type;
+		buf += varint_put(buf, ev->code);
+		buf += varint_put(buf, zigzag_encode(ev->value));
+
+		recorder->len = buf - recorder->buffer;
+		recorder->last_time = time;
+	}
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_replay_new(int fd, struct libevdev_replay **replay)
+{
+	struct libevdev_replay *r;
+	struct record_header header;
+	struct stat st;
+	void *data;
+	int rc;
+
+	*replay = NULL;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	if ((size_t)st.st_size < sizeof(header))
+		return -EINVAL;
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return -errno;
+
+	r = calloc(1, sizeof(*r));
+	if (!r) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	r->data = data;
+	r->size = st.st_size;
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.version != RECORD_VERSION ||
+	    header.events_offset < sizeof(header) + (size_t)header.description_size ||
+	    header.events_offset > r->size) {
+		rc = -EINVAL;
+		goto out;
+	}
+
+	rc = libevdev_new_from_description(r->data + sizeof(header),
+					   header.description_size,
+					   &r->dev);
+	if (rc < 0)
+		goto out;
+
+	r->events_offset = header.events_offset;
+	libevdev_replay_rewind(r);
+
+	*replay = r;
+	r = NULL;
+out:
+	if (r)
+		libevdev_replay_free(r);
+	else if (rc < 0)
+		munmap(data, st.st_size);
+	return rc;
+}
+
+LIBEVDEV_EXPORT void
+libevdev_replay_free(struct libevdev_replay *replay)
+{
+	if (!replay)
+		return;
+
+	libevdev_free(replay->dev);
+	munmap((void*)replay->data, replay->size);
+	free(replay);
+}
+
+LIBEVDEV_EXPORT const struct libevdev *
+libevdev_replay_get_device(const struct libevdev_replay *replay)
+{
+	return replay->dev;
+}
+
+LIBEVDEV_EXPORT void
+libevdev_replay_rewind(struct libevdev_replay *replay)
+{
+	replay->offset = replay->events_offset;
+	replay->time = 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_replay_next_event(struct libevdev_replay *replay,
+			   struct input_event *ev)
+{
+	const unsigned char *p = replay->data + replay->offset;
+	size_t size = replay->size - replay->offset;
+	uint64_t delta, code, value;
+	int64_t time;
+	int n;
+
+	if (size == 0)
+		return -ENODATA;
+
+	n = varint_get(p, size, &delta);
+	if (n <= 0 || (size_t)n == size)
+		goto error;
+	p += n;
+	size -= n;
+
+	ev->type = *p++;
+	size--;
+
+	n = varint_get(p, size, &code);
+	if (n <= 0)
+		goto error;
+	p += n;
+	size -= n;
+
+	n = varint_get(p, size, &value);
+	if (n <= 0)
+		goto error;
+	p += n;
+
+	if (code > UINT16_MAX)
+		return -EINVAL;
+
+	time = replay->time + zigzag_decode(delta);
+	ev->time.tv_sec = time / 1000000;
+	ev->time.tv_usec = time % 1000000;
+	ev->code = code;
+	ev->value = zigzag_decode(value);
+
+	replay->time = time;
+	replay->offset = p - replay->data;
+
+	return 0;
+
+error:
+	/* a truncated last event is the end of the recording */
+	return n < 0 ? -EINVAL : -ENODATA;
+}
+
+static void
+timespec_add_us(struct timespec *ts, int64_t us)
+{
+	int64_t ns = ts->tv_nsec + (us % 1000000) * 1000;
+
+	ts->tv_sec += us / 1000000 + ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+}
+
+static int
+replay_post(const struct libevdev_uinput *uinput_dev,
+	    const struct input_event *events, size_t nevents)
+{
+	size_t posted = 0;
+
+	while (posted < nevents) {
+		int rc = libevdev_uinput_write_events(uinput_dev,
+						      events + posted,
+						      nevents - posted);
+		if (rc < 0) {
+			if (rc == -EINTR)
+				continue;
+			return rc;
+		}
+		posted += rc;
+	}
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_replay_run(struct libevdev_replay *replay,
+		    const struct libevdev_uinput *uinput_dev,
+		    double speed)
+{
+	struct input_event batch[REPLAY_BATCH_SIZE];
+	struct input_event ev;
+	struct timespec start;
+	size_t nbatch = 0;
+	int64_t first = 0, batch_time = 0;
+	int nposted = 0;
+	int rc;
+
+	if (speed < 0)
+		return -EINVAL;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	libevdev_replay_rewind(replay);
+
+	do {
+		bool flush;
+		int64_t time = 0;
+
+		/* stop early rather than overflow the return value, the
+		   pending batch is flushed like at the end of the recording */
+		if (nposted + (int)nbatch == INT_MAX)
+			rc = -ENODATA;
+		else
+			rc = libevdev_replay_next_event(replay, &ev);
+		if (rc == -EINVAL)
+			return rc;
+
+		if (rc == 0) {
+			if (ev.type == EV_SYN && ev.code == SYN_DROPPED)
+				continue;
+
+			time = timeval_to_us(&ev.time);
+			if (nposted == 0 && nbatch == 0)
+				first = time;
+		}
+
+		flush = nbatch == REPLAY_BATCH_SIZE ||
+			(nbatch > 0 && (rc != 0 || (speed > 0 && time != batch_time)));
+
+		if (flush) {
+			if (speed > 0 && batch_time > first) {
+				struct timespec when = start;
+
+				timespec_add_us(&when, (batch_time - first) / speed);
+				while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+						       &when, NULL) == EINTR)
+					;
+			}
+
+			int err = replay_post(uinput_dev, batch, nbatch);
+			if (err < 0)
+				return err;
+
+			nposted += nbatch;
+			nbatch = 0;
+		}
+
+		if (rc == 0) {
+			batch[nbatch++] = ev;
+			batch_time = time;
+		}
+	} while (rc == 0);
+
+	return nposted;
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef LIBEVDEV_RECORD_H
+#define LIBEVDEV_RECORD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libevdev/libevdev.h>
+#include <libevdev/libevdev-uinput.h>
+
+struct libevdev_recorder;
+struct libevdev_replay;
+
+/**
+ * @defgroup record Recording and replaying events
+ *
+ * A recorder writes the description of a device (see
+ * libevdev_write_description()) and a sequence of events to a file. The
+ * events are stored in a compact variable-length encoding. Each
+ * timestamp is stored as the difference to the previous event, so events
+ * within one frame usually take only a few bytes each.
+ *
+ * A replay maps such a recording into memory. It recreates the device and
+ * posts the events through a uinput device, with the original timing,
+ * scaled timing or as fast as possible.
+ *
+ * @code
+ * struct libevdev_replay *replay;
+ * struct libevdev_uinput *uidev;
+ * int rc;
+ *
+ * rc = libevdev_replay_new(fd, &replay);
+ * if (rc < 0)
+ *     return rc;
+ *
+ * rc = libevdev_uinput_create_from_device(libevdev_replay_get_device(replay),
+ *                                         LIBEVDEV_UINPUT_OPEN_MANAGED,
+ *                                         &uidev);
+ * if (rc == 0) {
+ *     rc = libevdev_replay_run(replay, uidev, 1.0);
+ *     libevdev_uinput_destroy(uidev);
+ * }
+ * libevdev_replay_free(replay);
+ * @endcode
+ *
+ * The file format depends on the architecture, like the device
+ * description it contains. Recorders and replays are not thread-safe.
+ */
+
+/**
+ * @ingroup record
+ *
+ * Create a new recorder that writes to the given fd. The header and the
+ * description of the device are written immediately, the events are
+ * buffered.
+ *
+ * @param dev The device to record, its current capabilities are written
+ * to the recording
+ * @param fd A file descriptor open for writing. It is not closed when
+ * the recorder is freed.
+ * @param[out] recorder Set to the new recorder on success, NULL otherwise.
+ *
+ * @return 0 on success or a negative errno on failure.
+ *
+ * @see libevdev_recorder_free
+ * @since 1.6
+ */
+int libevdev_recorder_new(const struct libevdev *dev, int fd,
+			  struct libevdev_recorder **recorder);
+
+/**
+ * @ingroup record
+ *
+ * Flush any buffered events and free the recorder. Errors while flushing
+ * are lost, call libevdev_recorder_flush() first to check for them.
+ *
+ * @param recorder The recorder to free, may be NULL.
+ *
+ * @since 1.6
+ */
+void libevdev_recorder_free(struct libevdev_recorder *recorder);
+
+/**
+ * @ingroup record
+ *
+ * Append events to the recording. The events are usually the ones
+ * returned by libevdev_next_event() or libevdev_next_events(), in order.
+ * They are written to the fd when the internal buffer is full, or with
+ * libevdev_recorder_flush().
+ *
+ * @param recorder The recorder
+ * @param events The events to record
+ * @param nevents The number of events in events
+ *
+ * @return 0 on success or a negative errno if writing to the fd failed.
+ *
+ * @since 1.6
+ */
+int libevdev_recorder_write_events(struct libevdev_recorder *recorder,
+				   const struct input_event *events,
+				   size_t nevents);
+
+/**
+ * @ingroup record
+ *
+ * Write all buffered events to the fd.
+ *
+ * @param recorder The recorder
+ *
+ * @return 0 on success or a negative errno if writing to the fd failed.
+ *
+ * @since 1.6
+ */
+int libevdev_recorder_flush(struct libevdev_recorder *recorder);
+
+/**
+ * @ingroup record
+ *
+ * Open a recording for replay. The file is mapped into memory, the
+ * device description is read immediately.
+ *
+ * @param fd A file descriptor to a recording, open for reading. The fd
+ * may be closed once this function returns.
+ * @param[out] replay Set to the new replay on success, NULL otherwise.
+ *
+ * @return 0 on success or a negative errno on failure. -EINVAL means the
+ * file is not a valid recording, -ENOTSUP means it was recorded on a
+ * different architecture.
+ *
+ * @see libevdev_replay_free
+ * @since 1.6
+ */
+int libevdev_replay_new(int fd, struct libevdev_replay **replay);
+
+/**
+ * @ingroup record
+ *
+ * Unmap the recording and free the replay.
+ *
+ * @param replay The replay to free, may be NULL.
+ *
+ * @since 1.6
+ */
+void libevdev_replay_free(struct libevdev_replay *replay);
+
+/**
+ * @ingroup record
+ *
+ * Get the device as it was recorded. The device is not backed by a file
+ * descriptor but can be passed to libevdev_uinput_create_from_device().
+ *
+ * @param replay The replay
+ *
+ * @return The recorded device. It is freed by libevdev_replay_free().
+ *
+ * @since 1.6
+ */
+const struct libevdev *libevdev_replay_get_device(const struct libevdev_replay *replay);
+
+/**
+ * @ingroup record
+ *
+ * Get the next event of the recording, with its original timestamp.
+ *
+ * @param replay The replay
+ * @param[out] ev Set to the next event
+ *
+ * @return 0 on success, -ENODATA at the end of the recording or -EINVAL
+ * if the recording is corrupt. A recording that ends in the middle of an
+ * event, e.g. because the recorder was not flushed, ends at the last
+ * complete event.
+ *
+ * @see libevdev_replay_rewind
+ * @since 1.6
+ */
+int libevdev_replay_next_event(struct libevdev_replay *replay,
+			       struct input_event *ev);
+
+/**
+ * @ingroup record
+ *
+ * Go back to the first event of the recording.
+ *
+ * @param replay The replay
+ *
+ * @since 1.6
+ */
+void libevdev_replay_rewind(struct libevdev_replay *replay);
+
+/**
+ * @ingroup record
+ *
+ * Post all events of the recording through the uinput device, starting
+ * from the first event. Events with the same timestamp are posted with a
+ * single write(2). SYN_DROPPED events in the recording are not posted.
+ *
+ * If speed is positive, the time between two events is the original time
+ * divided by speed, i.e. a speed of 1.0 replays the events with their
+ * original timing and a speed of 2.0 twice as fast. This function then
+ * blocks for the length of the (scaled) recording. If speed is 0, the
+ * events are posted as fast as possible, in batches of up to 64 events.
+ *
+ * The kernel assigns new timestamps to the posted events.
+ *
+ * @param replay The replay
+ * @param uinput_dev A uinput device, usually created from
+ * libevdev_replay_get_device()
+ * @param speed The replay speed, or 0 to replay as fast as possible
+ *
+ * @return The number of events posted or a negative errno on failure.
+ *
+ * @since 1.6
+ */
+int libevdev_replay_run(struct libevdev_replay *replay,
+			const struct libevdev_uinput *uinput_dev,
+			double speed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBEVDEV_RECORD_H */
@@ -26,5 +26,7 @@ struct libevdev_uinput {
 	char *name; /**< device name */
 	char *syspath; /**< /sys path */
 	char *devnode; /**< device node */
+	int syspath_fetched; /**< syspath lookup done, syspath may be NULL */
+	int devnode_fetched; /**< devnode lookup done, devnode may be NULL */
 	time_t ctime[2]; /**< before/after UI_DEV_CREATE */
 };
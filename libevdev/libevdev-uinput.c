@@ -26,6 +26,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
@@ -84,7 +85,7 @@ set_evbits(const struct libevdev *dev, int fd, struct uinput_user_dev *uidev)
 	unsigned int type;
 
 	for (type = 0; type < EV_CNT; type++) {
-		unsigned int code;
+		int code;
 		int max;
 		int uinput_bit;
 		const unsigned long *mask;
@@ -119,10 +120,9 @@ set_evbits(const struct libevdev *dev, int fd, struct uinput_user_dev *uidev)
 				    goto out;
 		}
 
-		for (code = 0; code <= (unsigned int)max; code++) {
-			if (!libevdev_has_event_code(dev, type, code))
-				continue;
-
+		for (code = libevdev_get_next_event_code(dev, type, 0);
+		     code != -1;
+		     code = libevdev_get_next_event_code(dev, type, code + 1)) {
 			rc = ioctl(fd, uinput_bit, code);
 			if (rc == -1)
 				goto out;
@@ -184,82 +184,76 @@ libevdev_uinput_get_fd(const struct libevdev_uinput *uinput_dev)
 	return uinput_dev->fd;
 }
 
-static int is_event_device(const struct dirent *dent) {
-	return strncmp("event", dent->d_name, 5) == 0;
-}
-
+/**
+ * Look up the event node in the given sysfs directory. This reads the
+ * directory entries until the first eventN instead of sorting all of
+ * them.
+ */
 static char *
 fetch_device_node(const char *path)
 {
 	char *devnode = NULL;
-	struct dirent **namelist;
-	int ndev, i;
+	struct dirent *dent;
+	DIR *dir;
 
-	ndev = scandir(path, &namelist, is_event_device, alphasort);
-	if (ndev <= 0)
+	dir = opendir(path);
+	if (!dir)
 		return NULL;
 
-	/* ndev should only ever be 1 */
+	while ((dent = readdir(dir))) {
+		if (strncmp("event", dent->d_name, 5) != 0)
+			continue;
 
-	for (i = 0; i < ndev; i++) {
-		if (!devnode && asprintf(&devnode, "/dev/input/%s", namelist[i]->d_name) == -1)
+		if (asprintf(&devnode, "/dev/input/%s", dent->d_name) == -1)
 			devnode = NULL;
-		free(namelist[i]);
+		break;
 	}
 
-	free(namelist);
+	closedir(dir);
 
 	return devnode;
 }
 
-static int is_input_device(const struct dirent *dent) {
-	return strncmp("input", dent->d_name, 5) == 0;
-}
-
-static int
-fetch_syspath_and_devnode(struct libevdev_uinput *uinput_dev)
+/**
+ * Guess the syspath for kernels without UI_GET_SYSNAME: find a device
+ * with our name that was created during UI_DEV_CREATE.
+ */
+static void
+guess_syspath(struct libevdev_uinput *uinput_dev)
 {
-	struct dirent **namelist;
-	int ndev, i;
+	struct dirent *dent;
+	DIR *dir;
 	int rc;
 	char buf[sizeof(SYS_INPUT_DIR) + 64] = SYS_INPUT_DIR;
 
-	rc = ioctl(uinput_dev->fd,
-		   UI_GET_SYSNAME(sizeof(buf) - strlen(SYS_INPUT_DIR)),
-		   &buf[strlen(SYS_INPUT_DIR)]);
-	if (rc != -1) {
-		uinput_dev->syspath = strdup(buf);
-		uinput_dev->devnode = fetch_device_node(buf);
-		return 0;
-	}
-
-	ndev = scandir(SYS_INPUT_DIR, &namelist, is_input_device, alphasort);
-	if (ndev <= 0)
-		return -1;
+	dir = opendir(SYS_INPUT_DIR);
+	if (!dir)
+		return;
 
-	for (i = 0; i < ndev; i++) {
+	while ((dent = readdir(dir))) {
 		int fd, len;
 		struct stat st;
 
+		if (strncmp("input", dent->d_name, 5) != 0)
+			continue;
+
 		rc = snprintf(buf, sizeof(buf), "%s%s/name",
 			      SYS_INPUT_DIR,
-			      namelist[i]->d_name);
+			      dent->d_name);
 		if (rc < 0 || (size_t)rc >= sizeof(buf)) {
 			continue;
 		}
 
-		/* created within time frame */
-		fd = open(buf, O_RDONLY);
-		if (fd < 0)
+		/* created before UI_DEV_CREATE, or after it finished. stat
+		   first so we only open and read candidates */
+		if (stat(buf, &st) == -1 ||
+		    st.st_ctime < uinput_dev->ctime[0] ||
+		    st.st_ctime > uinput_dev->ctime[1])
 			continue;
 
-		/* created before UI_DEV_CREATE, or after it finished */
-		if (fstat(fd, &st) == -1 ||
-		    st.st_ctime < uinput_dev->ctime[0] ||
-		    st.st_ctime > uinput_dev->ctime[1]) {
-			close(fd);
+		fd = open(buf, O_RDONLY);
+		if (fd < 0)
 			continue;
-		}
 
 		len = read(fd, buf, sizeof(buf));
 		close(fd);
@@ -275,23 +269,61 @@ fetch_syspath_and_devnode(struct libevdev_uinput *uinput_dev)
 			} else {
 				rc = snprintf(buf, sizeof(buf), "%s%s",
 					      SYS_INPUT_DIR,
-					      namelist[i]->d_name);
+					      dent->d_name);
 				if (rc < 0 || (size_t)rc >= sizeof(buf)) {
 					log_error(NULL, "Invalid syspath, syspath is unreliable\n");
 					break;
 				}
 
 				uinput_dev->syspath = strdup(buf);
-				uinput_dev->devnode = fetch_device_node(buf);
 			}
 		}
 	}
 
-	for (i = 0; i < ndev; i++)
-		free(namelist[i]);
-	free(namelist);
+	closedir(dir);
+}
+
+/**
+ * Look up the syspath on first use. UI_GET_SYSNAME gives us the
+ * inputN directory directly, only older kernels need a scan.
+ */
+static void
+fetch_syspath(struct libevdev_uinput *uinput_dev)
+{
+	int rc;
+	char buf[sizeof(SYS_INPUT_DIR) + 64] = SYS_INPUT_DIR;
+
+	if (uinput_dev->syspath_fetched)
+		return;
+
+	uinput_dev->syspath_fetched = 1;
+
+	rc = ioctl(uinput_dev->fd,
+		   UI_GET_SYSNAME(sizeof(buf) - strlen(SYS_INPUT_DIR)),
+		   &buf[strlen(SYS_INPUT_DIR)]);
+	if (rc != -1)
+		uinput_dev->syspath = strdup(buf);
+	else
+		guess_syspath(uinput_dev);
+
+	if (!uinput_dev->syspath)
+		log_error(NULL, "unable to fetch syspath.\n");
+}
+
+static void
+fetch_devnode(struct libevdev_uinput *uinput_dev)
+{
+	if (uinput_dev->devnode_fetched)
+		return;
+
+	uinput_dev->devnode_fetched = 1;
 
-	return uinput_dev->devnode ? 0 : -1;
+	fetch_syspath(uinput_dev);
+	if (uinput_dev->syspath)
+		uinput_dev->devnode = fetch_device_node(uinput_dev->syspath);
+
+	if (!uinput_dev->devnode)
+		log_error(NULL, "unable to fetch device node.\n");
 }
 
 static int
@@ -404,11 +436,7 @@ libevdev_uinput_create_from_device(const struct libevdev *dev, int fd, struct li
 	new_device->ctime[1] = time(NULL);
 	new_device->fd = fd;
 
-	if (fetch_syspath_and_devnode(new_device) == -1) {
-		log_error(NULL, "unable to fetch syspath or device node.\n");
-		errno = ENODEV;
-		goto error;
-	}
+	/* syspath and devnode are looked up when first requested */
 
 	*uinput_dev = new_device;
 
@@ -442,15 +470,32 @@ libevdev_uinput_destroy(struct libevdev_uinput *uinput_dev)
 LIBEVDEV_EXPORT const char*
 libevdev_uinput_get_syspath(struct libevdev_uinput *uinput_dev)
 {
+	fetch_syspath(uinput_dev);
 	return uinput_dev->syspath;
 }
 
 LIBEVDEV_EXPORT const char*
 libevdev_uinput_get_devnode(struct libevdev_uinput *uinput_dev)
 {
+	fetch_devnode(uinput_dev);
 	return uinput_dev->devnode;
 }
 
+static inline bool
+uinput_event_is_valid(unsigned int type, unsigned int code)
+{
+	int max;
+
+	if (type > EV_MAX)
+		return false;
+
+	max = libevdev_event_type_get_max(type);
+	if (max == -1 || code > (unsigned int)max)
+		return false;
+
+	return true;
+}
+
 LIBEVDEV_EXPORT int
 libevdev_uinput_write_event(const struct libevdev_uinput *uinput_dev,
 			    unsigned int type,
@@ -459,13 +504,9 @@ libevdev_uinput_write_event(const struct libevdev_uinput *uinput_dev,
 {
 	struct input_event ev = { {0,0}, type, code, value };
 	int fd = libevdev_uinput_get_fd(uinput_dev);
-	int rc, max;
-
-	if (type > EV_MAX)
-		return -EINVAL;
+	int rc;
 
-	max = libevdev_event_type_get_max(type);
-	if (max == -1 || code > (unsigned int)max)
+	if (!uinput_event_is_valid(type, code))
 		return -EINVAL;
 
 	rc = write(fd, &ev, sizeof(ev));
@@ -473,4 +514,32 @@ libevdev_uinput_write_event(const struct libevdev_uinput *uinput_dev,
 	return rc < 0 ? -errno : 0;
 }
 
+LIBEVDEV_EXPORT int
+libevdev_uinput_write_events(const struct libevdev_uinput *uinput_dev,
+			     const struct input_event *events,
+			     size_t nevents)
+{
+	int fd = libevdev_uinput_get_fd(uinput_dev);
+	ssize_t rc;
+	size_t i;
+
+	if (nevents > INT_MAX)
+		nevents = INT_MAX;
+
+	for (i = 0; i < nevents; i++) {
+		if (!uinput_event_is_valid(events[i].type, events[i].code))
+			return -EINVAL;
+	}
+
+	if (nevents == 0)
+		return 0;
+
+	rc = write(fd, events, nevents * sizeof(*events));
+	if (rc < 0)
+		return -errno;
+
+	/* uinput only ever consumes whole events */
+	return rc / sizeof(*events);
+}
+
 #endif
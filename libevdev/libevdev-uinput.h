@@ -190,6 +190,11 @@ int libevdev_uinput_get_fd(const struct libevdev_uinput *uinput_dev);
  * In that case, libevdev uses ctime and the device name to guess devices.
  * To avoid false positives, wait at least wait at least 1.5s between
  * creating devices that have the same name.
+ *
+ * The syspath is looked up on the first call to this function or
+ * libevdev_uinput_get_devnode(), not when the device is created. If the
+ * caller manages the uinput fd, it must remain open until then.
+ *
  * @param uinput_dev A previously created uinput device.
  * @return The syspath for this device, including the preceding /sys
  *
@@ -207,6 +212,9 @@ const char* libevdev_uinput_get_syspath(struct libevdev_uinput *uinput_dev);
  *
  * @note This function may return NULL. libevdev may have to guess the
  * syspath and the device node. See libevdev_uinput_get_syspath() for details.
+ *
+ * Like the syspath, the device node is looked up on the first call.
+ *
  * @param uinput_dev A previously created uinput device.
  * @return The device node for this device, in the form of /dev/input/eventN
  *
@@ -232,6 +240,46 @@ int libevdev_uinput_write_event(const struct libevdev_uinput *uinput_dev,
 				unsigned int type,
 				unsigned int code,
 				int value);
+
+/**
+ * @ingroup uinput
+ *
+ * Post a sequence of events through the uinput device with a single
+ * write(2). The events are posted in order and the time field of each event
+ * is ignored. As with libevdev_uinput_write_event(), it is the caller's
+ * responsibility that the sequence is terminated with an
+ * EV_SYN/SYN_REPORT/0 event.
+ *
+ * All events are validated before any is posted. If any event has an
+ * invalid type or code, no event is posted and -EINVAL is returned.
+ *
+ * If the kernel fails to post an event, the events preceding it are still
+ * posted. The return value is then smaller than nevents and the caller
+ * may retry the remaining events.
+ *
+ * @code
+ * struct input_event evs[] = {
+ *     { .type = EV_REL, .code = REL_X, .value = 1 },
+ *     { .type = EV_REL, .code = REL_Y, .value = -1 },
+ *     { .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+ * };
+ *
+ * rc = libevdev_uinput_write_events(uidev, evs, 3);
+ * @endcode
+ *
+ * @param uinput_dev A previously created uinput device.
+ * @param events The events to post
+ * @param nevents The number of events in events. At most INT_MAX events
+ * are posted.
+ * @return The number of events posted or a negative errno on error
+ *
+ * @see libevdev_uinput_write_event
+ * @since 1.6
+ */
+int libevdev_uinput_write_events(const struct libevdev_uinput *uinput_dev,
+				 const struct input_event *events,
+				 size_t nevents);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,7 +25,9 @@
 
 #include <config.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/time.h>
 
 #define LONG_BITS (sizeof(long) * 8)
 #define NLONGS(x) (((x) + LONG_BITS - 1) / LONG_BITS)
@@ -78,4 +80,62 @@ set_bit_state(unsigned long *array, int bit, int state)
 		clear_bit(array, bit);
 }
 
+static inline unsigned int
+bits_count(const unsigned long *array, size_t nlongs)
+{
+	unsigned int count = 0;
+	size_t i;
+
+	for (i = 0; i < nlongs; i++)
+		count += __builtin_popcountl(array[i]);
+
+	return count;
+}
+
+/**
+ * @return the index of the first bit set at or after from, or nbits if
+ * there is none
+ */
+static inline unsigned int
+bits_find_next(const unsigned long *array, unsigned int nbits, unsigned int from)
+{
+	unsigned int i;
+	unsigned long word;
+
+	if (from >= nbits)
+		return nbits;
+
+	i = from / LONG_BITS;
+	word = array[i] & (~0UL << (from % LONG_BITS));
+
+	while (!word) {
+		if (++i >= NLONGS(nbits))
+			return nbits;
+		word = array[i];
+	}
+
+	return min(i * LONG_BITS + __builtin_ctzl(word), nbits);
+}
+
+/**
+ * @return the number of bits set in the first nbits of array
+ */
+static inline unsigned int
+bits_count_n(const unsigned long *array, unsigned int nbits)
+{
+	unsigned int count = bits_count(array, nbits / LONG_BITS);
+
+	if (nbits % LONG_BITS)
+		count += __builtin_popcountl(array[nbits / LONG_BITS] &
+					     (~0UL >> (LONG_BITS - nbits % LONG_BITS)));
+
+	return count;
+}
+
+static inline uint64_t
+timeval_to_ns(const struct timeval *tv)
+{
+	return (uint64_t)tv->tv_sec * 1000000000 + (uint64_t)tv->tv_usec * 1000;
+}
+
 #endif
@@ -29,6 +29,8 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 
 #include "libevdev.h"
 #include "libevdev-int.h"
@@ -37,13 +39,8 @@
 
 #define MAXEVENTS 64
 
-enum event_filter_status {
-	EVENT_FILTER_NONE,	/**< Event untouched by filters */
-	EVENT_FILTER_MODIFIED,	/**< Event was modified */
-	EVENT_FILTER_DISCARD,	/**< Discard current event */
-};
-
 static int sync_mt_state(struct libevdev *dev, int create_events);
+static void event_processor_select(struct libevdev *dev);
 
 static inline int*
 slot_value(const struct libevdev *dev, int slot, int axis)
@@ -60,41 +57,290 @@ slot_value(const struct libevdev *dev, int slot, int axis)
 	return &dev->mt_slot_vals[slot * ABS_MT_CNT + axis - ABS_MT_MIN];
 }
 
+/**
+ * Copy the values of the current slot into the abs_info of the MT axes.
+ */
+static void
+abs_info_sync_slot(struct libevdev *dev)
+{
+	unsigned int code;
+
+	dev->abs_info_slot = dev->current_slot;
+
+	if (dev->current_slot < 0 || dev->current_slot >= dev->num_slots)
+		return;
+
+	for (code = ABS_MT_SLOT + 1; code <= ABS_MT_MAX; code++) {
+		if (bit_is_set(dev->caps->abs_bits, code))
+			dev->abs_info[code].value =
+				*slot_value(dev, dev->current_slot, code);
+	}
+}
+
+/**
+ * An ABS_MT_SLOT event only switches the current slot. The abs_info of
+ * the MT axes is refreshed before the read functions return, so the
+ * const getters can hand out abs_info as-is and a batch of events
+ * switching slots several times costs one refresh at most.
+ */
+static inline void
+abs_info_update_slot(struct libevdev *dev)
+{
+	if (dev->abs_info_slot != dev->current_slot)
+		abs_info_sync_slot(dev);
+}
+
+/**
+ * Offset and number of codes of each event type in dev->filter. Types
+ * without codes have a count of 0 and never match.
+ */
+static const struct {
+	unsigned int offset;
+	unsigned int count;
+} filter_ranges[EV_CNT] = {
+	[EV_KEY] = { FILTER_OFFSET_KEY, KEY_CNT },
+	[EV_REL] = { FILTER_OFFSET_REL, REL_CNT },
+	[EV_ABS] = { FILTER_OFFSET_ABS, ABS_CNT },
+	[EV_MSC] = { FILTER_OFFSET_MSC, MSC_CNT },
+	[EV_SW] = { FILTER_OFFSET_SW, SW_CNT },
+	[EV_LED] = { FILTER_OFFSET_LED, LED_CNT },
+	[EV_SND] = { FILTER_OFFSET_SND, SND_CNT },
+	[EV_REP] = { FILTER_OFFSET_REP, REP_CNT },
+	[EV_FF] = { FILTER_OFFSET_FF, FF_CNT },
+};
+
+/**
+ * Same as libevdev_has_event_code() but a single lookup in the filter
+ * table. This is called for every event read from the device.
+ */
+static inline bool
+filter_accepts(const struct libevdev *dev, unsigned int type, unsigned int code)
+{
+	if (type == EV_SYN)
+		return true;
+
+	if (unlikely(type > EV_MAX) || code >= filter_ranges[type].count)
+		return false;
+
+	return bit_is_set(dev->filter, filter_ranges[type].offset + code);
+}
+
+static void
+filter_update_code(struct libevdev *dev, unsigned int type, unsigned int code)
+{
+	set_bit_state(dev->filter, filter_ranges[type].offset + code,
+		      libevdev_has_event_code(dev, type, code));
+}
+
+/**
+ * Re-derive the filter table entries for the given type from the device's
+ * bits. Must be called whenever a type or code is enabled or disabled.
+ */
+static void
+filter_update_type(struct libevdev *dev, unsigned int type)
+{
+	unsigned int code;
+
+	if (type > EV_MAX)
+		return;
+
+	for (code = 0; code < filter_ranges[type].count; code++)
+		filter_update_code(dev, type, code);
+}
+
+static void
+filter_rebuild(struct libevdev *dev)
+{
+	unsigned int type;
+
+	for (type = 0; type <= EV_MAX; type++)
+		filter_update_type(dev, type);
+}
+
+/**
+ * Push the filter for one event type to the kernel. Type EV_SYN sends
+ * the type mask instead, see EVIOCGMASK. The kernel forwards events whose
+ * bit is set, so with enable false all bits are set and nothing is
+ * filtered.
+ */
 static int
-init_event_queue(struct libevdev *dev)
+kernel_mask_send(struct libevdev *dev, unsigned int type, bool enable)
+{
+	unsigned long bits[NLONGS(KEY_CNT)];
+	struct input_mask mask;
+	unsigned int code, count;
+	int rc;
+
+	count = (type == EV_SYN) ? EV_CNT : filter_ranges[type].count;
+	if (count == 0)
+		return 0;
+
+	memset(bits, enable ? 0 : 0xff, sizeof(bits));
+	if (enable) {
+		for (code = 0; code < count; code++) {
+			bool accept;
+
+			if (type == EV_SYN)
+				accept = code == EV_SYN ||
+					 (filter_ranges[code].count > 0 &&
+					  libevdev_has_event_type(dev, code));
+			else
+				accept = filter_accepts(dev, type, code);
+
+			set_bit_state(bits, code, accept);
+		}
+	}
+
+	mask.type = type;
+	mask.codes_size = NLONGS(count) * sizeof(unsigned long);
+	mask.codes_ptr = (uintptr_t)bits;
+
+	rc = ioctl(dev->fd, EVIOCSMASK, &mask);
+	return rc < 0 ? -errno : 0;
+}
+
+static int
+kernel_mask_send_all(struct libevdev *dev, bool enable)
+{
+	unsigned int type;
+	int rc;
+
+	for (type = 0; type <= EV_MAX; type++) {
+		rc = kernel_mask_send(dev, type, enable);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+static void
+kernel_mask_disable(struct libevdev *dev, int error)
+{
+	log_info(dev, "Unable to set the kernel event mask (%s), "
+		 "falling back to filtering in libevdev.\n", strerror(-error));
+	kernel_mask_send_all(dev, false);
+	dev->kernel_mask = false;
+}
+
+/**
+ * Re-send the kernel masks after the filter entries for the given type
+ * changed. A failure drops back to the userspace filter, which is always
+ * active anyway.
+ */
+static void
+kernel_mask_update(struct libevdev *dev, unsigned int type)
+{
+	int rc;
+
+	if (!dev->kernel_mask || dev->fd < 0)
+		return;
+
+	rc = kernel_mask_send(dev, EV_SYN, true);
+	if (rc == 0 && type != EV_SYN)
+		rc = kernel_mask_send(dev, type, true);
+	if (rc < 0)
+		kernel_mask_disable(dev, rc);
+}
+
+/**
+ * The number of events a sync of this device may queue: one for each
+ * code, for each slot, plus the terminating SYN_REPORT.
+ */
+static size_t
+sync_queue_size(struct libevdev *dev)
 {
-	const int MIN_QUEUE_SIZE = 256;
-	int nevents = 1; /* terminating SYN_REPORT */
+	size_t nevents = 1; /* terminating SYN_REPORT */
 	int nslots;
-	unsigned int type, code;
+	int code;
 
 	/* count the number of axes, keys, etc. to get a better idea at how
 	   many events per EV_SYN we could possibly get. That's the max we
-	   may get during SYN_DROPPED too. Use double that, just so we have
-	   room for events while syncing a device.
+	   may get during SYN_DROPPED too. The filter has one bit set for
+	   each of those.
 	 */
-	for (type = EV_KEY; type < EV_MAX; type++) {
-		int max = libevdev_event_type_get_max(type);
-		for (code = 0; max > 0 && code < (unsigned int) max; code++) {
-			if (libevdev_has_event_code(dev, type, code))
-				nevents++;
-		}
-	}
+	nevents += bits_count(dev->filter, ARRAY_LENGTH(dev->filter));
 
 	nslots = libevdev_get_num_slots(dev);
 	if (nslots > 1) {
 		int num_mt_axes = 0;
 
-		for (code = ABS_MT_SLOT; code <= ABS_MAX; code++) {
-			if (libevdev_has_event_code(dev, EV_ABS, code))
-				num_mt_axes++;
-		}
+		for (code = libevdev_get_next_event_code(dev, EV_ABS, ABS_MT_SLOT);
+		     code != -1;
+		     code = libevdev_get_next_event_code(dev, EV_ABS, code + 1))
+			num_mt_axes++;
 
 		/* We already counted the first slot in the initial count */
 		nevents += num_mt_axes * (nslots - 1);
 	}
 
-	return queue_alloc(dev, max(MIN_QUEUE_SIZE, nevents * 2));
+	return nevents;
+}
+
+/**
+ * Resize the event queue and the frame buffer with it.
+ */
+static int
+resize_event_queue(struct libevdev *dev, size_t size)
+{
+	int rc;
+
+	if (size < dev->frame.nevents)
+		return -EINVAL;
+
+	/* resize the frame buffer first, so a failed realloc leaves the
+	   queue and the frame buffer as they were */
+	if (dev->frame.events) {
+		struct input_event *events;
+
+		events = realloc(dev->frame.events, size * sizeof(*events));
+		if (!events)
+			return -ENOMEM;
+
+		dev->frame.events = events;
+	}
+
+	rc = queue_resize(dev, size);
+	if (rc < 0) {
+		/* the frame buffer may have shrunk */
+		dev->frame.size = min(dev->frame.size, size);
+		return rc;
+	}
+
+	if (dev->frame.events)
+		dev->frame.size = size;
+
+	return 0;
+}
+
+static int
+init_event_queue(struct libevdev *dev)
+{
+	const size_t MIN_QUEUE_SIZE = 256;
+	size_t nevents = sync_queue_size(dev);
+	size_t size;
+	int rc;
+
+	/* Use double the sync size, just so we have room for events
+	   while syncing a device. */
+	if (dev->queue_config.size > 0)
+		size = max(dev->queue_config.size, nevents);
+	else
+		size = max(MIN_QUEUE_SIZE, nevents * 2);
+
+	rc = queue_alloc(dev, size);
+	if (rc < 0)
+		return rc;
+
+	/* allocated here, libevdev_next_frame() must not allocate to stay
+	   signal-safe */
+	dev->frame.events = calloc(size, sizeof(*dev->frame.events));
+	if (!dev->frame.events)
+		return -ENOMEM;
+	dev->frame.size = size;
+	dev->frame.complete = true;
+
+	return 0;
 }
 
 static void
@@ -143,7 +389,7 @@ fix_invalid_absinfo(const struct libevdev *dev,
 		abs_info->maximum = 0xFFFF;
 		log_bug(dev,
 			"Device \"%s\" has invalid ABS_MT_TRACKING_ID range",
-			dev->name);
+			dev->caps->name);
 	}
 }
 
@@ -189,28 +435,257 @@ _libevdev_log_msg(const struct libevdev *dev,
 	va_end(args);
 }
 
+static const struct {
+	enum libevdev_log_priority priority;
+	unsigned int nargs;
+	/* formatted with the device name and the arguments */
+	const char *format;
+} log_messages[LOG_MSG_CNT] = {
+	[LIBEVDEV_LOG_MSG_INVALID_SLOT] = {
+		LIBEVDEV_LOG_ERROR, 2,
+		"BUG: Device \"%s\" received an invalid slot index %d."
+		"Capping to announced max slot number %d.\n",
+	},
+	[LIBEVDEV_LOG_MSG_DOUBLE_TRACKING_ID] = {
+		LIBEVDEV_LOG_ERROR, 2,
+		"BUG: Device \"%s\" received a double tracking ID %d in slot %d.\n",
+	},
+	[LIBEVDEV_LOG_MSG_SYN_DROPPED_AFTER_SYNC] = {
+		LIBEVDEV_LOG_INFO, 0,
+		"SYN_DROPPED received after finished sync - you're not keeping up\n",
+	},
+	[LIBEVDEV_LOG_MSG_SUPPRESSED] = {
+		LIBEVDEV_LOG_ERROR, 2,
+		"Device \"%s\": %d similar messages suppressed\n",
+	},
+};
+
+/**
+ * @return true if the message is within the rate limit. *suppressed is
+ * set to the number of messages suppressed in the previous interval when
+ * a new interval starts.
+ */
+static bool
+log_ratelimit(struct libevdev *dev, enum libevdev_log_msg_id id,
+	      unsigned int *suppressed)
+{
+	struct log_ratelimit *rl = &dev->log_msgs.limits[id];
+	struct timespec now;
+	uint64_t now_ns;
+
+	if (dev->log_msgs.burst == 0)
+		return true;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+
+	if (now_ns - rl->interval_start >= dev->log_msgs.interval_ns) {
+		*suppressed = rl->nsuppressed;
+		rl->interval_start = now_ns;
+		rl->nlogged = 0;
+		rl->nsuppressed = 0;
+	}
+
+	if (rl->nlogged < dev->log_msgs.burst) {
+		rl->nlogged++;
+		return true;
+	}
+
+	rl->nsuppressed++;
+	return false;
+}
+
+static void
+log_msg_emit(struct libevdev *dev, enum libevdev_log_priority priority,
+	     enum libevdev_log_msg_id id,
+	     const char *file, int line, const char *func,
+	     int arg0, int arg1)
+{
+	const int args[] = { arg0, arg1 };
+
+	if (dev->log_msgs.handler)
+		dev->log_msgs.handler(dev, priority, dev->log_msgs.userdata,
+				      id, args, log_messages[id].nargs);
+	else
+		_libevdev_log_msg(dev, priority, file, line, func,
+				  log_messages[id].format, dev->caps->name, arg0, arg1);
+}
+
+/**
+ * Log one of the messages in enum libevdev_log_msg_id, subject to the
+ * rate limit. Unused arguments are ignored.
+ */
+static void
+log_msg_limited(struct libevdev *dev, enum libevdev_log_msg_id id,
+		const char *file, int line, const char *func,
+		int arg0, int arg1)
+{
+	enum libevdev_log_priority priority = log_messages[id].priority;
+	unsigned int suppressed = 0;
+
+	if (dev->log_msgs.handler) {
+		if (priority > dev->log_msgs.priority)
+			return;
+	} else if (_libevdev_log_priority(dev) < priority)
+		return;
+
+	if (!log_ratelimit(dev, id, &suppressed))
+		return;
+
+	if (suppressed > 0)
+		log_msg_emit(dev, priority, LIBEVDEV_LOG_MSG_SUPPRESSED,
+			     file, line, func, suppressed, id);
+	log_msg_emit(dev, priority, id, file, line, func, arg0, arg1);
+}
+
+#define log_limited(dev, id, arg0, arg1) \
+	log_msg_limited(dev, id, __FILE__, __LINE__, __func__, arg0, arg1)
+
+static int
+strdup_or_null(char **to, const char *from)
+{
+	*to = NULL;
+	if (from && !(*to = strdup(from)))
+		return -ENOMEM;
+	return 0;
+}
+
+/* the caps of a new device, never written to or freed */
+static struct libevdev_caps empty_caps;
+
+static inline struct libevdev_caps *
+caps_ref(struct libevdev_caps *caps)
+{
+	if (caps != &empty_caps)
+		__atomic_add_fetch(&caps->refcount, 1, __ATOMIC_RELAXED);
+	return caps;
+}
+
+static void
+caps_unref(struct libevdev_caps *caps)
+{
+	if (!caps || caps == &empty_caps ||
+	    __atomic_sub_fetch(&caps->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	free(caps->name);
+	free(caps->phys);
+	free(caps->uniq);
+	free(caps);
+}
+
+/**
+ * Make sure the caps of the device are not shared so they can be
+ * modified, copying them if necessary.
+ *
+ * @return 0 on success or -ENOMEM
+ */
+static int
+caps_writable(struct libevdev *dev)
+{
+	struct libevdev_caps *caps = dev->caps;
+	struct libevdev_caps *copy;
+
+	if (caps != &empty_caps &&
+	    __atomic_load_n(&caps->refcount, __ATOMIC_ACQUIRE) == 1)
+		return 0;
+
+	copy = malloc(sizeof(*copy));
+	if (!copy)
+		return -ENOMEM;
+
+	*copy = *caps;
+	copy->refcount = 1;
+	copy->name = copy->phys = copy->uniq = NULL;
+	if (strdup_or_null(&copy->name, caps->name) < 0 ||
+	    strdup_or_null(&copy->phys, caps->phys) < 0 ||
+	    strdup_or_null(&copy->uniq, caps->uniq) < 0) {
+		caps_unref(copy);
+		return -ENOMEM;
+	}
+
+	caps_unref(caps);
+	dev->caps = copy;
+
+	return 0;
+}
+
+/**
+ * Allocate the abs_info of the device if it doesn't have one yet,
+ * starting with the axis ranges from the caps.
+ *
+ * @return 0 on success or -ENOMEM
+ */
+static int
+abs_info_alloc(struct libevdev *dev)
+{
+	if (dev->abs_info)
+		return 0;
+
+	dev->abs_info = malloc(sizeof(dev->caps->abs_info));
+	if (!dev->abs_info)
+		return -ENOMEM;
+
+	memcpy(dev->abs_info, dev->caps->abs_info, sizeof(dev->caps->abs_info));
+
+	return 0;
+}
+
+/**
+ * Set the range and value of an axis, the caps must be writable.
+ */
+static void
+abs_info_set(struct libevdev *dev, unsigned int code,
+	     const struct input_absinfo *abs)
+{
+	dev->abs_info[code] = *abs;
+	dev->caps->abs_info[code] = *abs;
+	dev->caps->abs_info[code].value = 0;
+}
+
 static void
 libevdev_reset(struct libevdev *dev)
 {
 	enum libevdev_log_priority pri = dev->log.priority;
 	libevdev_device_log_func_t handler = dev->log.device_handler;
-
-	free(dev->name);
-	free(dev->phys);
-	free(dev->uniq);
+	size_t queue_size = dev->queue_config.size;
+	size_t queue_max_size = dev->queue_config.max_size;
+	bool latency = dev->latency.enabled;
+	libevdev_device_log_msg_func_t msg_handler = dev->log_msgs.handler;
+	enum libevdev_log_priority msg_pri = dev->log_msgs.priority;
+	void *msg_userdata = dev->log_msgs.userdata;
+	unsigned int burst = dev->log_msgs.burst;
+	uint64_t interval_ns = dev->log_msgs.interval_ns;
+
+	caps_unref(dev->caps);
+	free(dev->abs_info);
 	free(dev->mt_slot_vals);
 	free(dev->mt_sync.mt_state);
 	free(dev->mt_sync.tracking_id_changes);
 	free(dev->mt_sync.slot_update);
+	free(dev->frame.events);
+	free(dev->mt_slot_changes);
 	memset(dev, 0, sizeof(*dev));
 	dev->fd = -1;
+	dev->caps = &empty_caps;
+	dev->clock_id = CLOCK_REALTIME;
+	dev->latency.enabled = latency;
 	dev->initialized = false;
 	dev->num_slots = -1;
 	dev->current_slot = -1;
+	dev->abs_info_slot = -1;
 	dev->grabbed = LIBEVDEV_UNGRAB;
 	dev->sync_state = SYNC_NONE;
 	dev->log.priority = pri;
 	dev->log.device_handler = handler;
+	dev->log_msgs.handler = msg_handler;
+	dev->log_msgs.priority = msg_pri;
+	dev->log_msgs.userdata = msg_userdata;
+	dev->log_msgs.burst = burst;
+	dev->log_msgs.interval_ns = interval_ns;
+	dev->queue_config.size = queue_size;
+	dev->queue_config.max_size = queue_max_size;
+	event_processor_select(dev);
 	libevdev_enable_event_type(dev, EV_SYN);
 }
 
@@ -294,6 +769,37 @@ libevdev_set_device_log_function(struct libevdev *dev,
 	dev->log.userdata = data;
 }
 
+LIBEVDEV_EXPORT void
+libevdev_set_device_log_msg_function(struct libevdev *dev,
+				     libevdev_device_log_msg_func_t logfunc,
+				     enum libevdev_log_priority priority,
+				     void *data)
+{
+	if (!dev) {
+		log_bug(NULL, "device must not be NULL\n");
+		return;
+	}
+
+	dev->log_msgs.priority = priority;
+	dev->log_msgs.handler = logfunc;
+	dev->log_msgs.userdata = data;
+}
+
+LIBEVDEV_EXPORT void
+libevdev_set_device_log_ratelimit(struct libevdev *dev,
+				  unsigned int burst,
+				  unsigned int interval_ms)
+{
+	if (!dev) {
+		log_bug(NULL, "device must not be NULL\n");
+		return;
+	}
+
+	dev->log_msgs.burst = burst;
+	dev->log_msgs.interval_ns = interval_ms * 1000000ULL;
+	memset(dev->log_msgs.limits, 0, sizeof(dev->log_msgs.limits));
+}
+
 enum libevdev_log_priority
 _libevdev_log_priority(const struct libevdev *dev)
 {
@@ -311,25 +817,116 @@ libevdev_change_fd(struct libevdev *dev, int fd)
 		return -1;
 	}
 	dev->fd = fd;
+
+	/* masks are per file description, the new one starts unfiltered */
+	if (dev->kernel_mask && fd >= 0) {
+		int rc = kernel_mask_send_all(dev, true);
+		if (rc < 0)
+			kernel_mask_disable(dev, rc);
+	}
+
+	/* so is the clock */
+	if (dev->clock_id != CLOCK_REALTIME && fd >= 0 &&
+	    ioctl(fd, EVIOCSCLOCKID, &dev->clock_id) < 0) {
+		log_info(dev, "Failed to set the clock on the new fd (%s), "
+			 "using CLOCK_REALTIME\n", strerror(errno));
+		dev->clock_id = CLOCK_REALTIME;
+	}
+
 	return 0;
 }
 
-LIBEVDEV_EXPORT int
-libevdev_set_fd(struct libevdev* dev, int fd)
+/**
+ * Second half of libevdev_set_fd(), once the capabilities are known: set
+ * up the filter, the multitouch state and the event queue.
+ *
+ * @return 0 on success or a negative errno. The caller resets the device
+ * on failure.
+ */
+static int
+init_device_state(struct libevdev *dev, int fd)
 {
 	int rc;
-	int i;
-	char buf[256];
 
-	if (dev->initialized) {
-		log_bug(dev, "device already initialized.\n");
-		return -EBADF;
-	} else if (fd < 0)
-		return -EBADF;
+	filter_rebuild(dev);
 
-	libevdev_reset(dev);
+	dev->fd = fd;
+
+	/* devices with ABS_MT_SLOT - 1 aren't MT devices,
+	   see the documentation for multitouch-related
+	   functions for more details */
+	if (!libevdev_has_event_code(dev, EV_ABS, ABS_MT_SLOT - 1) &&
+	    libevdev_has_event_code(dev, EV_ABS, ABS_MT_SLOT)) {
+		const struct input_absinfo *abs_info;
+
+		abs_info = libevdev_get_abs_info(dev, ABS_MT_SLOT);
+
+		dev->num_slots = abs_info->maximum + 1;
+		dev->mt_slot_vals = calloc(dev->num_slots * ABS_MT_CNT, sizeof(int));
+		if (!dev->mt_slot_vals)
+			return -ENOMEM;
+		dev->current_slot = abs_info->value;
+
+		dev->mt_sync.mt_state_sz = sizeof(*dev->mt_sync.mt_state) +
+					   (dev->num_slots) * sizeof(int);
+		dev->mt_sync.mt_state = calloc(1, dev->mt_sync.mt_state_sz);
+
+		dev->mt_sync.tracking_id_changes_sz = NLONGS(dev->num_slots) * sizeof(long);
+		dev->mt_sync.tracking_id_changes = calloc(1, dev->mt_sync.tracking_id_changes_sz);
+
+		dev->mt_sync.slot_update_sz = NLONGS(dev->num_slots * ABS_MT_CNT) * sizeof(long);
+		dev->mt_sync.slot_update = calloc(1, dev->mt_sync.slot_update_sz);
+
+		dev->mt_slot_changes = calloc(max(dev->num_slots, 1),
+					      sizeof(*dev->mt_slot_changes));
+
+		if (!dev->mt_sync.tracking_id_changes ||
+		    !dev->mt_sync.slot_update ||
+		    !dev->mt_sync.mt_state ||
+		    !dev->mt_slot_changes)
+			return -ENOMEM;
+
+	    sync_mt_state(dev, 0);
+	}
+
+	rc = init_event_queue(dev);
+	if (rc < 0)
+		return rc;
 
-	rc = ioctl(fd, EVIOCGBIT(0, sizeof(dev->bits)), dev->bits);
+	/* not copying key state because we won't know when we'll start to
+	 * use this fd and key's are likely to change state by then.
+	 * Same with the valuators, really, but they may not change.
+	 */
+
+	dev->initialized = true;
+	event_processor_select(dev);
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_set_fd(struct libevdev* dev, int fd)
+{
+	int rc;
+	int i;
+	char buf[256];
+
+	if (dev->initialized) {
+		log_bug(dev, "device already initialized.\n");
+		return -EBADF;
+	} else if (fd < 0)
+		return -EBADF;
+
+	libevdev_reset(dev);
+
+	rc = caps_writable(dev);
+	if (rc < 0) {
+		errno = -rc;
+		rc = -1;
+		goto out;
+	}
+
+	rc = ioctl(fd, EVIOCGBIT(0, sizeof(dev->caps->bits)), dev->caps->bits);
 	if (rc < 0)
 		goto out;
 
@@ -338,15 +935,15 @@ libevdev_set_fd(struct libevdev* dev, int fd)
 	if (rc < 0)
 		goto out;
 
-	free(dev->name);
-	dev->name = strdup(buf);
-	if (!dev->name) {
+	free(dev->caps->name);
+	dev->caps->name = strdup(buf);
+	if (!dev->caps->name) {
 		errno = ENOMEM;
 		goto out;
 	}
 
-	free(dev->phys);
-	dev->phys = NULL;
+	free(dev->caps->phys);
+	dev->caps->phys = NULL;
 	memset(buf, 0, sizeof(buf));
 	rc = ioctl(fd, EVIOCGPHYS(sizeof(buf) - 1), buf);
 	if (rc < 0) {
@@ -354,33 +951,33 @@ libevdev_set_fd(struct libevdev* dev, int fd)
 		if (errno != ENOENT)
 			goto out;
 	} else {
-		dev->phys = strdup(buf);
-		if (!dev->phys) {
+		dev->caps->phys = strdup(buf);
+		if (!dev->caps->phys) {
 			errno = ENOMEM;
 			goto out;
 		}
 	}
 
-	free(dev->uniq);
-	dev->uniq = NULL;
+	free(dev->caps->uniq);
+	dev->caps->uniq = NULL;
 	memset(buf, 0, sizeof(buf));
 	rc = ioctl(fd, EVIOCGUNIQ(sizeof(buf) - 1), buf);
 	if (rc < 0) {
 		if (errno != ENOENT)
 			goto out;
 	} else  {
-		dev->uniq = strdup(buf);
-		if (!dev->uniq) {
+		dev->caps->uniq = strdup(buf);
+		if (!dev->caps->uniq) {
 			errno = ENOMEM;
 			goto out;
 		}
 	}
 
-	rc = ioctl(fd, EVIOCGID, &dev->ids);
+	rc = ioctl(fd, EVIOCGID, &dev->caps->ids);
 	if (rc < 0)
 		goto out;
 
-	rc = ioctl(fd, EVIOCGVERSION, &dev->driver_version);
+	rc = ioctl(fd, EVIOCGVERSION, &dev->caps->driver_version);
 	if (rc < 0)
 		goto out;
 
@@ -388,39 +985,39 @@ libevdev_set_fd(struct libevdev* dev, int fd)
 	   support. This should not be a fatal case, we'll be missing properties but other
 	   than that everything is as expected.
 	 */
-	rc = ioctl(fd, EVIOCGPROP(sizeof(dev->props)), dev->props);
+	rc = ioctl(fd, EVIOCGPROP(sizeof(dev->caps->props)), dev->caps->props);
 	if (rc < 0 && errno != EINVAL)
 		goto out;
 
-	rc = ioctl(fd, EVIOCGBIT(EV_REL, sizeof(dev->rel_bits)), dev->rel_bits);
+	rc = ioctl(fd, EVIOCGBIT(EV_REL, sizeof(dev->caps->rel_bits)), dev->caps->rel_bits);
 	if (rc < 0)
 		goto out;
 
-	rc = ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(dev->abs_bits)), dev->abs_bits);
+	rc = ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(dev->caps->abs_bits)), dev->caps->abs_bits);
 	if (rc < 0)
 		goto out;
 
-	rc = ioctl(fd, EVIOCGBIT(EV_LED, sizeof(dev->led_bits)), dev->led_bits);
+	rc = ioctl(fd, EVIOCGBIT(EV_LED, sizeof(dev->caps->led_bits)), dev->caps->led_bits);
 	if (rc < 0)
 		goto out;
 
-	rc = ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(dev->key_bits)), dev->key_bits);
+	rc = ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(dev->caps->key_bits)), dev->caps->key_bits);
 	if (rc < 0)
 		goto out;
 
-	rc = ioctl(fd, EVIOCGBIT(EV_SW, sizeof(dev->sw_bits)), dev->sw_bits);
+	rc = ioctl(fd, EVIOCGBIT(EV_SW, sizeof(dev->caps->sw_bits)), dev->caps->sw_bits);
 	if (rc < 0)
 		goto out;
 
-	rc = ioctl(fd, EVIOCGBIT(EV_MSC, sizeof(dev->msc_bits)), dev->msc_bits);
+	rc = ioctl(fd, EVIOCGBIT(EV_MSC, sizeof(dev->caps->msc_bits)), dev->caps->msc_bits);
 	if (rc < 0)
 		goto out;
 
-	rc = ioctl(fd, EVIOCGBIT(EV_FF, sizeof(dev->ff_bits)), dev->ff_bits);
+	rc = ioctl(fd, EVIOCGBIT(EV_FF, sizeof(dev->caps->ff_bits)), dev->caps->ff_bits);
 	if (rc < 0)
 		goto out;
 
-	rc = ioctl(fd, EVIOCGBIT(EV_SND, sizeof(dev->snd_bits)), dev->snd_bits);
+	rc = ioctl(fd, EVIOCGBIT(EV_SND, sizeof(dev->caps->snd_bits)), dev->caps->snd_bits);
 	if (rc < 0)
 		goto out;
 
@@ -437,16 +1034,24 @@ libevdev_set_fd(struct libevdev* dev, int fd)
 		goto out;
 
 	/* rep is a special case, always set it to 1 for both values if EV_REP is set */
-	if (bit_is_set(dev->bits, EV_REP)) {
+	if (bit_is_set(dev->caps->bits, EV_REP)) {
 		for (i = 0; i < REP_CNT; i++)
-			set_bit(dev->rep_bits, i);
+			set_bit(dev->caps->rep_bits, i);
 		rc = ioctl(fd, EVIOCGREP, dev->rep_values);
 		if (rc < 0)
 			goto out;
 	}
 
+	if (bits_count_n(dev->caps->abs_bits, ABS_CNT) > 0) {
+		rc = abs_info_alloc(dev);
+		if (rc < 0) {
+			errno = -rc;
+			goto out;
+		}
+	}
+
 	for (i = ABS_X; i <= ABS_MAX; i++) {
-		if (bit_is_set(dev->abs_bits, i)) {
+		if (bit_is_set(dev->caps->abs_bits, i)) {
 			struct input_absinfo abs_info;
 			rc = ioctl(fd, EVIOCGABS(i), &abs_info);
 			if (rc < 0)
@@ -454,61 +1059,14 @@ libevdev_set_fd(struct libevdev* dev, int fd)
 
 			fix_invalid_absinfo(dev, i, &abs_info);
 
-			dev->abs_info[i] = abs_info;
-		}
-	}
-
-	dev->fd = fd;
-
-	/* devices with ABS_MT_SLOT - 1 aren't MT devices,
-	   see the documentation for multitouch-related
-	   functions for more details */
-	if (!libevdev_has_event_code(dev, EV_ABS, ABS_MT_SLOT - 1) &&
-	    libevdev_has_event_code(dev, EV_ABS, ABS_MT_SLOT)) {
-		const struct input_absinfo *abs_info;
-
-		abs_info = libevdev_get_abs_info(dev, ABS_MT_SLOT);
-
-		dev->num_slots = abs_info->maximum + 1;
-		dev->mt_slot_vals = calloc(dev->num_slots * ABS_MT_CNT, sizeof(int));
-		if (!dev->mt_slot_vals) {
-			rc = -ENOMEM;
-			goto out;
-		}
-		dev->current_slot = abs_info->value;
-
-		dev->mt_sync.mt_state_sz = sizeof(*dev->mt_sync.mt_state) +
-					   (dev->num_slots) * sizeof(int);
-		dev->mt_sync.mt_state = calloc(1, dev->mt_sync.mt_state_sz);
-
-		dev->mt_sync.tracking_id_changes_sz = NLONGS(dev->num_slots) * sizeof(long);
-		dev->mt_sync.tracking_id_changes = malloc(dev->mt_sync.tracking_id_changes_sz);
-
-		dev->mt_sync.slot_update_sz = NLONGS(dev->num_slots * ABS_MT_CNT) * sizeof(long);
-		dev->mt_sync.slot_update = malloc(dev->mt_sync.slot_update_sz);
-
-		if (!dev->mt_sync.tracking_id_changes ||
-		    !dev->mt_sync.slot_update ||
-		    !dev->mt_sync.mt_state) {
-			rc = -ENOMEM;
-			goto out;
+			abs_info_set(dev, i, &abs_info);
 		}
-
-	    sync_mt_state(dev, 0);
-	}
-
-	rc = init_event_queue(dev);
-	if (rc < 0) {
-		dev->fd = -1;
-		return -rc;
 	}
 
-	/* not copying key state because we won't know when we'll start to
-	 * use this fd and key's are likely to change state by then.
-	 * Same with the valuators, really, but they may not change.
-	 */
+	rc = init_device_state(dev, fd);
+	if (rc < 0)
+		errno = -rc;
 
-	dev->initialized = true;
 out:
 	if (rc)
 		libevdev_reset(dev);
@@ -516,598 +1074,2109 @@ out:
 }
 
 LIBEVDEV_EXPORT int
-libevdev_get_fd(const struct libevdev* dev)
+libevdev_snapshot_new(const struct libevdev *dev,
+		      struct libevdev_snapshot **snapshot)
 {
-	return dev->fd;
-}
+	struct libevdev_snapshot *s;
 
-static inline void
-init_event(struct libevdev *dev, struct input_event *ev, int type, int code, int value)
-{
-	ev->time = dev->last_event_time;
-	ev->type = type;
-	ev->code = code;
-	ev->value = value;
-}
+	s = malloc(sizeof(*s));
+	if (!s)
+		return -ENOMEM;
 
-static int
-sync_key_state(struct libevdev *dev)
-{
-	int rc;
-	int i;
-	unsigned long keystate[NLONGS(KEY_CNT)] = {0};
+	/* the caps are shared with the device until either one is
+	   modified */
+	s->caps = caps_ref(dev->caps);
 
-	rc = ioctl(dev->fd, EVIOCGKEY(sizeof(keystate)), keystate);
-	if (rc < 0)
-		goto out;
+	*snapshot = s;
 
-	for (i = 0; i < KEY_CNT; i++) {
-		int old, new;
-		old = bit_is_set(dev->key_values, i);
-		new = bit_is_set(keystate, i);
-		if (old ^ new) {
-			struct input_event *ev = queue_push(dev);
-			init_event(dev, ev, EV_KEY, i, new ? 1 : 0);
-		}
-	}
+	return 0;
+}
 
-	memcpy(dev->key_values, keystate, rc);
+LIBEVDEV_EXPORT void
+libevdev_snapshot_free(struct libevdev_snapshot *snapshot)
+{
+	if (!snapshot)
+		return;
 
-	rc = 0;
-out:
-	return rc ? -errno : 0;
+	caps_unref(snapshot->caps);
+	free(snapshot);
 }
 
-static int
-sync_sw_state(struct libevdev *dev)
+LIBEVDEV_EXPORT int
+libevdev_set_fd_with_snapshot(struct libevdev *dev, int fd,
+			      const struct libevdev_snapshot *snapshot)
 {
+	struct input_id ids;
+	unsigned long bits[NLONGS(EV_CNT)];
+	bool is_mt;
 	int rc;
 	int i;
-	unsigned long swstate[NLONGS(SW_CNT)] = {0};
 
-	rc = ioctl(dev->fd, EVIOCGSW(sizeof(swstate)), swstate);
+	if (dev->initialized) {
+		log_bug(dev, "device already initialized.\n");
+		return -EBADF;
+	} else if (fd < 0)
+		return -EBADF;
+
+	libevdev_reset(dev);
+
+	/* cheap check that this is still the same device */
+	rc = ioctl(fd, EVIOCGID, &ids);
 	if (rc < 0)
 		goto out;
 
-	for (i = 0; i < SW_CNT; i++) {
-		int old, new;
-		old = bit_is_set(dev->sw_values, i);
-		new = bit_is_set(swstate, i);
-		if (old ^ new) {
-			struct input_event *ev = queue_push(dev);
-			init_event(dev, ev, EV_SW, i, new ? 1 : 0);
-		}
-	}
+	memset(bits, 0, sizeof(bits));
+	rc = ioctl(fd, EVIOCGBIT(0, sizeof(bits)), bits);
+	if (rc < 0)
+		goto out;
 
-	memcpy(dev->sw_values, swstate, rc);
+	if (memcmp(&ids, &snapshot->caps->ids, sizeof(ids)) != 0 ||
+	    memcmp(bits, snapshot->caps->bits, sizeof(bits)) != 0) {
+		rc = -1;
+		errno = ESTALE;
+		goto out;
+	}
 
-	rc = 0;
-out:
-	return rc ? -errno : 0;
-}
+	dev->caps = caps_ref(snapshot->caps);
 
-static int
-sync_led_state(struct libevdev *dev)
-{
-	int rc;
-	int i;
-	unsigned long ledstate[NLONGS(LED_CNT)] = {0};
+	if (bits_count_n(dev->caps->abs_bits, ABS_CNT) > 0) {
+		rc = abs_info_alloc(dev);
+		if (rc < 0) {
+			errno = -rc;
+			goto out;
+		}
+	}
 
-	rc = ioctl(dev->fd, EVIOCGLED(sizeof(ledstate)), ledstate);
+	/* The capabilities come from the snapshot, the state must be read
+	   from the device. */
+	rc = ioctl(fd, EVIOCGKEY(sizeof(dev->key_values)), dev->key_values);
 	if (rc < 0)
 		goto out;
 
-	for (i = 0; i < LED_CNT; i++) {
-		int old, new;
-		old = bit_is_set(dev->led_values, i);
-		new = bit_is_set(ledstate, i);
-		if (old ^ new) {
-			struct input_event *ev = queue_push(dev);
-			init_event(dev, ev, EV_LED, i, new ? 1 : 0);
-		}
-	}
+	rc = ioctl(fd, EVIOCGLED(sizeof(dev->led_values)), dev->led_values);
+	if (rc < 0)
+		goto out;
 
-	memcpy(dev->led_values, ledstate, rc);
+	rc = ioctl(fd, EVIOCGSW(sizeof(dev->sw_values)), dev->sw_values);
+	if (rc < 0)
+		goto out;
 
-	rc = 0;
-out:
-	return rc ? -errno : 0;
-}
-static int
-sync_abs_state(struct libevdev *dev)
-{
-	int rc;
-	int i;
+	if (bit_is_set(dev->caps->bits, EV_REP)) {
+		rc = ioctl(fd, EVIOCGREP, dev->rep_values);
+		if (rc < 0)
+			goto out;
+	}
 
-	for (i = ABS_X; i < ABS_CNT; i++) {
+	/* on multitouch devices, the MT axes are read per slot by
+	   init_device_state(), only the current slot is needed here */
+	is_mt = !bit_is_set(dev->caps->abs_bits, ABS_MT_SLOT - 1) &&
+		bit_is_set(dev->caps->abs_bits, ABS_MT_SLOT);
+	for (i = ABS_X; i <= ABS_MAX; i++) {
 		struct input_absinfo abs_info;
 
-		if (i >= ABS_MT_MIN && i <= ABS_MT_MAX)
-			continue;
-
-		if (!bit_is_set(dev->abs_bits, i))
+		if (!bit_is_set(dev->caps->abs_bits, i) ||
+		    (is_mt && i > ABS_MT_SLOT && i <= ABS_MT_MAX))
 			continue;
 
-		rc = ioctl(dev->fd, EVIOCGABS(i), &abs_info);
+		rc = ioctl(fd, EVIOCGABS(i), &abs_info);
 		if (rc < 0)
 			goto out;
 
-		if (dev->abs_info[i].value != abs_info.value) {
-			struct input_event *ev = queue_push(dev);
+		dev->abs_info[i].value = abs_info.value;
+	}
 
-			init_event(dev, ev, EV_ABS, i, abs_info.value);
-			dev->abs_info[i].value = abs_info.value;
-		}
+	rc = init_device_state(dev, fd);
+	if (rc < 0) {
+		errno = -rc;
+		goto out;
 	}
 
-	rc = 0;
 out:
+	if (rc)
+		libevdev_reset(dev);
 	return rc ? -errno : 0;
 }
 
-static int
-sync_mt_state(struct libevdev *dev, int create_events)
+LIBEVDEV_EXPORT int
+libevdev_new_from_fd_with_snapshot(int fd,
+				   const struct libevdev_snapshot *snapshot,
+				   struct libevdev **dev)
 {
-	struct input_event *ev;
-	struct input_absinfo abs_info;
+	struct libevdev *d;
 	int rc;
-	int axis, slot;
-	int ioctl_success = 0;
-	int last_reported_slot = 0;
-	struct mt_sync_state *mt_state = dev->mt_sync.mt_state;
-	unsigned long *slot_update = dev->mt_sync.slot_update;
-	unsigned long *tracking_id_changes = dev->mt_sync.tracking_id_changes;
-	int need_tracking_id_changes = 0;
-
-	memset(dev->mt_sync.slot_update, 0, dev->mt_sync.slot_update_sz);
-	memset(dev->mt_sync.tracking_id_changes, 0,
-	       dev->mt_sync.tracking_id_changes_sz);
 
-#define AXISBIT(_slot, _axis) (_slot * ABS_MT_CNT + _axis - ABS_MT_MIN)
-
-	for (axis = ABS_MT_MIN; axis <= ABS_MT_MAX; axis++) {
-		if (axis == ABS_MT_SLOT)
-			continue;
+	d = libevdev_new();
+	if (!d)
+		return -ENOMEM;
 
-		if (!libevdev_has_event_code(dev, EV_ABS, axis))
-			continue;
+	rc = libevdev_set_fd_with_snapshot(d, fd, snapshot);
+	if (rc < 0)
+		libevdev_free(d);
+	else
+		*dev = d;
+	return rc;
+}
 
-		mt_state->code = axis;
-		rc = ioctl(dev->fd, EVIOCGMTSLOTS(dev->mt_sync.mt_state_sz), mt_state);
-		if (rc < 0) {
-			/* if the first ioctl fails with -EINVAL, chances are the kernel
-			   doesn't support the ioctl. Simply continue */
-			if (errno == -EINVAL && !ioctl_success) {
-				rc = 0;
-			} else /* if the second, ... ioctl fails, really fail */
-				goto out;
-		} else {
-			if (ioctl_success == 0)
-				ioctl_success = 1;
+/**
+ * Where a field of a device description is stored: in struct
+ * libevdev_caps or in struct libevdev.
+ */
+enum description_field_source {
+	DESCRIPTION_SOURCE_CAPS,
+	DESCRIPTION_SOURCE_DEVICE,
+};
 
-			for (slot = 0; slot < dev->num_slots; slot++) {
+/**
+ * Fields stored in a device description, in the order of
+ * description_header.fields. New fields must be appended and the
+ * description version bumped.
+ */
+#define DESCRIPTION_CAPS_FIELD(_f) \
+	{ DESCRIPTION_SOURCE_CAPS, offsetof(struct libevdev_caps, _f), \
+	  sizeof(((struct libevdev_caps*)0)->_f) }
+#define DESCRIPTION_DEVICE_FIELD(_f) \
+	{ DESCRIPTION_SOURCE_DEVICE, offsetof(struct libevdev, _f), \
+	  sizeof(((struct libevdev*)0)->_f) }
+static const struct {
+	enum description_field_source source;
+	size_t offset;
+	size_t size;
+} description_fields[] = {
+	DESCRIPTION_CAPS_FIELD(bits),
+	DESCRIPTION_CAPS_FIELD(props),
+	DESCRIPTION_CAPS_FIELD(key_bits),
+	DESCRIPTION_CAPS_FIELD(rel_bits),
+	DESCRIPTION_CAPS_FIELD(abs_bits),
+	DESCRIPTION_CAPS_FIELD(led_bits),
+	DESCRIPTION_CAPS_FIELD(msc_bits),
+	DESCRIPTION_CAPS_FIELD(sw_bits),
+	DESCRIPTION_CAPS_FIELD(rep_bits),
+	DESCRIPTION_CAPS_FIELD(ff_bits),
+	DESCRIPTION_CAPS_FIELD(snd_bits),
+	DESCRIPTION_CAPS_FIELD(abs_info),
+	DESCRIPTION_DEVICE_FIELD(rep_values),
+};
+#undef DESCRIPTION_CAPS_FIELD
+#undef DESCRIPTION_DEVICE_FIELD
 
-				if (*slot_value(dev, slot, axis) == mt_state->val[slot])
-					continue;
+static void *
+description_field(struct libevdev *dev, size_t field)
+{
+	switch (description_fields[field].source) {
+	case DESCRIPTION_SOURCE_CAPS:
+		return (char*)dev->caps + description_fields[field].offset;
+	case DESCRIPTION_SOURCE_DEVICE:
+		return (char*)dev + description_fields[field].offset;
+	}
 
-				if (axis == ABS_MT_TRACKING_ID &&
-				    *slot_value(dev, slot, axis) != -1 &&
-				    mt_state->val[slot] != -1) {
-					set_bit(tracking_id_changes, slot);
-					need_tracking_id_changes = 1;
-				}
+	return NULL;
+}
 
-				*slot_value(dev, slot, axis) = mt_state->val[slot];
+#define DESCRIPTION_MAGIC "EVDD"
+#define DESCRIPTION_VERSION 1
+#define DESCRIPTION_NFIELDS 13
+#define DESCRIPTION_ALIGN 8
 
-				set_bit(slot_update, AXISBIT(slot, axis));
-				/* note that this slot has updates */
-				set_bit(slot_update, AXISBIT(slot, ABS_MT_SLOT));
-			}
-
-		}
-	}
-
-	if (!create_events) {
-		rc = 0;
-		goto out;
-	}
-
-	if (need_tracking_id_changes) {
-		for (slot = 0; slot < dev->num_slots;  slot++) {
-			if (!bit_is_set(tracking_id_changes, slot))
-				continue;
+/**
+ * Location of a blob in the description, relative to the start of the
+ * header. A size of 0 for a string means the string is NULL.
+ */
+struct description_entry {
+	uint32_t offset;
+	uint32_t size;
+};
 
-			ev = queue_push(dev);
-			init_event(dev, ev, EV_ABS, ABS_MT_SLOT, slot);
-			ev = queue_push(dev);
-			init_event(dev, ev, EV_ABS, ABS_MT_TRACKING_ID, -1);
+/**
+ * A description is this header followed by the blobs it points to. The
+ * blobs are the raw contents of the respective struct libevdev fields, so
+ * a description can only be loaded on an architecture with the same
+ * size of long and byte order.
+ */
+struct description_header {
+	char magic[4];
+	uint16_t version;
+	uint8_t long_size;
+	uint8_t big_endian;
+	uint32_t size;			/**< total size in bytes */
+	struct input_id ids;
+	int32_t driver_version;
+	struct description_entry name;
+	struct description_entry phys;
+	struct description_entry uniq;
+	struct description_entry fields[DESCRIPTION_NFIELDS];
+};
 
-			last_reported_slot = slot;
-		}
+static inline uint8_t
+is_big_endian(void)
+{
+	const uint16_t one = 1;
+	return *(const uint8_t*)&one == 0;
+}
 
-		ev = queue_push(dev);
-		init_event(dev, ev, EV_SYN, SYN_REPORT, 0);
-	}
+static inline size_t
+description_align(size_t size)
+{
+	return (size + DESCRIPTION_ALIGN - 1) & ~(size_t)(DESCRIPTION_ALIGN - 1);
+}
 
-	for (slot = 0; slot < dev->num_slots;  slot++) {
-		if (!bit_is_set(slot_update, AXISBIT(slot, ABS_MT_SLOT)))
-			continue;
+static size_t
+description_put(char *buf, size_t offset, struct description_entry *entry,
+		const void *data, size_t size)
+{
+	entry->offset = offset;
+	entry->size = size;
+	if (buf && size)
+		memcpy(buf + offset, data, size);
+	return description_align(offset + size);
+}
 
-		ev = queue_push(dev);
-		init_event(dev, ev, EV_ABS, ABS_MT_SLOT, slot);
-		last_reported_slot = slot;
+static size_t
+description_put_string(char *buf, size_t offset,
+		       struct description_entry *entry, const char *str)
+{
+	return description_put(buf, offset, entry, str,
+			       str ? strlen(str) + 1 : 0);
+}
 
-		for (axis = ABS_MT_MIN; axis <= ABS_MT_MAX; axis++) {
-			if (axis == ABS_MT_SLOT ||
-			    !libevdev_has_event_code(dev, EV_ABS, axis))
-				continue;
+LIBEVDEV_EXPORT int
+libevdev_write_description(const struct libevdev *dev, void *data, size_t size)
+{
+	struct description_header header;
+	char *buf = NULL;
+	size_t offset;
+	size_t i;
+	int pass;
+
+	/* first pass computes the size, second pass writes the data */
+	for (pass = 0; pass < 2; pass++) {
+		memset(&header, 0, sizeof(header));
+		offset = description_align(sizeof(header));
+
+		offset = description_put_string(buf, offset, &header.name, dev->caps->name);
+		offset = description_put_string(buf, offset, &header.phys, dev->caps->phys);
+		offset = description_put_string(buf, offset, &header.uniq, dev->caps->uniq);
+
+		for (i = 0; i < ARRAY_LENGTH(description_fields); i++)
+			offset = description_put(buf, offset, &header.fields[i],
+						 description_field((struct libevdev*)dev, i),
+						 description_fields[i].size);
+
+		if (offset > INT_MAX)
+			return -E2BIG;
+
+		if (buf || size < offset)
+			break;
 
-			if (bit_is_set(slot_update, AXISBIT(slot, axis))) {
-				ev = queue_push(dev);
-				init_event(dev, ev, EV_ABS, axis, *slot_value(dev, slot, axis));
-			}
-		}
+		buf = data;
+		memset(buf, 0, offset);
 	}
 
-	/* add one last slot event to make sure the client is on the same
-	   slot as the kernel */
-
-	rc = ioctl(dev->fd, EVIOCGABS(ABS_MT_SLOT), &abs_info);
-	if (rc < 0)
-		goto out;
-
-	dev->current_slot = abs_info.value;
+	if (!buf)
+		return (int)offset;
 
-	if (dev->current_slot != last_reported_slot) {
-		ev = queue_push(dev);
-		init_event(dev, ev, EV_ABS, ABS_MT_SLOT, dev->current_slot);
-	}
+	memcpy(header.magic, DESCRIPTION_MAGIC, sizeof(header.magic));
+	header.version = DESCRIPTION_VERSION;
+	header.long_size = sizeof(long);
+	header.big_endian = is_big_endian();
+	header.size = offset;
+	header.ids = dev->caps->ids;
+	header.driver_version = dev->caps->driver_version;
+	memcpy(buf, &header, sizeof(header));
 
-#undef AXISBIT
+	return (int)offset;
+}
 
-	rc = 0;
-out:
-	return rc ? -errno : 0;
+static bool
+description_entry_valid(const struct description_entry *entry, size_t size)
+{
+	return entry->offset <= size && entry->size <= size - entry->offset;
 }
 
 static int
-read_more_events(struct libevdev *dev)
+description_get_string(const char *data, size_t size,
+		       const struct description_entry *entry, char **str)
 {
-	int free_elem;
-	int len;
-	struct input_event *next;
+	*str = NULL;
 
-	free_elem = queue_num_free_elements(dev);
-	if (free_elem <= 0)
+	if (entry->size == 0)
 		return 0;
 
-	next = queue_next_element(dev);
-	len = read(dev->fd, next, free_elem * sizeof(struct input_event));
-	if (len < 0) {
-		return -errno;
-	} else if (len > 0 && len % sizeof(struct input_event) != 0)
+	if (!description_entry_valid(entry, size) ||
+	    data[entry->offset + entry->size - 1] != '\0')
 		return -EINVAL;
-	else if (len > 0) {
-		int nev = len/sizeof(struct input_event);
-		queue_set_num_elements(dev, queue_num_elements(dev) + nev);
-	}
 
-	return 0;
+	*str = strdup(data + entry->offset);
+	return *str ? 0 : -ENOMEM;
 }
 
-static inline void
-drain_events(struct libevdev *dev)
+LIBEVDEV_EXPORT int
+libevdev_new_from_description(const void *data, size_t size,
+			      struct libevdev **dev)
 {
+	const char *buf = data;
+	struct description_header header;
+	struct libevdev *d;
+	size_t i;
 	int rc;
-	size_t nelem;
-	int iterations = 0;
-	const int max_iterations = 8; /* EVDEV_BUF_PACKETS in
-					 kernel/drivers/input/evedev.c */
-
-	queue_shift_multiple(dev, queue_num_elements(dev), NULL);
-
-	do {
-		rc = read_more_events(dev);
-		if (rc == -EAGAIN)
-			return;
 
-		if (rc < 0) {
-			log_error(dev, "Failed to drain events before sync.\n");
-			return;
-		}
+	if (size < sizeof(header))
+		return -EINVAL;
 
-		nelem = queue_num_elements(dev);
-		queue_shift_multiple(dev, nelem, NULL);
-	} while (iterations++ < max_iterations && nelem >= queue_size(dev));
+	memcpy(&header, buf, sizeof(header));
+	if (memcmp(header.magic, DESCRIPTION_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.version != DESCRIPTION_VERSION ||
+	    header.size > size)
+		return -EINVAL;
 
-	/* Our buffer should be roughly the same or bigger than the kernel
-	   buffer in most cases, so we usually don't expect to recurse. If
-	   we do, make sure we stop after max_iterations and proceed with
-	   what we have.  This could happen if events queue up faster than
-	   we can drain them.
-	 */
-	if (iterations >= max_iterations)
-		log_info(dev, "Unable to drain events, buffer size mismatch.\n");
-}
+	if (header.long_size != sizeof(long) ||
+	    header.big_endian != is_big_endian())
+		return -ENOTSUP;
 
-static int
-sync_state(struct libevdev *dev)
-{
-	int rc = 0;
-	struct input_event *ev;
+	size = header.size;
+	for (i = 0; i < ARRAY_LENGTH(header.fields); i++) {
+		if (!description_entry_valid(&header.fields[i], size))
+			return -EINVAL;
+	}
 
-	 /* see section "Discarding events before synchronizing" in
-	  * libevdev/libevdev.h */
-	drain_events(dev);
+	d = libevdev_new();
+	if (!d)
+		return -ENOMEM;
 
-	if (libevdev_has_event_type(dev, EV_KEY))
-		rc = sync_key_state(dev);
-	if (libevdev_has_event_type(dev, EV_LED))
-		rc = sync_led_state(dev);
-	if (libevdev_has_event_type(dev, EV_SW))
-		rc = sync_sw_state(dev);
-	if (rc == 0 && libevdev_has_event_type(dev, EV_ABS))
-		rc = sync_abs_state(dev);
-	if (rc == 0 && dev->num_slots > -1 &&
-	    libevdev_has_event_code(dev, EV_ABS, ABS_MT_SLOT))
-		rc = sync_mt_state(dev, 1);
+	if ((rc = caps_writable(d)) < 0 ||
+	    (rc = description_get_string(buf, size, &header.name, &d->caps->name)) < 0 ||
+	    (rc = description_get_string(buf, size, &header.phys, &d->caps->phys)) < 0 ||
+	    (rc = description_get_string(buf, size, &header.uniq, &d->caps->uniq)) < 0) {
+		libevdev_free(d);
+		return rc;
+	}
 
-	dev->queue_nsync = queue_num_elements(dev);
+	d->caps->ids = header.ids;
+	d->caps->driver_version = header.driver_version;
 
-	if (dev->queue_nsync > 0) {
-		ev = queue_push(dev);
-		init_event(dev, ev, EV_SYN, SYN_REPORT, 0);
-		dev->queue_nsync++;
+	/* the writer may have been built against kernel headers with a
+	   different number of codes, copy what fits */
+	for (i = 0; i < ARRAY_LENGTH(description_fields); i++) {
+		memcpy(description_field(d, i),
+		       buf + header.fields[i].offset,
+		       min(description_fields[i].size,
+			   (size_t)header.fields[i].size));
 	}
 
-	return rc;
-}
-
-static int
-update_key_state(struct libevdev *dev, const struct input_event *e)
-{
-	if (!libevdev_has_event_type(dev, EV_KEY))
-		return 1;
+	if (bits_count_n(d->caps->abs_bits, ABS_CNT) > 0 &&
+	    (rc = abs_info_alloc(d)) < 0) {
+		libevdev_free(d);
+		return rc;
+	}
 
-	if (e->code > KEY_MAX)
-		return 1;
+	filter_rebuild(d);
 
-	set_bit_state(dev->key_values, e->code, e->value != 0);
+	*dev = d;
 
 	return 0;
 }
 
-static int
-update_mt_state(struct libevdev *dev, const struct input_event *e)
+LIBEVDEV_EXPORT int
+libevdev_get_fd(const struct libevdev* dev)
 {
-	if (e->code == ABS_MT_SLOT && dev->num_slots > -1) {
-		int i;
-		dev->current_slot = e->value;
-		/* sync abs_info with the current slot values */
-		for (i = ABS_MT_SLOT + 1; i <= ABS_MT_MAX; i++) {
-			if (libevdev_has_event_code(dev, EV_ABS, i))
-				dev->abs_info[i].value = *slot_value(dev, dev->current_slot, i);
-		}
+	return dev->fd;
+}
 
+LIBEVDEV_EXPORT int
+libevdev_set_queue_size(struct libevdev *dev, size_t size)
+{
+	int rc;
+
+	if (size == 0)
+		return -EINVAL;
+
+	if (!dev->initialized) {
+		dev->queue_config.size = size;
 		return 0;
-	} else if (dev->current_slot == -1)
-		return 1;
+	}
 
-	*slot_value(dev, dev->current_slot, e->code) = e->value;
+	if (size < sync_queue_size(dev))
+		return -EINVAL;
+
+	rc = resize_event_queue(dev, size);
+	if (rc < 0)
+		return rc;
+
+	dev->queue_config.size = size;
 
 	return 0;
 }
 
-static int
-update_abs_state(struct libevdev *dev, const struct input_event *e)
+LIBEVDEV_EXPORT size_t
+libevdev_get_queue_size(const struct libevdev *dev)
 {
-	if (!libevdev_has_event_type(dev, EV_ABS))
-		return 1;
-
-	if (e->code > ABS_MAX)
-		return 1;
-
-	if (e->code >= ABS_MT_MIN && e->code <= ABS_MT_MAX)
-		update_mt_state(dev, e);
+	return dev->queue_size;
+}
 
-	dev->abs_info[e->code].value = e->value;
+LIBEVDEV_EXPORT int
+libevdev_set_queue_max_size(struct libevdev *dev, size_t max_size)
+{
+	dev->queue_config.max_size = max_size;
+	dev->queue_config.full_reads = 0;
 
 	return 0;
 }
 
-static int
-update_led_state(struct libevdev *dev, const struct input_event *e)
+LIBEVDEV_EXPORT uint64_t
+libevdev_get_last_event_time_ns(const struct libevdev *dev)
 {
-	if (!libevdev_has_event_type(dev, EV_LED))
-		return 1;
-
-	if (e->code > LED_MAX)
-		return 1;
+	return timeval_to_ns(&dev->last_event_time);
+}
 
-	set_bit_state(dev->led_values, e->code, e->value != 0);
+LIBEVDEV_EXPORT int
+libevdev_set_latency_histogram(struct libevdev *dev, int enable)
+{
+	dev->latency.enabled = !!enable;
+	memset(dev->latency.buckets, 0, sizeof(dev->latency.buckets));
 
 	return 0;
 }
 
-static int
-update_sw_state(struct libevdev *dev, const struct input_event *e)
+LIBEVDEV_EXPORT int
+libevdev_get_latency_histogram(const struct libevdev *dev,
+			       uint64_t *buckets, size_t nbuckets)
 {
-	if (!libevdev_has_event_type(dev, EV_SW))
-		return 1;
-
-	if (e->code > SW_MAX)
-		return 1;
+	size_t n = min(nbuckets, ARRAY_LENGTH(dev->latency.buckets));
 
-	set_bit_state(dev->sw_values, e->code, e->value != 0);
+	if (buckets)
+		memcpy(buckets, dev->latency.buckets, n * sizeof(*buckets));
 
-	return 0;
+	return buckets ? (int)n : LATENCY_BUCKETS;
 }
 
-static int
-update_state(struct libevdev *dev, const struct input_event *e)
+LIBEVDEV_EXPORT int
+libevdev_get_stat(const struct libevdev *dev, enum libevdev_stat stat,
+		  uint64_t *value)
 {
-	int rc = 0;
-
-	switch(e->type) {
-		case EV_SYN:
-		case EV_REL:
+	switch (stat) {
+		case LIBEVDEV_STAT_EVENTS_READ:
+			*value = dev->stats.events_read;
 			break;
-		case EV_KEY:
-			rc = update_key_state(dev, e);
+		case LIBEVDEV_STAT_READ_CALLS:
+			*value = dev->stats.read_calls;
 			break;
-		case EV_ABS:
-			rc = update_abs_state(dev, e);
+		case LIBEVDEV_STAT_BYTES_READ:
+			*value = dev->stats.bytes_read;
 			break;
-		case EV_LED:
-			rc = update_led_state(dev, e);
+		case LIBEVDEV_STAT_SYN_DROPPED:
+			*value = dev->stats.syn_dropped;
 			break;
-		case EV_SW:
-			rc = update_sw_state(dev, e);
+		case LIBEVDEV_STAT_SYN_DROPPED_AFTER_SYNC:
+			*value = dev->stats.syn_dropped_after_sync;
+			break;
+		case LIBEVDEV_STAT_SYNCS:
+			*value = dev->stats.syncs;
+			break;
+		case LIBEVDEV_STAT_SYNC_TIME_NS:
+			*value = dev->stats.sync_time_ns;
+			break;
+		case LIBEVDEV_STAT_EVENTS_DISCARDED:
+			*value = dev->stats.events_discarded;
 			break;
+		case LIBEVDEV_STAT_QUEUE_HIGH_WATER:
+			*value = dev->stats.queue_high_water;
+			break;
+		case LIBEVDEV_STAT_QUEUE_SIZE:
+			*value = dev->queue_size;
+			break;
+		case LIBEVDEV_STAT_EVENTS_COALESCED:
+			*value = dev->stats.events_coalesced;
+			break;
+		default:
+			return -EINVAL;
 	}
 
-	dev->last_event_time = e->time;
+	return 0;
+}
 
-	return rc;
+static inline void
+init_event(struct libevdev *dev, struct input_event *ev, int type, int code, int value)
+{
+	ev->time = dev->last_event_time;
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
 }
 
 /**
- * Sanitize/modify events where needed.
+ * Push an event for every bit that differs between the old and the new
+ * state. The bitmaps are compared one word at a time, so the cost depends
+ * on the number of changes rather than the number of bits.
  */
-static inline enum event_filter_status
-sanitize_event(const struct libevdev *dev,
-	       struct input_event *ev,
-	       enum SyncState sync_state)
+static void
+push_bit_changes(struct libevdev *dev, unsigned int type,
+		 const unsigned long *old, const unsigned long *new,
+		 unsigned int nbits)
 {
-	if (unlikely(dev->num_slots > -1 &&
-		     libevdev_event_is_code(ev, EV_ABS, ABS_MT_SLOT) &&
-		     (ev->value < 0 || ev->value >= dev->num_slots))) {
-		log_bug(dev, "Device \"%s\" received an invalid slot index %d."
-				"Capping to announced max slot number %d.\n",
-				dev->name, ev->value, dev->num_slots - 1);
-		ev->value = dev->num_slots - 1;
-		return EVENT_FILTER_MODIFIED;
+	unsigned int i;
 
-	/* Drop any invalid tracking IDs, they are only supposed to go from
-	   N to -1 or from -1 to N. Never from -1 to -1, or N to M. Very
-	   unlikely to ever happen from a real device.
-	   */
-	} else if (unlikely(sync_state == SYNC_NONE &&
-			    dev->num_slots > -1 &&
-			    libevdev_event_is_code(ev, EV_ABS, ABS_MT_TRACKING_ID) &&
-			    ((ev->value == -1 &&
-			     *slot_value(dev, dev->current_slot, ABS_MT_TRACKING_ID) == -1) ||
-			     (ev->value != -1 &&
-			     *slot_value(dev, dev->current_slot, ABS_MT_TRACKING_ID) != -1)))) {
-		log_bug(dev, "Device \"%s\" received a double tracking ID %d in slot %d.\n",
-			dev->name, ev->value, dev->current_slot);
-		return EVENT_FILTER_DISCARD;
-	}
+	for (i = 0; i < NLONGS(nbits); i++) {
+		unsigned long diff = old[i] ^ new[i];
 
-	return EVENT_FILTER_NONE;
-}
+		while (diff) {
+			unsigned int code = i * LONG_BITS + __builtin_ctzl(diff);
+			struct input_event *ev;
 
-LIBEVDEV_EXPORT int
+			if (code >= nbits)
+				break;
+
+			ev = queue_push(dev);
+			init_event(dev, ev, type, code, bit_is_set(new, code));
+
+			diff &= diff - 1;
+		}
+	}
+}
+
+static int
+sync_key_state(struct libevdev *dev)
+{
+	int rc;
+	unsigned long keystate[NLONGS(KEY_CNT)] = {0};
+
+	rc = ioctl(dev->fd, EVIOCGKEY(sizeof(keystate)), keystate);
+	if (rc < 0)
+		return -errno;
+
+	push_bit_changes(dev, EV_KEY, dev->key_values, keystate,
+			 min(KEY_CNT, rc * 8));
+	memcpy(dev->key_values, keystate, rc);
+
+	return 0;
+}
+
+static int
+sync_sw_state(struct libevdev *dev)
+{
+	int rc;
+	unsigned long swstate[NLONGS(SW_CNT)] = {0};
+
+	rc = ioctl(dev->fd, EVIOCGSW(sizeof(swstate)), swstate);
+	if (rc < 0)
+		return -errno;
+
+	push_bit_changes(dev, EV_SW, dev->sw_values, swstate,
+			 min(SW_CNT, rc * 8));
+	memcpy(dev->sw_values, swstate, rc);
+
+	return 0;
+}
+
+static int
+sync_led_state(struct libevdev *dev)
+{
+	int rc;
+	unsigned long ledstate[NLONGS(LED_CNT)] = {0};
+
+	rc = ioctl(dev->fd, EVIOCGLED(sizeof(ledstate)), ledstate);
+	if (rc < 0)
+		return -errno;
+
+	push_bit_changes(dev, EV_LED, dev->led_values, ledstate,
+			 min(LED_CNT, rc * 8));
+	memcpy(dev->led_values, ledstate, rc);
+
+	return 0;
+}
+
+/**
+ * @return 0 on success or the first error. An axis that fails to sync
+ * keeps its previous value, the other axes are still synced.
+ */
+static int
+sync_abs_state(struct libevdev *dev)
+{
+	int rc = 0;
+	int i;
+
+	for (i = ABS_X; i < ABS_CNT; i++) {
+		struct input_absinfo abs_info;
+
+		if (i >= ABS_MT_MIN && i <= ABS_MT_MAX)
+			continue;
+
+		if (!bit_is_set(dev->caps->abs_bits, i))
+			continue;
+
+		if (ioctl(dev->fd, EVIOCGABS(i), &abs_info) < 0) {
+			if (rc == 0)
+				rc = -errno;
+			continue;
+		}
+
+		if (dev->abs_info[i].value != abs_info.value) {
+			struct input_event *ev = queue_push(dev);
+
+			init_event(dev, ev, EV_ABS, i, abs_info.value);
+			dev->abs_info[i].value = abs_info.value;
+		}
+	}
+
+	return rc;
+}
+
+/**
+ * dev->mt_sync.slot_update and dev->mt_sync.tracking_id_changes are
+ * all-zero outside of this function. Bits are cleared as they are
+ * consumed, so the buffers don't need to be wiped on every sync.
+ *
+ * @return 0 on success or the first error. An axis that fails to sync
+ * keeps its previous values, the other axes are still synced.
+ */
+static int
+sync_mt_state(struct libevdev *dev, int create_events)
+{
+	struct input_event *ev;
+	struct input_absinfo abs_info;
+	int rc = 0;
+	int axis, slot;
+	int axes[ABS_MT_CNT];
+	int naxes = 0;
+	int i;
+	int ioctl_success = 0;
+	int last_reported_slot = 0;
+	struct mt_sync_state *mt_state = dev->mt_sync.mt_state;
+	unsigned long *slot_update = dev->mt_sync.slot_update;
+	unsigned long *tracking_id_changes = dev->mt_sync.tracking_id_changes;
+	int need_tracking_id_changes = 0;
+
+#define AXISBIT(_slot, _axis) (_slot * ABS_MT_CNT + _axis - ABS_MT_MIN)
+
+	for (axis = libevdev_get_next_event_code(dev, EV_ABS, ABS_MT_MIN);
+	     axis != -1 && axis <= ABS_MT_MAX;
+	     axis = libevdev_get_next_event_code(dev, EV_ABS, axis + 1)) {
+		if (axis != ABS_MT_SLOT)
+			axes[naxes++] = axis;
+	}
+
+	for (i = 0; i < naxes; i++) {
+		axis = axes[i];
+
+		mt_state->code = axis;
+		if (ioctl(dev->fd, EVIOCGMTSLOTS(dev->mt_sync.mt_state_sz), mt_state) < 0) {
+			/* if the first ioctl fails with -EINVAL, chances are the kernel
+			   doesn't support the ioctl. Simply continue */
+			if (errno != EINVAL || ioctl_success) {
+				if (rc == 0)
+					rc = -errno;
+			}
+			continue;
+		}
+
+		ioctl_success = 1;
+
+		for (slot = 0; slot < dev->num_slots; slot++) {
+
+			if (*slot_value(dev, slot, axis) == mt_state->val[slot])
+				continue;
+
+			if (axis == ABS_MT_TRACKING_ID &&
+			    *slot_value(dev, slot, axis) != -1 &&
+			    mt_state->val[slot] != -1) {
+				set_bit(tracking_id_changes, slot);
+				need_tracking_id_changes = 1;
+			}
+
+			*slot_value(dev, slot, axis) = mt_state->val[slot];
+
+			set_bit(slot_update, AXISBIT(slot, axis));
+			/* note that this slot has updates */
+			set_bit(slot_update, AXISBIT(slot, ABS_MT_SLOT));
+		}
+	}
+
+	if (!create_events) {
+		memset(slot_update, 0, dev->mt_sync.slot_update_sz);
+		memset(tracking_id_changes, 0,
+		       dev->mt_sync.tracking_id_changes_sz);
+		goto out;
+	}
+
+	if (need_tracking_id_changes) {
+		for (slot = 0; slot < dev->num_slots;  slot++) {
+			if (!bit_is_set(tracking_id_changes, slot))
+				continue;
+
+			clear_bit(tracking_id_changes, slot);
+
+			ev = queue_push(dev);
+			init_event(dev, ev, EV_ABS, ABS_MT_SLOT, slot);
+			ev = queue_push(dev);
+			init_event(dev, ev, EV_ABS, ABS_MT_TRACKING_ID, -1);
+
+			last_reported_slot = slot;
+		}
+
+		ev = queue_push(dev);
+		init_event(dev, ev, EV_SYN, SYN_REPORT, 0);
+	}
+
+	for (slot = 0; slot < dev->num_slots;  slot++) {
+		if (!bit_is_set(slot_update, AXISBIT(slot, ABS_MT_SLOT)))
+			continue;
+
+		clear_bit(slot_update, AXISBIT(slot, ABS_MT_SLOT));
+
+		ev = queue_push(dev);
+		init_event(dev, ev, EV_ABS, ABS_MT_SLOT, slot);
+		last_reported_slot = slot;
+
+		for (i = 0; i < naxes; i++) {
+			axis = axes[i];
+
+			if (bit_is_set(slot_update, AXISBIT(slot, axis))) {
+				clear_bit(slot_update, AXISBIT(slot, axis));
+				ev = queue_push(dev);
+				init_event(dev, ev, EV_ABS, axis, *slot_value(dev, slot, axis));
+			}
+		}
+	}
+
+	/* add one last slot event to make sure the client is on the same
+	   slot as the kernel */
+
+	if (ioctl(dev->fd, EVIOCGABS(ABS_MT_SLOT), &abs_info) < 0) {
+		if (rc == 0)
+			rc = -errno;
+		goto out;
+	}
+
+	dev->current_slot = abs_info.value;
+
+	if (dev->current_slot != last_reported_slot) {
+		ev = queue_push(dev);
+		init_event(dev, ev, EV_ABS, ABS_MT_SLOT, dev->current_slot);
+	}
+
+#undef AXISBIT
+
+out:
+	abs_info_sync_slot(dev);
+
+	return rc;
+}
+
+/**
+ * Called after each successful read when the queue may grow. Double the
+ * queue size once consecutive reads have filled the queue.
+ */
+static void
+grow_event_queue(struct libevdev *dev)
+{
+	const unsigned int FULL_READS_BEFORE_GROWING = 2;
+	size_t size;
+
+	if (queue_num_free_elements(dev) > 0) {
+		dev->queue_config.full_reads = 0;
+		return;
+	}
+
+	if (++dev->queue_config.full_reads < FULL_READS_BEFORE_GROWING)
+		return;
+
+	dev->queue_config.full_reads = 0;
+
+	size = min(queue_size(dev) * 2, dev->queue_config.max_size);
+	if (resize_event_queue(dev, size) < 0)
+		log_error(dev, "Failed to grow the event queue to %zu events.\n", size);
+	else
+		log_dbg(dev, "Event queue grown to %zu events.\n", size);
+}
+
+/**
+ * Account for a read of len bytes into queue_next_element(), or a
+ * negative errno if the read failed.
+ */
+int
+_libevdev_queue_commit_read(struct libevdev *dev, int len)
+{
+	dev->stats.read_calls++;
+	if (len < 0) {
+		return len;
+	} else if (len > 0 && len % sizeof(struct input_event) != 0)
+		return -EINVAL;
+	else if (len > 0) {
+		int nev = len/sizeof(struct input_event);
+		queue_set_num_elements(dev, queue_num_elements(dev) + nev);
+
+		dev->stats.bytes_read += len;
+		dev->stats.events_read += nev;
+		dev->stats.queue_high_water = max(dev->stats.queue_high_water,
+						  queue_num_elements(dev));
+
+		if (dev->queue_config.max_size > queue_size(dev))
+			grow_event_queue(dev);
+	}
+
+	return 0;
+}
+
+static int
+read_more_events(struct libevdev *dev)
+{
+	int free_elem;
+	int len;
+	struct input_event *next;
+
+	/* Only read into the contiguous part of the ring buffer. If the
+	   free space wraps around, the remainder is picked up by the next
+	   read. */
+	free_elem = queue_num_free_elements_contiguous(dev);
+	if (free_elem <= 0)
+		return 0;
+
+	next = queue_next_element(dev);
+	len = read(dev->fd, next, free_elem * sizeof(struct input_event));
+
+	return _libevdev_queue_commit_read(dev, len < 0 ? -errno : len);
+}
+
+static inline bool
+is_syn_report(const struct input_event *ev)
+{
+	return ev->type == EV_SYN && ev->code == SYN_REPORT;
+}
+
+/**
+ * Move the events [from, to) within the queue down to index w, w <= from.
+ *
+ * @return the index after the last event moved
+ */
+static size_t
+queue_move_down(struct libevdev *dev, size_t w, size_t from, size_t to)
+{
+	if (w == from)
+		return to;
+
+	while (from < to)
+		*queue_element(dev, w++) = *queue_element(dev, from++);
+
+	return w;
+}
+
+/* A run of consecutive queued frames with only EV_REL events */
+struct rel_run {
+	size_t start, end;	/* queue indices of the run, end exclusive */
+	unsigned int nframes;
+	int deltas[REL_CNT];
+	unsigned long present[NLONGS(REL_CNT)];
+	struct timeval time;	/* of the last frame in the run */
+};
+
+/**
+ * Write the run to the queue at index w, w <= run->start. A run of more
+ * than one frame is written as a single frame with one event per axis.
+ * The merged frame is never longer than the run.
+ *
+ * @return the index after the last event written
+ */
+static size_t
+rel_run_flush(struct libevdev *dev, struct rel_run *run, size_t w)
+{
+	struct input_event *e;
+	unsigned int code;
+
+	if (run->nframes == 1) {
+		w = queue_move_down(dev, w, run->start, run->end);
+	} else if (run->nframes > 1) {
+		for (code = 0; code < REL_CNT; code++) {
+			if (!bit_is_set(run->present, code) ||
+			    run->deltas[code] == 0)
+				continue;
+
+			e = queue_element(dev, w++);
+			e->time = run->time;
+			e->type = EV_REL;
+			e->code = code;
+			e->value = run->deltas[code];
+		}
+
+		e = queue_element(dev, w++);
+		e->time = run->time;
+		e->type = EV_SYN;
+		e->code = SYN_REPORT;
+		e->value = 0;
+	}
+
+	memset(run, 0, sizeof(*run));
+
+	return w;
+}
+
+/**
+ * Merge consecutive queued frames with only EV_REL events into one frame
+ * with the summed deltas and the timestamp of the last frame merged. The
+ * frame at the head of the queue may be partially processed already and
+ * is left alone, as is the incomplete frame at the tail. Any frame with
+ * other events ends a run of frames to merge.
+ *
+ * @return the number of events removed from the queue
+ */
+static size_t
+coalesce_rel_frames(struct libevdev *dev)
+{
+	size_t nelem = queue_num_elements(dev);
+	size_t r, w;
+	struct rel_run run;
+
+	if (dev->sync_state != SYNC_NONE || dev->peek.syn_dropped)
+		return 0;
+
+	for (r = dev->peek.nprocessed; r < nelem; r++)
+		if (is_syn_report(queue_element(dev, r)))
+			break;
+
+	memset(&run, 0, sizeof(run));
+	w = ++r;
+	while (r < nelem) {
+		size_t end;
+		bool rel_only = true;
+
+		for (end = r; end < nelem; end++) {
+			const struct input_event *e = queue_element(dev, end);
+
+			if (is_syn_report(e))
+				break;
+			if (e->type != EV_REL || e->code >= REL_CNT)
+				rel_only = false;
+		}
+
+		if (end == nelem)
+			break;
+
+		if (rel_only) {
+			size_t i;
+
+			if (run.nframes++ == 0)
+				run.start = r;
+
+			for (i = r; i < end; i++) {
+				const struct input_event *e = queue_element(dev, i);
+
+				run.deltas[e->code] += e->value;
+				set_bit(run.present, e->code);
+			}
+			run.time = queue_element(dev, end)->time;
+			run.end = end + 1;
+		} else {
+			w = rel_run_flush(dev, &run, w);
+			w = queue_move_down(dev, w, r, end + 1);
+		}
+
+		r = end + 1;
+	}
+
+	w = rel_run_flush(dev, &run, w);
+	w = queue_move_down(dev, w, r, nelem);
+
+	if (w < nelem) {
+		queue_set_num_elements(dev, w);
+		dev->stats.events_coalesced += nelem - w;
+	}
+
+	return nelem - w;
+}
+
+/**
+ * Read more events from the fd. With @ref LIBEVDEV_READ_FLAG_COALESCE_REL,
+ * merge relative motion once the queue is more than half full and read
+ * again into the space freed up. Devices read by a hub only hand out
+ * what the hub has already read for them.
+ */
+static int
+fill_queue(struct libevdev *dev, unsigned int flags)
+{
+	int rc;
+
+	if (dev->external_reads)
+		return 0;
+
+	rc = read_more_events(dev);
+
+	/* Refill the space freed by coalescing. Not on a blocking fd,
+	   the read would wait for the device while the merged events are
+	   ready to be returned. */
+	if (rc == 0 && (flags & LIBEVDEV_READ_FLAG_COALESCE_REL) &&
+	    !(flags & LIBEVDEV_READ_FLAG_BLOCKING) &&
+	    queue_num_elements(dev) > queue_size(dev) / 2 &&
+	    coalesce_rel_frames(dev) > 0)
+		rc = read_more_events(dev);
+
+	return rc;
+}
+
+static inline void
+drain_events(struct libevdev *dev)
+{
+	int rc;
+	size_t nelem;
+	int iterations = 0;
+	const int max_iterations = 8; /* EVDEV_BUF_PACKETS in
+					 kernel/drivers/input/evedev.c */
+
+	queue_shift_multiple(dev, queue_num_elements(dev), NULL);
+	memset(&dev->peek, 0, sizeof(dev->peek));
+
+	do {
+		rc = read_more_events(dev);
+		if (rc == -EAGAIN)
+			return;
+
+		if (rc < 0) {
+			log_error(dev, "Failed to drain events before sync.\n");
+			return;
+		}
+
+		nelem = queue_num_elements(dev);
+		queue_shift_multiple(dev, nelem, NULL);
+	} while (iterations++ < max_iterations && nelem >= queue_size(dev));
+
+	/* Our buffer should be roughly the same or bigger than the kernel
+	   buffer in most cases, so we usually don't expect to recurse. If
+	   we do, make sure we stop after max_iterations and proceed with
+	   what we have.  This could happen if events queue up faster than
+	   we can drain them.
+	 */
+	if (iterations >= max_iterations)
+		log_info(dev, "Unable to drain events, buffer size mismatch.\n");
+}
+
+static inline int
+first_error(int rc, int err)
+{
+	return rc ? rc : err;
+}
+
+static int
+sync_state(struct libevdev *dev)
+{
+	int rc = 0;
+	struct input_event *ev;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	 /* see section "Discarding events before synchronizing" in
+	  * libevdev/libevdev.h */
+	drain_events(dev);
+
+	/* a failing ioctl only loses part of the delta, so sync as much as
+	 * we can and remember the first error */
+	if (libevdev_has_event_type(dev, EV_KEY))
+		rc = sync_key_state(dev);
+	if (libevdev_has_event_type(dev, EV_LED))
+		rc = first_error(rc, sync_led_state(dev));
+	if (libevdev_has_event_type(dev, EV_SW))
+		rc = first_error(rc, sync_sw_state(dev));
+	if (libevdev_has_event_type(dev, EV_ABS))
+		rc = first_error(rc, sync_abs_state(dev));
+	if (dev->num_slots > -1 &&
+	    libevdev_has_event_code(dev, EV_ABS, ABS_MT_SLOT))
+		rc = first_error(rc, sync_mt_state(dev, 1));
+
+	/* unless the device is gone, hand out what we have */
+	if (rc != 0 && rc != -ENODEV) {
+		log_error(dev, "Failed to sync parts of the device state (%s).\n",
+			  strerror(-rc));
+		rc = 0;
+	}
+
+	dev->queue_nsync = queue_num_elements(dev);
+
+	if (dev->queue_nsync > 0) {
+		ev = queue_push(dev);
+		init_event(dev, ev, EV_SYN, SYN_REPORT, 0);
+		dev->queue_nsync++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	dev->stats.syncs++;
+	dev->stats.sync_time_ns += (end.tv_sec - start.tv_sec) * 1000000000ULL +
+				   end.tv_nsec - start.tv_nsec;
+
+	return rc;
+}
+
+/* The event classes an event processor is specialized for, see
+   event_processor_select(). The processors are instances of
+   process_event() with a constant set of classes, so the compiler drops
+   the code for the other event types. A processor for a set of classes
+   must only be used for devices with exactly those event types. */
+#define EVENT_CLASS_KEY		(1 << 0)
+#define EVENT_CLASS_ABS		(1 << 1)
+#define EVENT_CLASS_MT		(1 << 2)	/**< num_slots > -1 */
+#define EVENT_CLASS_LED		(1 << 3)
+#define EVENT_CLASS_SW		(1 << 4)
+#define EVENT_CLASS_GENERIC	(1 << 5)	/**< any device */
+
+static inline bool
+class_has_type(const struct libevdev *dev, unsigned int classes,
+	       unsigned int class, unsigned int type)
+{
+	if (classes & EVENT_CLASS_GENERIC)
+		return libevdev_has_event_type(dev, type);
+
+	return classes & class;
+}
+
+static inline bool
+class_has_slots(const struct libevdev *dev, unsigned int classes)
+{
+	if (classes & EVENT_CLASS_GENERIC)
+		return dev->num_slots > -1;
+
+	return classes & EVENT_CLASS_MT;
+}
+
+static inline int
+update_key_state(struct libevdev *dev, const struct input_event *e,
+		 unsigned int classes)
+{
+	if (!class_has_type(dev, classes, EVENT_CLASS_KEY, EV_KEY))
+		return 1;
+
+	if (e->code > KEY_MAX)
+		return 1;
+
+	set_bit_state(dev->key_values, e->code, e->value != 0);
+
+	return 0;
+}
+
+static int
+update_mt_state(struct libevdev *dev, const struct input_event *e)
+{
+	if (e->code == ABS_MT_SLOT && dev->num_slots > -1) {
+		/* abs_info is refreshed later, see abs_info_update_slot() */
+		dev->current_slot = e->value;
+		return 0;
+	} else if (dev->current_slot == -1)
+		return 1;
+
+	*slot_value(dev, dev->current_slot, e->code) = e->value;
+	if (dev->current_slot < dev->num_slots)
+		dev->mt_slot_changes[dev->current_slot] |= 1U << (e->code - ABS_MT_MIN);
+
+	return 0;
+}
+
+static inline int
+update_abs_state(struct libevdev *dev, const struct input_event *e,
+		 unsigned int classes)
+{
+	if (!class_has_type(dev, classes, EVENT_CLASS_ABS, EV_ABS))
+		return 1;
+
+	if (e->code > ABS_MAX)
+		return 1;
+
+	/* without slots, current_slot is -1 and this is a noop */
+	if (class_has_slots(dev, classes) &&
+	    e->code >= ABS_MT_MIN && e->code <= ABS_MT_MAX)
+		update_mt_state(dev, e);
+
+	if (bit_is_set(dev->caps->abs_bits, e->code))
+		dev->abs_info[e->code].value = e->value;
+
+	return 0;
+}
+
+static inline int
+update_led_state(struct libevdev *dev, const struct input_event *e,
+		 unsigned int classes)
+{
+	if (!class_has_type(dev, classes, EVENT_CLASS_LED, EV_LED))
+		return 1;
+
+	if (e->code > LED_MAX)
+		return 1;
+
+	set_bit_state(dev->led_values, e->code, e->value != 0);
+
+	return 0;
+}
+
+static inline int
+update_sw_state(struct libevdev *dev, const struct input_event *e,
+		unsigned int classes)
+{
+	if (!class_has_type(dev, classes, EVENT_CLASS_SW, EV_SW))
+		return 1;
+
+	if (e->code > SW_MAX)
+		return 1;
+
+	set_bit_state(dev->sw_values, e->code, e->value != 0);
+
+	return 0;
+}
+
+/**
+ * Record the time between the kernel timestamp of the frame and now, when
+ * the caller gets its SYN_REPORT. Timestamps in the future, e.g. after the
+ * realtime clock was set backwards, are not counted. Neither are synced
+ * events, they carry the timestamp of the last event.
+ */
+static void
+latency_record(struct libevdev *dev, const struct input_event *e)
+{
+	struct timespec now;
+	uint64_t now_ns, time_ns, us;
+	unsigned int bucket;
+
+	if (dev->sync_state != SYNC_NONE ||
+	    clock_gettime(dev->clock_id, &now) < 0)
+		return;
+
+	now_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	time_ns = timeval_to_ns(&e->time);
+	if (time_ns > now_ns)
+		return;
+
+	us = (now_ns - time_ns) / 1000;
+	bucket = us ? 64 - __builtin_clzll(us) : 0;
+	dev->latency.buckets[min(bucket, LATENCY_BUCKETS - 1U)]++;
+}
+
+static inline int
+update_state(struct libevdev *dev, const struct input_event *e,
+	     unsigned int classes)
+{
+	int rc = 0;
+
+	/* mt_slot_changes only exists with slots */
+	if (class_has_slots(dev, classes) && unlikely(dev->mt_changes_reset)) {
+		if (dev->mt_slot_changes)
+			memset(dev->mt_slot_changes, 0,
+			       dev->num_slots * sizeof(*dev->mt_slot_changes));
+		dev->mt_changes_reset = false;
+	}
+
+	switch(e->type) {
+		case EV_SYN:
+			if (e->code == SYN_DROPPED)
+				dev->stats.syn_dropped++;
+			else if (e->code == SYN_REPORT) {
+				if (class_has_slots(dev, classes))
+					dev->mt_changes_reset = true;
+				if (dev->latency.enabled)
+					latency_record(dev, e);
+			}
+			break;
+		case EV_REL:
+			break;
+		case EV_KEY:
+			rc = update_key_state(dev, e, classes);
+			break;
+		case EV_ABS:
+			rc = update_abs_state(dev, e, classes);
+			break;
+		case EV_LED:
+			rc = update_led_state(dev, e, classes);
+			break;
+		case EV_SW:
+			rc = update_sw_state(dev, e, classes);
+			break;
+	}
+
+	dev->last_event_time = e->time;
+
+	return rc;
+}
+
+/**
+ * Sanitize/modify events where needed.
+ */
+static inline enum event_filter_status
+sanitize_event(struct libevdev *dev,
+	       struct input_event *ev,
+	       enum SyncState sync_state,
+	       unsigned int classes)
+{
+	if (!class_has_slots(dev, classes))
+		return EVENT_FILTER_NONE;
+
+	if (unlikely(dev->num_slots > -1 &&
+		     libevdev_event_is_code(ev, EV_ABS, ABS_MT_SLOT) &&
+		     (ev->value < 0 || ev->value >= dev->num_slots))) {
+		log_limited(dev, LIBEVDEV_LOG_MSG_INVALID_SLOT,
+			    ev->value, dev->num_slots - 1);
+		ev->value = dev->num_slots - 1;
+		return EVENT_FILTER_MODIFIED;
+
+	/* Drop any invalid tracking IDs, they are only supposed to go from
+	   N to -1 or from -1 to N. Never from -1 to -1, or N to M. Very
+	   unlikely to ever happen from a real device.
+	   */
+	} else if (unlikely(sync_state == SYNC_NONE &&
+			    dev->num_slots > -1 &&
+			    libevdev_event_is_code(ev, EV_ABS, ABS_MT_TRACKING_ID) &&
+			    ((ev->value == -1 &&
+			     *slot_value(dev, dev->current_slot, ABS_MT_TRACKING_ID) == -1) ||
+			     (ev->value != -1 &&
+			     *slot_value(dev, dev->current_slot, ABS_MT_TRACKING_ID) != -1)))) {
+		log_limited(dev, LIBEVDEV_LOG_MSG_DOUBLE_TRACKING_ID,
+			    ev->value, dev->current_slot);
+		return EVENT_FILTER_DISCARD;
+	}
+
+	return EVENT_FILTER_NONE;
+}
+
+static inline __attribute__((always_inline)) enum event_filter_status
+process_event(struct libevdev *dev, struct input_event *ev,
+	      enum SyncState sync_state, unsigned int classes)
+{
+	enum event_filter_status filter_status;
+
+	filter_status = sanitize_event(dev, ev, sync_state, classes);
+	if (filter_status == EVENT_FILTER_DISCARD)
+		dev->stats.events_discarded++;
+	else
+		update_state(dev, ev, classes);
+
+	return filter_status;
+}
+
+#define EVENT_PROCESSOR(name_, classes_) \
+static enum event_filter_status \
+process_event_##name_(struct libevdev *dev, struct input_event *ev, \
+		      enum SyncState sync_state) \
+{ \
+	return process_event(dev, ev, sync_state, classes_); \
+}
+
+EVENT_PROCESSOR(generic, EVENT_CLASS_GENERIC)
+/* relative devices without buttons, e.g. scroll wheels */
+EVENT_PROCESSOR(none, 0)
+/* mice, trackballs, button boxes */
+EVENT_PROCESSOR(pointer, EVENT_CLASS_KEY)
+EVENT_PROCESSOR(keyboard, EVENT_CLASS_KEY | EVENT_CLASS_LED)
+/* single-touch touchpads and touchscreens, tablets, joysticks */
+EVENT_PROCESSOR(single_touch, EVENT_CLASS_KEY | EVENT_CLASS_ABS)
+EVENT_PROCESSOR(multitouch, EVENT_CLASS_KEY | EVENT_CLASS_ABS | EVENT_CLASS_MT)
+
+/**
+ * Pick the event processor for the device's current event types. Must be
+ * called whenever an initialized device's event types or slots change.
+ * Uninitialized devices use the generic processor, their fields may be
+ * set up in any order.
+ */
+static void
+event_processor_select(struct libevdev *dev)
+{
+	unsigned int classes = 0;
+
+	if (!dev->initialized) {
+		dev->process_event = process_event_generic;
+		return;
+	}
+
+	if (libevdev_has_event_type(dev, EV_KEY))
+		classes |= EVENT_CLASS_KEY;
+	if (libevdev_has_event_type(dev, EV_ABS))
+		classes |= EVENT_CLASS_ABS;
+	if (dev->num_slots > -1)
+		classes |= EVENT_CLASS_MT;
+	if (libevdev_has_event_type(dev, EV_LED))
+		classes |= EVENT_CLASS_LED;
+	if (libevdev_has_event_type(dev, EV_SW))
+		classes |= EVENT_CLASS_SW;
+
+	switch (classes) {
+	case 0:
+		dev->process_event = process_event_none;
+		break;
+	case EVENT_CLASS_KEY:
+		dev->process_event = process_event_pointer;
+		break;
+	case EVENT_CLASS_KEY | EVENT_CLASS_LED:
+		dev->process_event = process_event_keyboard;
+		break;
+	case EVENT_CLASS_KEY | EVENT_CLASS_ABS:
+		dev->process_event = process_event_single_touch;
+		break;
+	case EVENT_CLASS_KEY | EVENT_CLASS_ABS | EVENT_CLASS_MT:
+		dev->process_event = process_event_multitouch;
+		break;
+	default:
+		dev->process_event = process_event_generic;
+		break;
+	}
+}
+
+/**
+ * Shift the next event off the queue into ev and update the device state
+ * for it, unless libevdev_peek_events() has done so already.
+ *
+ * @return 0 if the event is to be passed to the caller, 1 if it was
+ * filtered, or -1 if the queue is empty
+ */
+static int
+process_next_event(struct libevdev *dev, struct input_event *ev)
+{
+	enum event_filter_status filter_status;
+
+	if (queue_shift(dev, ev) != 0)
+		return -1;
+
+	if (dev->peek.nprocessed > 0) {
+		if (--dev->peek.nprocessed == 0)
+			dev->peek.syn_dropped = false;
+		return 0;
+	} else if (dev->peek.discard_next) {
+		dev->peek.discard_next = false;
+		return 1;
+	}
+
+	filter_status = dev->process_event(dev, ev, dev->sync_state);
+
+	/* if we disabled a code, get the next event instead */
+	if (filter_status == EVENT_FILTER_DISCARD ||
+	    !filter_accepts(dev, ev->type, ev->code))
+		return 1;
+
+	return 0;
+}
+
+/**
+ * The caller didn't want the sync events, drop them from the queue.
+ */
+static void
+drop_sync_events(struct libevdev *dev)
+{
+	struct input_event e;
+
+	/* call update_state for all events here, otherwise the library has the wrong view
+	   of the device too */
+	while (process_next_event(dev, &e) >= 0)
+		;
+
+	dev->queue_nsync = 0;
+	dev->sync_state = SYNC_NONE;
+}
+
+static inline void
+check_sync_finished(struct libevdev *dev)
+{
+	struct input_event next;
+
+	if (dev->queue_nsync > 0)
+		return;
+
+	dev->sync_state = SYNC_NONE;
+
+	if (queue_peek(dev, 0, &next) == 0 &&
+	    next.type == EV_SYN && next.code == SYN_DROPPED) {
+		dev->stats.syn_dropped_after_sync++;
+		log_limited(dev, LIBEVDEV_LOG_MSG_SYN_DROPPED_AFTER_SYNC, 0, 0);
+	}
+}
+
+static int
+next_event(struct libevdev *dev, unsigned int flags, struct input_event *ev)
+{
+	int rc = LIBEVDEV_READ_STATUS_SUCCESS;
+	int status;
+	const unsigned int valid_flags = LIBEVDEV_READ_FLAG_NORMAL |
+					 LIBEVDEV_READ_FLAG_SYNC |
+					 LIBEVDEV_READ_FLAG_FORCE_SYNC |
+					 LIBEVDEV_READ_FLAG_BLOCKING |
+					 LIBEVDEV_READ_FLAG_COALESCE_REL;
+
+	if (!dev->initialized) {
+		log_bug(dev, "device not initialized. call libevdev_set_fd() first\n");
+		return -EBADF;
+	} else if (dev->fd < 0)
+		return -EBADF;
+
+	if ((flags & valid_flags) == 0) {
+		log_bug(dev, "invalid flags %#x.\n", flags);
+		return -EINVAL;
+	}
+
+	if (flags & LIBEVDEV_READ_FLAG_SYNC) {
+		if (dev->sync_state == SYNC_NEEDED) {
+			rc = sync_state(dev);
+			if (rc != 0)
+				return rc;
+			dev->sync_state = SYNC_IN_PROGRESS;
+		}
+
+		if (dev->queue_nsync == 0) {
+			dev->sync_state = SYNC_NONE;
+			return -EAGAIN;
+		}
+
+	} else if (dev->sync_state != SYNC_NONE) {
+		drop_sync_events(dev);
+	}
+
+	/* Always read in some more events. Best case this smoothes over a potential SYN_DROPPED,
+	   worst case we don't read fast enough and end up with SYN_DROPPED anyway.
+
+	   Except if the fd is in blocking mode and we still have events from the last read, don't
+	   read in any more.
+	 */
+	do {
+		if (!(flags & LIBEVDEV_READ_FLAG_BLOCKING) ||
+		    queue_num_elements(dev) == 0) {
+			rc = fill_queue(dev, flags);
+			if (rc < 0 && rc != -EAGAIN)
+				goto out;
+		}
+
+		if (flags & LIBEVDEV_READ_FLAG_FORCE_SYNC) {
+			dev->sync_state = SYNC_NEEDED;
+			rc = LIBEVDEV_READ_STATUS_SYNC;
+			goto out;
+		}
+
+		status = process_next_event(dev, ev);
+		if (status < 0)
+			return -EAGAIN;
+
+	/* if we disabled a code, get the next event instead */
+	} while (status != 0);
+
+	rc = LIBEVDEV_READ_STATUS_SUCCESS;
+	if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+		dev->sync_state = SYNC_NEEDED;
+		rc = LIBEVDEV_READ_STATUS_SYNC;
+	}
+
+	if (flags & LIBEVDEV_READ_FLAG_SYNC && dev->queue_nsync > 0) {
+		dev->queue_nsync--;
+		rc = LIBEVDEV_READ_STATUS_SYNC;
+		check_sync_finished(dev);
+	}
+
+out:
+	return rc;
+}
+
+LIBEVDEV_EXPORT int
 libevdev_next_event(struct libevdev *dev, unsigned int flags, struct input_event *ev)
 {
-	int rc = LIBEVDEV_READ_STATUS_SUCCESS;
-	enum event_filter_status filter_status;
+	int rc = next_event(dev, flags, ev);
+
+	abs_info_update_slot(dev);
+
+	return rc;
+}
+
+/**
+ * Common setup for reading more than one event per call: check the device
+ * and the flags, handle the sync state and read once from the fd.
+ *
+ * @return 0 if events can be shifted off the queue, 1 if a sync was
+ * forced, or a negative errno
+ */
+static int
+read_events_prepare(struct libevdev *dev, unsigned int flags)
+{
+	int rc;
 	const unsigned int valid_flags = LIBEVDEV_READ_FLAG_NORMAL |
 					 LIBEVDEV_READ_FLAG_SYNC |
 					 LIBEVDEV_READ_FLAG_FORCE_SYNC |
-					 LIBEVDEV_READ_FLAG_BLOCKING;
+					 LIBEVDEV_READ_FLAG_BLOCKING |
+					 LIBEVDEV_READ_FLAG_COALESCE_REL;
+
+	if (!dev->initialized) {
+		log_bug(dev, "device not initialized. call libevdev_set_fd() first\n");
+		return -EBADF;
+	} else if (dev->fd < 0)
+		return -EBADF;
+
+	if ((flags & valid_flags) == 0) {
+		log_bug(dev, "invalid flags %#x.\n", flags);
+		return -EINVAL;
+	}
+
+	if (flags & LIBEVDEV_READ_FLAG_SYNC) {
+		if (dev->sync_state == SYNC_NEEDED) {
+			rc = sync_state(dev);
+			if (rc != 0)
+				return rc;
+			dev->sync_state = SYNC_IN_PROGRESS;
+		}
+
+		if (dev->queue_nsync == 0) {
+			dev->sync_state = SYNC_NONE;
+			return -EAGAIN;
+		}
+	} else if (dev->sync_state != SYNC_NONE) {
+		drop_sync_events(dev);
+	}
+
+	/* See libevdev_next_event() */
+	if (!(flags & LIBEVDEV_READ_FLAG_BLOCKING) ||
+	    queue_num_elements(dev) == 0) {
+		rc = fill_queue(dev, flags);
+		if (rc < 0 && rc != -EAGAIN)
+			return rc;
+	}
+
+	if (flags & LIBEVDEV_READ_FLAG_FORCE_SYNC) {
+		dev->sync_state = SYNC_NEEDED;
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Shift the next event off the queue into ev and update the device state.
+ * Discarded events and events for disabled codes are skipped. In sync
+ * mode, only the sync events are shifted.
+ *
+ * @return 0 on success, 1 if there are no more events
+ */
+static int
+shift_event(struct libevdev *dev, struct input_event *ev, bool sync)
+{
+	int status;
+
+	do {
+		if (sync && dev->queue_nsync == 0)
+			return 1;
+
+		status = process_next_event(dev, ev);
+		if (status < 0)
+			return 1;
+
+		if (sync)
+			dev->queue_nsync--;
+	} while (status != 0);
+
+	return 0;
+}
+
+static int
+next_events(struct libevdev *dev, unsigned int flags,
+	    struct input_event *evs, size_t nevents)
+{
+	int rc;
+	size_t nev = 0;
+	bool sync = !!(flags & LIBEVDEV_READ_FLAG_SYNC);
+
+	if (nevents > INT_MAX)
+		nevents = INT_MAX;
+
+	rc = read_events_prepare(dev, flags);
+	if (rc < 0)
+		return rc;
+	else if (rc == 1 || nevents == 0)
+		return 0;
+
+	while (nev < nevents && shift_event(dev, &evs[nev], sync) == 0) {
+		const struct input_event *ev = &evs[nev++];
+
+		/* the caller needs to sync before it can continue */
+		if (!sync && ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+			dev->sync_state = SYNC_NEEDED;
+			break;
+		}
+	}
+
+	if (sync)
+		check_sync_finished(dev);
+
+	return nev > 0 ? (int)nev : -EAGAIN;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_next_events(struct libevdev *dev, unsigned int flags,
+		     struct input_event *evs, size_t nevents)
+{
+	int rc = next_events(dev, flags, evs, nevents);
+
+	abs_info_update_slot(dev);
+
+	return rc;
+}
+
+/**
+ * Drop the first event in the queue, it has been processed and filtered
+ * already.
+ */
+static inline void
+peek_drop_first(struct libevdev *dev, bool sync)
+{
+	queue_shift_multiple(dev, 1, NULL);
+	if (sync)
+		dev->queue_nsync--;
+}
+
+static int
+peek_events(struct libevdev *dev, unsigned int flags,
+	    const struct input_event **events, size_t *nevents)
+{
+	int rc;
+	bool sync = !!(flags & LIBEVDEV_READ_FLAG_SYNC);
+	enum event_filter_status filter_status;
+
+	*events = NULL;
+	*nevents = 0;
+
+	rc = read_events_prepare(dev, flags);
+	if (rc < 0)
+		return rc;
+	else if (rc == 1)
+		return LIBEVDEV_READ_STATUS_SYNC;
+
+	/* Process events in place for as long as they can be handed to
+	   the caller as one array. Filtered events at the start of the
+	   queue are dropped. Any other filtered event ends the array, the
+	   next peek after advancing drops it. */
+	while (!dev->peek.syn_dropped) {
+		struct input_event *ev;
+		size_t avail = queue_num_elements_contiguous(dev);
+		bool first = dev->peek.nprocessed == 0;
+
+		if (sync)
+			avail = min(avail, dev->queue_nsync);
+
+		if (dev->peek.nprocessed >= avail)
+			break;
+
+		ev = queue_element(dev, dev->peek.nprocessed);
+
+		if (first && dev->peek.discard_next) {
+			dev->peek.discard_next = false;
+			peek_drop_first(dev, sync);
+			continue;
+		}
+
+		if (!first && !filter_accepts(dev, ev->type, ev->code))
+			break;
+
+		filter_status = dev->process_event(dev, ev, dev->sync_state);
+		if (filter_status == EVENT_FILTER_DISCARD) {
+			if (!first) {
+				dev->peek.discard_next = true;
+				break;
+			}
+			peek_drop_first(dev, sync);
+			continue;
+		}
+
+		if (!filter_accepts(dev, ev->type, ev->code)) {
+			peek_drop_first(dev, sync);
+			continue;
+		}
+
+		dev->peek.nprocessed++;
+
+		/* the caller needs to sync once it has advanced past this */
+		if (!sync && ev->type == EV_SYN && ev->code == SYN_DROPPED)
+			dev->peek.syn_dropped = true;
+	}
+
+	if (dev->peek.nprocessed == 0) {
+		if (sync)
+			check_sync_finished(dev);
+		return -EAGAIN;
+	}
+
+	*events = queue_element(dev, 0);
+	*nevents = dev->peek.nprocessed;
+
+	return (sync || dev->peek.syn_dropped) ?
+		LIBEVDEV_READ_STATUS_SYNC : LIBEVDEV_READ_STATUS_SUCCESS;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_peek_events(struct libevdev *dev, unsigned int flags,
+		     const struct input_event **events, size_t *nevents)
+{
+	int rc = peek_events(dev, flags, events, nevents);
+
+	abs_info_update_slot(dev);
+
+	return rc;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_advance_events(struct libevdev *dev, size_t nevents)
+{
+	if (nevents > dev->peek.nprocessed) {
+		log_bug(dev, "advancing by %zu events, only %zu available\n",
+			nevents, dev->peek.nprocessed);
+		return -EINVAL;
+	}
+
+	queue_shift_multiple(dev, nevents, NULL);
+	dev->peek.nprocessed -= nevents;
+
+	if (dev->sync_state == SYNC_IN_PROGRESS) {
+		dev->queue_nsync -= min(nevents, dev->queue_nsync);
+		check_sync_finished(dev);
+	}
+
+	if (dev->peek.nprocessed == 0 && dev->peek.syn_dropped) {
+		dev->peek.syn_dropped = false;
+		dev->sync_state = SYNC_NEEDED;
+	}
+
+	return 0;
+}
+
+#define frame_mask(uc, lc) \
+	case EV_##uc: \
+		*mask = dev->frame.changed.lc; \
+		max = libevdev_event_type_get_max(type); \
+		break;
+
+static inline int
+frame_type_to_mask_const(const struct libevdev *dev, unsigned int type,
+			 const unsigned long **mask)
+{
+	int max;
+
+	switch(type) {
+		frame_mask(SYN, syn);
+		frame_mask(KEY, key);
+		frame_mask(REL, rel);
+		frame_mask(ABS, abs);
+		frame_mask(LED, led);
+		frame_mask(MSC, msc);
+		frame_mask(SW, sw);
+		frame_mask(SND, snd);
+		default:
+		     max = -1;
+		     break;
+	}
+
+	return max;
+}
+
+static inline int
+frame_type_to_mask(struct libevdev *dev, unsigned int type, unsigned long **mask)
+{
+	int max;
+
+	switch(type) {
+		frame_mask(SYN, syn);
+		frame_mask(KEY, key);
+		frame_mask(REL, rel);
+		frame_mask(ABS, abs);
+		frame_mask(LED, led);
+		frame_mask(MSC, msc);
+		frame_mask(SW, sw);
+		frame_mask(SND, snd);
+		default:
+		     max = -1;
+		     break;
+	}
+
+	return max;
+}
+
+#undef frame_mask
+
+static inline void
+frame_mark_changed(struct libevdev *dev, const struct input_event *ev)
+{
+	unsigned long *mask;
+	int max;
+
+	set_bit(dev->frame.changed.types, ev->type);
+
+	max = frame_type_to_mask(dev, ev->type, &mask);
+	if (max != -1 && ev->code <= (unsigned int)max)
+		set_bit(mask, ev->code);
+}
+
+static void
+frame_reset(struct libevdev *dev)
+{
+	dev->frame.nevents = 0;
+	dev->frame.complete = false;
+	memset(&dev->frame.changed, 0, sizeof(dev->frame.changed));
+	if (dev->mt_slot_changes)
+		memset(dev->mt_slot_changes, 0,
+		       dev->num_slots * sizeof(*dev->mt_slot_changes));
+	dev->mt_changes_reset = false;
+}
+
+static int
+next_frame(struct libevdev *dev, unsigned int flags,
+	   const struct input_event **events, size_t *nevents)
+{
+	int rc;
+	bool sync = !!(flags & LIBEVDEV_READ_FLAG_SYNC);
+	struct input_event *ev = NULL;
+
+	*events = NULL;
+	*nevents = 0;
+
+	rc = read_events_prepare(dev, flags);
+	if (rc < 0)
+		return rc;
+
+	/* forced sync: whatever we have so far is out of date */
+	if (rc == 1) {
+		frame_reset(dev);
+		dev->frame.complete = true;
+		return LIBEVDEV_READ_STATUS_SYNC;
+	}
+
+	if (dev->frame.complete)
+		frame_reset(dev);
+
+	while (dev->frame.nevents < dev->frame.size) {
+		ev = &dev->frame.events[dev->frame.nevents];
+		if (shift_event(dev, ev, sync) != 0) {
+			ev = NULL;
+			break;
+		}
+
+		dev->frame.nevents++;
+		frame_mark_changed(dev, ev);
+
+		if (ev->type == EV_SYN &&
+		    (ev->code == SYN_REPORT || ev->code == SYN_DROPPED)) {
+			dev->frame.complete = true;
+			break;
+		}
+	}
+
+	/* A frame longer than our buffer is handed out in pieces */
+	if (dev->frame.nevents == dev->frame.size)
+		dev->frame.complete = true;
+
+	if (sync) {
+		/* the sync events always end in a SYN_REPORT, but don't
+		   hang on to anything once the sync is done */
+		if (dev->frame.nevents > 0 && dev->queue_nsync == 0)
+			dev->frame.complete = true;
+		check_sync_finished(dev);
+	}
+
+	if (!dev->frame.complete || dev->frame.nevents == 0)
+		return -EAGAIN;
+
+	*events = dev->frame.events;
+	*nevents = dev->frame.nevents;
+
+	ev = &dev->frame.events[dev->frame.nevents - 1];
+	if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+		dev->sync_state = SYNC_NEEDED;
+		return LIBEVDEV_READ_STATUS_SYNC;
+	}
+
+	return sync ? LIBEVDEV_READ_STATUS_SYNC : LIBEVDEV_READ_STATUS_SUCCESS;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_next_frame(struct libevdev *dev, unsigned int flags,
+		    const struct input_event **events, size_t *nevents)
+{
+	int rc = next_frame(dev, flags, events, nevents);
+
+	abs_info_update_slot(dev);
+
+	return rc;
+}
+
+/**
+ * Wait until the fd is readable or the deadline on CLOCK_MONOTONIC has
+ * passed.
+ *
+ * @return 1 if the fd is readable, 0 on timeout or a negative errno
+ */
+static int
+wait_readable(struct libevdev *dev, uint64_t deadline_ns)
+{
+	struct pollfd fds = { dev->fd, POLLIN, 0 };
+	struct timespec now, timeout;
+	uint64_t now_ns, remaining;
+	int rc;
 
-	if (!dev->initialized) {
-		log_bug(dev, "device not initialized. call libevdev_set_fd() first\n");
-		return -EBADF;
-	} else if (dev->fd < 0)
-		return -EBADF;
+	if (deadline_ns == UINT64_MAX) {
+		rc = ppoll(&fds, 1, NULL, NULL);
+	} else {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		now_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+		if (now_ns >= deadline_ns)
+			return 0;
 
-	if ((flags & valid_flags) == 0) {
-		log_bug(dev, "invalid flags %#x.\n", flags);
-		return -EINVAL;
+		remaining = deadline_ns - now_ns;
+		timeout.tv_sec = remaining / 1000000000;
+		timeout.tv_nsec = remaining % 1000000000;
+		rc = ppoll(&fds, 1, &timeout, NULL);
 	}
 
-	if (flags & LIBEVDEV_READ_FLAG_SYNC) {
-		if (dev->sync_state == SYNC_NEEDED) {
-			rc = sync_state(dev);
-			if (rc != 0)
-				return rc;
-			dev->sync_state = SYNC_IN_PROGRESS;
-		}
-
-		if (dev->queue_nsync == 0) {
-			dev->sync_state = SYNC_NONE;
-			return -EAGAIN;
-		}
+	return (rc >= 0) ? rc : -errno;
+}
 
-	} else if (dev->sync_state != SYNC_NONE) {
-		struct input_event e;
+LIBEVDEV_EXPORT int
+libevdev_next_event_deadline(struct libevdev *dev, unsigned int flags,
+			     struct input_event *ev, uint64_t deadline_ns)
+{
+	int rc;
 
-		/* call update_state for all events here, otherwise the library has the wrong view
-		   of the device too */
-		while (queue_shift(dev, &e) == 0) {
-			dev->queue_nsync--;
-			if (sanitize_event(dev, &e, dev->sync_state) != EVENT_FILTER_DISCARD)
-				update_state(dev, &e);
-		}
+	while (true) {
+		rc = libevdev_next_event(dev, flags, ev);
+		if (rc != -EAGAIN || (flags & LIBEVDEV_READ_FLAG_SYNC))
+			return rc;
 
-		dev->sync_state = SYNC_NONE;
+		rc = wait_readable(dev, deadline_ns);
+		if (rc <= 0)
+			return (rc == 0) ? -EAGAIN : rc;
 	}
+}
 
-	/* Always read in some more events. Best case this smoothes over a potential SYN_DROPPED,
-	   worst case we don't read fast enough and end up with SYN_DROPPED anyway.
-
-	   Except if the fd is in blocking mode and we still have events from the last read, don't
-	   read in any more.
-	 */
-	do {
-		if (!(flags & LIBEVDEV_READ_FLAG_BLOCKING) ||
-		    queue_num_elements(dev) == 0) {
-			rc = read_more_events(dev);
-			if (rc < 0 && rc != -EAGAIN)
-				goto out;
-		}
+LIBEVDEV_EXPORT int
+libevdev_next_frame_deadline(struct libevdev *dev, unsigned int flags,
+			     const struct input_event **events, size_t *nevents,
+			     uint64_t deadline_ns)
+{
+	int rc;
 
-		if (flags & LIBEVDEV_READ_FLAG_FORCE_SYNC) {
-			dev->sync_state = SYNC_NEEDED;
-			rc = LIBEVDEV_READ_STATUS_SYNC;
-			goto out;
-		}
+	while (true) {
+		rc = libevdev_next_frame(dev, flags, events, nevents);
+		if (rc != -EAGAIN || (flags & LIBEVDEV_READ_FLAG_SYNC))
+			return rc;
 
-		if (queue_shift(dev, ev) != 0)
-			return -EAGAIN;
+		rc = wait_readable(dev, deadline_ns);
+		if (rc <= 0)
+			return (rc == 0) ? -EAGAIN : rc;
+	}
+}
 
-		filter_status = sanitize_event(dev, ev, dev->sync_state);
-		if (filter_status != EVENT_FILTER_DISCARD)
-			update_state(dev, ev);
+LIBEVDEV_EXPORT int
+libevdev_frame_has_event_type(const struct libevdev *dev, unsigned int type)
+{
+	return type <= EV_MAX && bit_is_set(dev->frame.changed.types, type);
+}
 
-	/* if we disabled a code, get the next event instead */
-	} while(filter_status == EVENT_FILTER_DISCARD ||
-		!libevdev_has_event_code(dev, ev->type, ev->code));
+LIBEVDEV_EXPORT int
+libevdev_frame_has_event_code(const struct libevdev *dev, unsigned int type, unsigned int code)
+{
+	const unsigned long *mask = NULL;
+	int max;
 
-	rc = LIBEVDEV_READ_STATUS_SUCCESS;
-	if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
-		dev->sync_state = SYNC_NEEDED;
-		rc = LIBEVDEV_READ_STATUS_SYNC;
-	}
+	max = frame_type_to_mask_const(dev, type, &mask);
+	if (max == -1 || code > (unsigned int)max)
+		return 0;
 
-	if (flags & LIBEVDEV_READ_FLAG_SYNC && dev->queue_nsync > 0) {
-		dev->queue_nsync--;
-		rc = LIBEVDEV_READ_STATUS_SYNC;
-		if (dev->queue_nsync == 0) {
-			struct input_event next;
-			dev->sync_state = SYNC_NONE;
+	return bit_is_set(mask, code);
+}
 
-			if (queue_peek(dev, 0, &next) == 0 &&
-			    next.type == EV_SYN && next.code == SYN_DROPPED)
-				log_info(dev, "SYN_DROPPED received after finished "
-					 "sync - you're not keeping up\n");
-		}
-	}
+LIBEVDEV_EXPORT int
+libevdev_frame_has_slot(const struct libevdev *dev, unsigned int slot)
+{
+	if (!dev->mt_slot_changes || dev->num_slots < 0 ||
+	    slot >= (unsigned int)dev->num_slots)
+		return 0;
 
-out:
-	return rc;
+	return dev->mt_slot_changes[slot] != 0;
 }
 
 LIBEVDEV_EXPORT int
@@ -1132,28 +3201,28 @@ libevdev_has_event_pending(struct libevdev *dev)
 LIBEVDEV_EXPORT const char *
 libevdev_get_name(const struct libevdev *dev)
 {
-	return dev->name ? dev->name : "";
+	return dev->caps->name ? dev->caps->name : "";
 }
 
 LIBEVDEV_EXPORT const char *
 libevdev_get_phys(const struct libevdev *dev)
 {
-	return dev->phys;
+	return dev->caps->phys;
 }
 
 LIBEVDEV_EXPORT const char *
 libevdev_get_uniq(const struct libevdev *dev)
 {
-	return dev->uniq;
+	return dev->caps->uniq;
 }
 
 #define STRING_SETTER(field) \
 LIBEVDEV_EXPORT void libevdev_set_##field(struct libevdev *dev, const char *field) \
 { \
-	if (field == NULL) \
+	if (field == NULL || caps_writable(dev) < 0) \
 		return; \
-	free(dev->field); \
-	dev->field = strdup(field); \
+	free(dev->caps->field); \
+	dev->caps->field = strdup(field); \
 }
 
 STRING_SETTER(name)
@@ -1163,7 +3232,7 @@ STRING_SETTER(uniq)
 #define PRODUCT_GETTER(name) \
 LIBEVDEV_EXPORT int libevdev_get_id_##name(const struct libevdev *dev) \
 { \
-	return dev->ids.name; \
+	return dev->caps->ids.name; \
 }
 
 PRODUCT_GETTER(product)
@@ -1174,7 +3243,9 @@ PRODUCT_GETTER(version)
 #define PRODUCT_SETTER(field) \
 LIBEVDEV_EXPORT void libevdev_set_id_##field(struct libevdev *dev, int field) \
 { \
-	dev->ids.field = field;\
+	if (caps_writable(dev) < 0) \
+		return; \
+	dev->caps->ids.field = field;\
 }
 
 PRODUCT_SETTER(product)
@@ -1185,29 +3256,29 @@ PRODUCT_SETTER(version)
 LIBEVDEV_EXPORT int
 libevdev_get_driver_version(const struct libevdev *dev)
 {
-	return dev->driver_version;
+	return dev->caps->driver_version;
 }
 
 LIBEVDEV_EXPORT int
 libevdev_has_property(const struct libevdev *dev, unsigned int prop)
 {
-	return (prop <= INPUT_PROP_MAX) && bit_is_set(dev->props, prop);
+	return (prop <= INPUT_PROP_MAX) && bit_is_set(dev->caps->props, prop);
 }
 
 LIBEVDEV_EXPORT int
 libevdev_enable_property(struct libevdev *dev, unsigned int prop)
 {
-	if (prop > INPUT_PROP_MAX)
+	if (prop > INPUT_PROP_MAX || caps_writable(dev) < 0)
 		return -1;
 
-	set_bit(dev->props, prop);
+	set_bit(dev->caps->props, prop);
 	return 0;
 }
 
 LIBEVDEV_EXPORT int
 libevdev_has_event_type(const struct libevdev *dev, unsigned int type)
 {
-	return type == EV_SYN ||(type <= EV_MAX && bit_is_set(dev->bits, type));
+	return type == EV_SYN ||(type <= EV_MAX && bit_is_set(dev->caps->bits, type));
 }
 
 LIBEVDEV_EXPORT int
@@ -1230,6 +3301,47 @@ libevdev_has_event_code(const struct libevdev *dev, unsigned int type, unsigned
 	return bit_is_set(mask, code);
 }
 
+LIBEVDEV_EXPORT int
+libevdev_get_next_event_code(const struct libevdev *dev, unsigned int type, unsigned int code)
+{
+	const unsigned long *mask = NULL;
+	unsigned int next;
+	int max;
+
+	if (!libevdev_has_event_type(dev, type))
+		return -1;
+
+	if (type == EV_SYN)
+		return code <= SYN_MAX ? (int)code : -1;
+
+	max = type_to_mask_const(dev, type, &mask);
+	if (max == -1)
+		return -1;
+
+	next = bits_find_next(mask, max + 1, code);
+
+	return next <= (unsigned int)max ? (int)next : -1;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_get_num_event_codes(const struct libevdev *dev, unsigned int type)
+{
+	const unsigned long *mask = NULL;
+	int max;
+
+	if (!libevdev_has_event_type(dev, type))
+		return 0;
+
+	if (type == EV_SYN)
+		return SYN_CNT;
+
+	max = type_to_mask_const(dev, type, &mask);
+	if (max == -1)
+		return 0;
+
+	return bits_count_n(mask, max + 1);
+}
+
 LIBEVDEV_EXPORT int
 libevdev_get_event_value(const struct libevdev *dev, unsigned int type, unsigned int code)
 {
@@ -1239,7 +3351,9 @@ libevdev_get_event_value(const struct libevdev *dev, unsigned int type, unsigned
 		return 0;
 
 	switch (type) {
-		case EV_ABS: value = dev->abs_info[code].value; break;
+		case EV_ABS:
+			value = dev->abs_info[code].value;
+			break;
 		case EV_KEY: value = bit_is_set(dev->key_values, code); break;
 		case EV_LED: value = bit_is_set(dev->led_values, code); break;
 		case EV_SW: value = bit_is_set(dev->sw_values, code); break;
@@ -1277,19 +3391,21 @@ libevdev_set_event_value(struct libevdev *dev, unsigned int type, unsigned int c
 	e.code = code;
 	e.value = value;
 
-	if (sanitize_event(dev, &e, SYNC_NONE) != EVENT_FILTER_NONE)
+	if (sanitize_event(dev, &e, SYNC_NONE, EVENT_CLASS_GENERIC) != EVENT_FILTER_NONE)
 		return -1;
 
 	switch(type) {
-		case EV_ABS: rc = update_abs_state(dev, &e); break;
-		case EV_KEY: rc = update_key_state(dev, &e); break;
-		case EV_LED: rc = update_led_state(dev, &e); break;
-		case EV_SW: rc = update_sw_state(dev, &e); break;
+		case EV_ABS: rc = update_abs_state(dev, &e, EVENT_CLASS_GENERIC); break;
+		case EV_KEY: rc = update_key_state(dev, &e, EVENT_CLASS_GENERIC); break;
+		case EV_LED: rc = update_led_state(dev, &e, EVENT_CLASS_GENERIC); break;
+		case EV_SW: rc = update_sw_state(dev, &e, EVENT_CLASS_GENERIC); break;
 		default:
 			     rc = -1;
 			     break;
 	}
 
+	abs_info_update_slot(dev);
+
 	return rc;
 }
 
@@ -1339,6 +3455,9 @@ libevdev_set_slot_value(struct libevdev *dev, unsigned int slot, unsigned int co
 
 	*slot_value(dev, slot, code) = value;
 
+	if (code == ABS_MT_SLOT || slot == (unsigned int)dev->current_slot)
+		abs_info_sync_slot(dev);
+
 	return 0;
 }
 
@@ -1355,6 +3474,29 @@ libevdev_fetch_slot_value(const struct libevdev *dev, unsigned int slot, unsigne
 		return 0;
 }
 
+LIBEVDEV_EXPORT int
+libevdev_get_slot_changes(const struct libevdev *dev,
+			  struct libevdev_slot_change *changes,
+			  size_t nchanges)
+{
+	int slot;
+	size_t n = 0;
+
+	if (!dev->mt_slot_changes)
+		return 0;
+
+	for (slot = 0; slot < dev->num_slots && n < nchanges; slot++) {
+		if (dev->mt_slot_changes[slot] == 0)
+			continue;
+
+		changes[n].slot = slot;
+		changes[n].axes = dev->mt_slot_changes[slot];
+		n++;
+	}
+
+	return n;
+}
+
 LIBEVDEV_EXPORT int
 libevdev_get_num_slots(const struct libevdev *dev)
 {
@@ -1367,6 +3509,198 @@ libevdev_get_current_slot(const struct libevdev *dev)
 	return dev->current_slot;
 }
 
+static inline size_t
+state_num_slot_vals(int num_slots)
+{
+	return num_slots > 0 ? num_slots * ABS_MT_CNT : 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_state_new(const struct libevdev *dev, struct libevdev_state **state)
+{
+	struct libevdev_state *s;
+
+	s = calloc(1, sizeof(*s) +
+		   state_num_slot_vals(dev->num_slots) * sizeof(*s->mt_slot_vals));
+	if (!s)
+		return -ENOMEM;
+
+	s->num_slots = dev->num_slots;
+	libevdev_state_capture(dev, s);
+
+	*state = s;
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_state_capture(const struct libevdev *dev, struct libevdev_state *state)
+{
+	int i;
+
+	if (state->num_slots != dev->num_slots)
+		return -EINVAL;
+
+	state->current_slot = dev->current_slot;
+	state->time = dev->last_event_time;
+	memcpy(state->key_values, dev->key_values, sizeof(state->key_values));
+	memcpy(state->led_values, dev->led_values, sizeof(state->led_values));
+	memcpy(state->sw_values, dev->sw_values, sizeof(state->sw_values));
+	for (i = 0; i < ABS_CNT; i++)
+		state->abs_values[i] = bit_is_set(dev->caps->abs_bits, i) ?
+				       dev->abs_info[i].value : 0;
+	memcpy(state->mt_slot_vals, dev->mt_slot_vals,
+	       state_num_slot_vals(dev->num_slots) * sizeof(*state->mt_slot_vals));
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT void
+libevdev_state_free(struct libevdev_state *state)
+{
+	free(state);
+}
+
+/**
+ * Events for libevdev_state_diff(). Events beyond the caller's array are
+ * counted but not written.
+ */
+struct state_events {
+	struct input_event *events;
+	size_t size;
+	size_t n;
+	struct timeval time;
+};
+
+static inline void
+state_push(struct state_events *out, unsigned int type, unsigned int code, int value)
+{
+	if (out->n < out->size) {
+		struct input_event *ev = &out->events[out->n];
+
+		ev->time = out->time;
+		ev->type = type;
+		ev->code = code;
+		ev->value = value;
+	}
+	out->n++;
+}
+
+/* see push_bit_changes() */
+static void
+state_push_bit_changes(struct state_events *out, unsigned int type,
+		       const unsigned long *old, const unsigned long *new,
+		       unsigned int nbits)
+{
+	unsigned int i;
+
+	for (i = 0; i < NLONGS(nbits); i++) {
+		unsigned long diff = old[i] ^ new[i];
+
+		while (diff) {
+			unsigned int code = i * LONG_BITS + __builtin_ctzl(diff);
+
+			if (code >= nbits)
+				break;
+
+			state_push(out, type, code, bit_is_set(new, code));
+			diff &= diff - 1;
+		}
+	}
+}
+
+static inline int
+state_slot_value(const struct libevdev_state *state, int slot, int axis)
+{
+	return state->mt_slot_vals[slot * ABS_MT_CNT + axis - ABS_MT_MIN];
+}
+
+/* see sync_mt_state() */
+static void
+state_push_mt_changes(struct state_events *out,
+		      const struct libevdev_state *from,
+		      const struct libevdev_state *to)
+{
+	const int tracking_id = ABS_MT_TRACKING_ID;
+	int last_reported_slot = from->current_slot;
+	bool tracking_id_changes = false;
+	int slot, axis;
+
+	for (slot = 0; slot < to->num_slots; slot++) {
+		int old = state_slot_value(from, slot, tracking_id);
+		int new = state_slot_value(to, slot, tracking_id);
+
+		if (old == new || old == -1 || new == -1)
+			continue;
+
+		state_push(out, EV_ABS, ABS_MT_SLOT, slot);
+		state_push(out, EV_ABS, ABS_MT_TRACKING_ID, -1);
+		last_reported_slot = slot;
+		tracking_id_changes = true;
+	}
+
+	if (tracking_id_changes)
+		state_push(out, EV_SYN, SYN_REPORT, 0);
+
+	for (slot = 0; slot < to->num_slots; slot++) {
+		bool slot_reported = false;
+
+		for (axis = ABS_MT_MIN + 1; axis <= ABS_MT_MAX; axis++) {
+			int new = state_slot_value(to, slot, axis);
+
+			if (state_slot_value(from, slot, axis) == new)
+				continue;
+
+			if (!slot_reported) {
+				state_push(out, EV_ABS, ABS_MT_SLOT, slot);
+				last_reported_slot = slot;
+				slot_reported = true;
+			}
+			state_push(out, EV_ABS, axis, new);
+		}
+	}
+
+	if (to->current_slot != last_reported_slot)
+		state_push(out, EV_ABS, ABS_MT_SLOT, to->current_slot);
+}
+
+LIBEVDEV_EXPORT int
+libevdev_state_diff(const struct libevdev_state *from,
+		    const struct libevdev_state *to,
+		    struct input_event *events, size_t nevents)
+{
+	struct state_events out = {
+		.events = events,
+		.size = nevents,
+		.n = 0,
+		.time = to->time,
+	};
+	int i;
+
+	if (from->num_slots != to->num_slots)
+		return -EINVAL;
+
+	state_push_bit_changes(&out, EV_KEY, from->key_values, to->key_values, KEY_CNT);
+	state_push_bit_changes(&out, EV_LED, from->led_values, to->led_values, LED_CNT);
+	state_push_bit_changes(&out, EV_SW, from->sw_values, to->sw_values, SW_CNT);
+
+	for (i = 0; i < ABS_CNT; i++) {
+		if (to->num_slots > -1 && i >= ABS_MT_MIN && i <= ABS_MT_MAX)
+			continue;
+
+		if (from->abs_values[i] != to->abs_values[i])
+			state_push(&out, EV_ABS, i, to->abs_values[i]);
+	}
+
+	if (to->num_slots > 0)
+		state_push_mt_changes(&out, from, to);
+
+	if (out.n > 0)
+		state_push(&out, EV_SYN, SYN_REPORT, 0);
+
+	return out.n;
+}
+
 LIBEVDEV_EXPORT const struct input_absinfo*
 libevdev_get_abs_info(const struct libevdev *dev, unsigned int code)
 {
@@ -1393,8 +3727,9 @@ ABS_GETTER(resolution)
 #define ABS_SETTER(field) \
 LIBEVDEV_EXPORT void libevdev_set_abs_##field(struct libevdev *dev, unsigned int code, int val) \
 { \
-	if (!libevdev_has_event_code(dev, EV_ABS, code)) \
+	if (!libevdev_has_event_code(dev, EV_ABS, code) || caps_writable(dev) < 0) \
 		return; \
+	dev->caps->abs_info[code].field = val; \
 	dev->abs_info[code].field = val; \
 }
 
@@ -1407,10 +3742,10 @@ ABS_SETTER(resolution)
 LIBEVDEV_EXPORT void
 libevdev_set_abs_info(struct libevdev *dev, unsigned int code, const struct input_absinfo *abs)
 {
-	if (!libevdev_has_event_code(dev, EV_ABS, code))
+	if (!libevdev_has_event_code(dev, EV_ABS, code) || caps_writable(dev) < 0)
 		return;
 
-	dev->abs_info[code] = *abs;
+	abs_info_set(dev, code, abs);
 }
 
 LIBEVDEV_EXPORT int
@@ -1425,10 +3760,13 @@ libevdev_enable_event_type(struct libevdev *dev, unsigned int type)
 		return 0;
 
 	max = libevdev_event_type_get_max(type);
-	if (max == -1)
+	if (max == -1 || caps_writable(dev) < 0)
 		return -1;
 
-	set_bit(dev->bits, type);
+	set_bit(dev->caps->bits, type);
+	filter_update_type(dev, type);
+	kernel_mask_update(dev, type);
+	event_processor_select(dev);
 
 	if (type == EV_REP) {
 		int delay = 0, period = 0;
@@ -1447,10 +3785,13 @@ libevdev_disable_event_type(struct libevdev *dev, unsigned int type)
 		return -1;
 
 	max = libevdev_event_type_get_max(type);
-	if (max == -1)
+	if (max == -1 || caps_writable(dev) < 0)
 		return -1;
 
-	clear_bit(dev->bits, type);
+	clear_bit(dev->caps->bits, type);
+	filter_update_type(dev, type);
+	kernel_mask_update(dev, type);
+	event_processor_select(dev);
 
 	return 0;
 }
@@ -1461,6 +3802,7 @@ libevdev_enable_event_code(struct libevdev *dev, unsigned int type,
 {
 	unsigned int max;
 	unsigned long *mask = NULL;
+	bool was_set;
 
 	if (libevdev_enable_event_type(dev, type))
 		return -1;
@@ -1479,16 +3821,35 @@ libevdev_enable_event_code(struct libevdev *dev, unsigned int type,
 			break;
 	}
 
+	if (caps_writable(dev) < 0 ||
+	    (type == EV_ABS && abs_info_alloc(dev) < 0))
+		return -1;
+
 	max = type_to_mask(dev, type, &mask);
 
 	if (code > max || (int)max == -1)
 		return -1;
 
+	was_set = bit_is_set(mask, code);
 	set_bit(mask, code);
+	filter_update_code(dev, type, code);
+
+	/* make sure a sync still fits into the queue */
+	if (dev->initialized && !was_set) {
+		size_t nevents = sync_queue_size(dev);
+
+		if (nevents > queue_size(dev) &&
+		    resize_event_queue(dev, nevents * 2) < 0) {
+			clear_bit(mask, code);
+			filter_update_code(dev, type, code);
+			return -1;
+		}
+	}
+
+	kernel_mask_update(dev, type);
 
 	if (type == EV_ABS) {
-		const struct input_absinfo *abs = data;
-		dev->abs_info[code] = *abs;
+		abs_info_set(dev, code, data);
 	} else if (type == EV_REP) {
 		const int *value = data;
 		dev->rep_values[code] = *value;
@@ -1503,7 +3864,7 @@ libevdev_disable_event_code(struct libevdev *dev, unsigned int type, unsigned in
 	unsigned int max;
 	unsigned long *mask = NULL;
 
-	if (type > EV_MAX || type == EV_SYN)
+	if (type > EV_MAX || type == EV_SYN || caps_writable(dev) < 0)
 		return -1;
 
 	max = type_to_mask(dev, type, &mask);
@@ -1512,6 +3873,8 @@ libevdev_disable_event_code(struct libevdev *dev, unsigned int type, unsigned in
 		return -1;
 
 	clear_bit(mask, code);
+	filter_update_code(dev, type, code);
+	kernel_mask_update(dev, type);
 
 	return 0;
 }
@@ -1575,6 +3938,12 @@ libevdev_event_is_type(const struct input_event *ev, unsigned int type)
 	return type < EV_CNT && ev->type == type;
 }
 
+LIBEVDEV_EXPORT uint64_t
+libevdev_event_get_time_ns(const struct input_event *ev)
+{
+	return timeval_to_ns(&ev->time);
+}
+
 LIBEVDEV_EXPORT int
 libevdev_event_is_code(const struct input_event *ev, unsigned int type, unsigned int code)
 {
@@ -1700,7 +4069,7 @@ libevdev_kernel_set_led_values(struct libevdev *dev, ...)
 		if (rc > 0) {
 			nleds--; /* last is EV_SYN */
 			while (nleds--)
-				update_led_state(dev, &ev[nleds]);
+				update_led_state(dev, &ev[nleds], EVENT_CLASS_GENERIC);
 		}
 		rc = (rc != -1) ? 0 : -errno;
 	}
@@ -1717,5 +4086,36 @@ libevdev_set_clock_id(struct libevdev *dev, int clockid)
 	} else if (dev->fd < 0)
 		return -EBADF;
 
-	return ioctl(dev->fd, EVIOCSCLOCKID, &clockid) ? -errno : 0;
+	if (ioctl(dev->fd, EVIOCSCLOCKID, &clockid) < 0)
+		return -errno;
+
+	dev->clock_id = clockid;
+
+	return 0;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_get_clock_id(const struct libevdev *dev)
+{
+	return dev->clock_id;
+}
+
+LIBEVDEV_EXPORT int
+libevdev_kernel_set_event_mask(struct libevdev *dev, int enable)
+{
+	int rc;
+
+	if (!dev->initialized) {
+		log_bug(dev, "device not initialized. call libevdev_set_fd() first\n");
+		return -EBADF;
+	} else if (dev->fd < 0)
+		return -EBADF;
+
+	rc = kernel_mask_send_all(dev, !!enable);
+	if (rc < 0 && enable)
+		kernel_mask_send_all(dev, false);
+
+	dev->kernel_mask = enable && rc == 0;
+
+	return rc;
 }
@@ -29,6 +29,7 @@ extern "C" {
 
 #include <linux/input.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #define LIBEVDEV_ATTRIBUTE_PRINTF(_format, _args) __attribute__ ((format (printf, _format, _args)))
 
@@ -525,6 +526,8 @@ extern "C" {
  * <dd>supported, see libevdev_grab()</dd>
  * <dt>EVIOCSCLOCKID:</dt>
  * <dd>supported, see libevdev_set_clock_id()</dd>
+ * <dt>EVIOCSMASK:</dt>
+ * <dd>supported, see libevdev_kernel_set_event_mask()</dd>
  * <dt>EVIOCREVOKE:</dt>
  * <dd>currently not supported, see
  * http://lists.freedesktop.org/archives/input-tools/2014-January/000688.html</dd>
@@ -746,7 +749,10 @@ enum libevdev_read_flag {
 	LIBEVDEV_READ_FLAG_NORMAL	= 2, /**< Process data in normal mode */
 	LIBEVDEV_READ_FLAG_FORCE_SYNC	= 4, /**< Pretend the next event is a SYN_DROPPED and
 					          require the caller to sync */
-	LIBEVDEV_READ_FLAG_BLOCKING	= 8  /**< The fd is not in O_NONBLOCK and a read may block */
+	LIBEVDEV_READ_FLAG_BLOCKING	= 8, /**< The fd is not in O_NONBLOCK and a read may block */
+	LIBEVDEV_READ_FLAG_COALESCE_REL	= 16 /**< Merge queued frames with only relative
+					          events when the queue fills up,
+					          see libevdev_next_event(). @since 1.6 */
 };
 
 /**
@@ -936,6 +942,114 @@ void libevdev_set_device_log_function(struct libevdev *dev,
 				      enum libevdev_log_priority priority,
 				      void *data);
 
+/**
+ * @ingroup logging
+ *
+ * Identifiers for the messages libevdev may log while processing
+ * events. These messages are caused by the device, so a misbehaving
+ * device may trigger them many times a second. They can be rate-limited,
+ * see libevdev_set_device_log_ratelimit(), and are passed to the handler set
+ * with libevdev_set_device_log_msg_function() without formatting.
+ *
+ * @since 1.6
+ */
+enum libevdev_log_msg_id {
+	/**
+	 * An ABS_MT_SLOT event with a slot outside of the device's range.
+	 * The arguments are the slot index received and the slot index it
+	 * was capped to. Logged with @ref LIBEVDEV_LOG_ERROR.
+	 */
+	LIBEVDEV_LOG_MSG_INVALID_SLOT = 1,
+	/**
+	 * An ABS_MT_TRACKING_ID event that starts a touch in a slot that
+	 * already has one, or ends a touch in a slot that has none. The
+	 * event is discarded. The arguments are the tracking ID and the
+	 * slot. Logged with @ref LIBEVDEV_LOG_ERROR.
+	 */
+	LIBEVDEV_LOG_MSG_DOUBLE_TRACKING_ID,
+	/**
+	 * A SYN_DROPPED right after a sync finished, the caller is not
+	 * reading fast enough. There are no arguments. Logged with
+	 * @ref LIBEVDEV_LOG_INFO.
+	 */
+	LIBEVDEV_LOG_MSG_SYN_DROPPED_AFTER_SYNC,
+	/**
+	 * Messages were suppressed by the rate limit. This is logged before
+	 * the first message that passes the rate limit again, with the
+	 * priority of the suppressed messages. The arguments are the number
+	 * of messages suppressed and their @ref libevdev_log_msg_id.
+	 */
+	LIBEVDEV_LOG_MSG_SUPPRESSED
+};
+
+/**
+ * @ingroup logging
+ *
+ * Logging function for the messages in @ref libevdev_log_msg_id. The
+ * message is passed as its identifier and integer arguments, it is never
+ * formatted.
+ *
+ * @param dev The evdev device
+ * @param priority Log priority of this message
+ * @param data User-supplied data pointer (see
+ * libevdev_set_device_log_msg_function())
+ * @param id The message
+ * @param args The arguments of the message, as documented for id
+ * @param nargs The number of arguments
+ *
+ * @see libevdev_set_device_log_msg_function
+ * @since 1.6
+ */
+typedef void (*libevdev_device_log_msg_func_t)(const struct libevdev *dev,
+					       enum libevdev_log_priority priority,
+					       void *data,
+					       enum libevdev_log_msg_id id,
+					       const int *args,
+					       unsigned int nargs);
+
+/**
+ * @ingroup logging
+ *
+ * Set a handler for the messages in @ref libevdev_log_msg_id for this
+ * device context. If set, these messages are only passed to this
+ * handler, the printf-style handlers do not see them. All other messages
+ * are logged as before.
+ *
+ * @param dev The evdev device
+ * @param logfunc The logging function, or NULL to pass the messages to
+ * the printf-style handlers again.
+ * @param priority Minimum priority to be passed to logfunc.
+ * @param data User-specific data passed to the log handler.
+ *
+ * @note This function may be called before libevdev_set_fd().
+ * @since 1.6
+ */
+void libevdev_set_device_log_msg_function(struct libevdev *dev,
+					  libevdev_device_log_msg_func_t logfunc,
+					  enum libevdev_log_priority priority,
+					  void *data);
+
+/**
+ * @ingroup logging
+ *
+ * Limit how often each message in @ref libevdev_log_msg_id is logged for
+ * this device context. At most burst messages with the same identifier
+ * are logged per interval, the others are counted and reported with
+ * @ref LIBEVDEV_LOG_MSG_SUPPRESSED. By default, messages are never
+ * suppressed.
+ *
+ * @param dev The evdev device
+ * @param burst The number of messages per interval, or 0 to never
+ * suppress messages
+ * @param interval_ms The length of an interval in milliseconds
+ *
+ * @note This function may be called before libevdev_set_fd().
+ * @since 1.6
+ */
+void libevdev_set_device_log_ratelimit(struct libevdev *dev,
+				       unsigned int burst,
+				       unsigned int interval_ms);
+
 /**
  * @ingroup init
  */
@@ -1045,6 +1159,230 @@ int libevdev_change_fd(struct libevdev* dev, int fd);
  */
 int libevdev_get_fd(const struct libevdev* dev);
 
+/**
+ * @ingroup init
+ *
+ * Set the size of libevdev's internal event queue, in events. By default,
+ * libevdev picks a size based on the device's capabilities. A queue
+ * that is at least as large as the kernel's buffer for this client lets
+ * libevdev empty the kernel buffer with a single read(2).
+ *
+ * If called before libevdev_set_fd(), the size is applied when the device
+ * is initialized. libevdev may enlarge the queue so that it can hold the
+ * events needed to sync the device after a SYN_DROPPED.
+ *
+ * If called after libevdev_set_fd(), the queue is resized immediately.
+ * Events already queued are kept. Pointers returned by
+ * libevdev_next_frame() or libevdev_peek_events() are invalidated.
+ *
+ * @param dev The evdev device
+ * @param size The new queue size in events
+ *
+ * @return 0 on success or a negative errno on failure.
+ * @retval -EINVAL The size is smaller than the number of events currently
+ * queued, or too small to sync the device
+ * @retval -ENOMEM The queue could not be allocated
+ *
+ * @see libevdev_set_queue_max_size
+ * @since 1.6
+ */
+int libevdev_set_queue_size(struct libevdev *dev, size_t size);
+
+/**
+ * @ingroup init
+ *
+ * @param dev The evdev device
+ *
+ * @return The size of the internal event queue in events, or 0 if the
+ * device has not been initialized with libevdev_set_fd() yet.
+ *
+ * @since 1.6
+ */
+size_t libevdev_get_queue_size(const struct libevdev *dev);
+
+/**
+ * @ingroup init
+ *
+ * Let libevdev grow its internal event queue when the caller does not
+ * keep up with the device. When consecutive reads fill the queue
+ * completely, libevdev doubles the queue size, up to max_size events. The
+ * queue never shrinks automatically.
+ *
+ * Growing the queue happens in the read path after the events have been
+ * read. It costs a reallocation and a copy of the queued events, and
+ * invalidates pointers returned by libevdev_next_frame() or
+ * libevdev_peek_events() as described in libevdev_set_queue_size().
+ *
+ * Automatic growing is disabled by default. This function may be called
+ * before libevdev_set_fd().
+ *
+ * @param dev The evdev device
+ * @param max_size The maximum queue size in events, or 0 to disable
+ * growing the queue.
+ *
+ * @return 0 on success.
+ *
+ * @see libevdev_set_queue_size
+ * @since 1.6
+ */
+int libevdev_set_queue_max_size(struct libevdev *dev, size_t max_size);
+
+/**
+ * @ingroup init
+ *
+ * Opaque struct holding the capabilities of a device, see
+ * libevdev_snapshot_new().
+ */
+struct libevdev_snapshot;
+
+/**
+ * @ingroup init
+ *
+ * Take a snapshot of the static part of a device: the event types and
+ * codes, properties, the axis ranges, the ids, the driver version and the
+ * name, phys and uniq strings. The snapshot can be used to initialize
+ * further instances of the same device with
+ * libevdev_set_fd_with_snapshot(), skipping most of the ioctls
+ * libevdev_set_fd() needs to probe the device.
+ *
+ * The snapshot reflects libevdev's view of the device, including local
+ * modifications such as libevdev_disable_event_code(). A snapshot should
+ * be taken immediately after libevdev_set_fd() if it is to be used for
+ * other fds of the same device.
+ *
+ * The snapshot is independent of the device it was taken from and must be
+ * released with libevdev_snapshot_free(). Internally, the capabilities
+ * are shared with the device, and with all devices initialized from the
+ * snapshot, until one of them is modified. Taking a snapshot is cheap and
+ * devices initialized from a snapshot use less memory than devices
+ * probed with libevdev_set_fd().
+ *
+ * @param dev The evdev device
+ * @param[out] snapshot The newly allocated snapshot
+ *
+ * @return 0 on success, or a negative errno on failure
+ *
+ * @see libevdev_new_from_fd_with_snapshot
+ *
+ * @since 1.6
+ */
+int libevdev_snapshot_new(const struct libevdev *dev,
+			  struct libevdev_snapshot **snapshot);
+
+/**
+ * @ingroup init
+ *
+ * Release the memory associated with a snapshot. If snapshot is NULL,
+ * this function does nothing.
+ *
+ * @param snapshot The snapshot, created with libevdev_snapshot_new()
+ *
+ * @since 1.6
+ */
+void libevdev_snapshot_free(struct libevdev_snapshot *snapshot);
+
+/**
+ * @ingroup init
+ *
+ * Like libevdev_set_fd(), but take the device capabilities from a
+ * snapshot instead of querying them from the kernel. The snapshot is
+ * validated against the device's ids and supported event types only, the
+ * caller must ensure it was taken from the same kind of device. The device
+ * state (key, LED and switch states, axis values and multitouch slots) is
+ * always read from the fd.
+ *
+ * The snapshot may be freed after this call, the device keeps its own
+ * reference to the capabilities.
+ *
+ * @param dev The evdev device
+ * @param fd The file descriptor for the device
+ * @param snapshot A snapshot created with libevdev_snapshot_new()
+ *
+ * @return 0 on success, or a negative errno on failure. If the device does
+ * not match the snapshot, -ESTALE is returned and the caller should fall
+ * back to libevdev_set_fd().
+ *
+ * @see libevdev_set_fd
+ *
+ * @since 1.6
+ */
+int libevdev_set_fd_with_snapshot(struct libevdev *dev, int fd,
+				  const struct libevdev_snapshot *snapshot);
+
+/**
+ * @ingroup init
+ *
+ * Initialize a new libevdev device from the given fd and snapshot. This is
+ * a shortcut for libevdev_new() followed by
+ * libevdev_set_fd_with_snapshot().
+ *
+ * @param fd A file descriptor to the device in O_RDWR or O_RDONLY mode.
+ * @param snapshot A snapshot created with libevdev_snapshot_new()
+ * @param[out] dev The newly initialized evdev device.
+ *
+ * @return On success, 0 is returned and dev is set to the newly
+ * allocated struct. On failure, a negative errno is returned and the value
+ * of dev is undefined.
+ *
+ * @since 1.6
+ */
+int libevdev_new_from_fd_with_snapshot(int fd,
+				       const struct libevdev_snapshot *snapshot,
+				       struct libevdev **dev);
+
+/**
+ * @ingroup init
+ *
+ * Write a binary description of the device's capabilities into the
+ * given buffer: the event types and codes, properties, axis ranges,
+ * repeat values, the ids, the driver version and the name, phys and uniq
+ * strings. The description can be stored, e.g. in a file, and loaded
+ * again with libevdev_new_from_description().
+ *
+ * If the buffer is too small, nothing is written and the required size is
+ * returned. Call this function with a size of 0 to query the size.
+ *
+ * The format is versioned and only valid on the architecture it was
+ * written on. It contains the device's capabilities as libevdev sees
+ * them, including local modifications such as
+ * libevdev_disable_event_code().
+ *
+ * @param dev The evdev device
+ * @param data The buffer to write the description to
+ * @param size The size of the buffer in bytes
+ *
+ * @return The size of the description in bytes, or a negative errno on
+ * failure. If the return value is larger than size, nothing was written.
+ *
+ * @since 1.6
+ */
+int libevdev_write_description(const struct libevdev *dev, void *data, size_t size);
+
+/**
+ * @ingroup init
+ *
+ * Create a new libevdev device from a description written by
+ * libevdev_write_description(). The data is copied and may be an mmap'd
+ * file, it is not referenced after this call.
+ *
+ * The device is not connected to a kernel device, as if it had been
+ * created with libevdev_new() and set up with libevdev_set_name(),
+ * libevdev_enable_event_code(), etc. It can be passed to
+ * libevdev_uinput_create_from_device().
+ *
+ * @param data The description
+ * @param size The size of the data in bytes
+ * @param[out] dev The newly allocated device
+ *
+ * @return 0 on success, or a negative errno on failure. -EINVAL is returned
+ * if the data is not a valid description, -ENOTSUP if it was written on an
+ * incompatible architecture.
+ *
+ * @since 1.6
+ */
+int libevdev_new_from_description(const void *data, size_t size,
+				  struct libevdev **dev);
+
 /**
  * @ingroup events
  */
@@ -1103,6 +1441,18 @@ enum libevdev_read_status {
  * Any state changes are available as events as described above. If
  * @ref LIBEVDEV_READ_FLAG_FORCE_SYNC is set, the value of ev is undefined.
  *
+ * If @ref LIBEVDEV_READ_FLAG_COALESCE_REL is set and more than half of the
+ * internal queue is in use after a read, consecutive queued frames that
+ * contain only EV_REL events are merged into a single frame. The merged
+ * frame has one event per axis with the summed deltas and the timestamp of
+ * the last merged frame. Frames with any other event, e.g. a key press or
+ * a SYN_DROPPED, are never merged, so the order of relative motion and
+ * other events is preserved. The frame at the head of the queue is never
+ * merged. This frees up space in the queue for a caller that falls behind
+ * a high-frequency device and reduces the chance of a SYN_DROPPED.
+ * Merging only happens in normal mode, the events removed are counted in
+ * @ref LIBEVDEV_STAT_EVENTS_COALESCED.
+ *
  * @param dev The evdev device, already initialized with libevdev_set_fd()
  * @param flags Set of flags to determine behaviour. If @ref LIBEVDEV_READ_FLAG_NORMAL
  * is set, the next event is read in normal mode. If @ref LIBEVDEV_READ_FLAG_SYNC is
@@ -1119,6 +1469,306 @@ enum libevdev_read_status {
  */
 int libevdev_next_event(struct libevdev *dev, unsigned int flags, struct input_event *ev);
 
+/**
+ * @ingroup events
+ *
+ * Get up to nevents events from the device. This is the batch version of
+ * libevdev_next_event() and follows the same rules for normal mode, sync
+ * mode and the read flags. libevdev reads at most once from the fd per
+ * call and processes each event as libevdev_next_event() does, the
+ * device state is updated for every event copied into evs.
+ *
+ * In normal mode (when flags has @ref LIBEVDEV_READ_FLAG_NORMAL set), the
+ * events currently queued are copied into evs. If an EV_SYN SYN_DROPPED
+ * event is encountered, it is the last event in evs and the caller should
+ * now call this function (or libevdev_next_event()) with the
+ * @ref LIBEVDEV_READ_FLAG_SYNC flag set.
+ *
+ * In sync mode (when flags has @ref LIBEVDEV_READ_FLAG_SYNC set), only
+ * the events making up the device state delta are copied into evs. Once
+ * all events have been synced, this function returns -EAGAIN.
+ *
+ * If @ref LIBEVDEV_READ_FLAG_FORCE_SYNC is set, the device is marked as
+ * requiring a sync, 0 is returned and evs is left untouched.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param flags Set of flags to determine behaviour, see
+ * libevdev_next_event()
+ * @param evs Caller-allocated array of at least nevents elements
+ * @param nevents The maximum number of events to return
+ *
+ * @return On success, the number of events copied into evs. On failure, a
+ * negative errno is returned.
+ * @retval -EAGAIN No events are currently available on the device, or in
+ * sync mode, all events have been synced
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+int libevdev_next_events(struct libevdev *dev, unsigned int flags,
+			 struct input_event *evs, size_t nevents);
+
+/**
+ * @ingroup events
+ *
+ * Get the next complete frame from the device. A frame is the sequence of
+ * events up to and including the next EV_SYN SYN_REPORT. The events are
+ * processed as in libevdev_next_event() and follow the same rules for
+ * normal mode, sync mode and the read flags. libevdev reads at most once
+ * from the fd per call.
+ *
+ * If the events currently available do not make up a complete frame, this
+ * function returns -EAGAIN. The events read so far are kept and the frame
+ * is completed by a later call. A frame that does not fit into libevdev's
+ * internal buffer is returned in pieces, only the last piece ends in a
+ * SYN_REPORT.
+ *
+ * In normal mode, a frame interrupted by an EV_SYN SYN_DROPPED event ends
+ * with that event and this function returns @ref LIBEVDEV_READ_STATUS_SYNC.
+ * The caller should now call this function (or libevdev_next_event()) with
+ * the @ref LIBEVDEV_READ_FLAG_SYNC flag set. In sync mode, each frame of
+ * the device state delta is returned with @ref LIBEVDEV_READ_STATUS_SYNC
+ * until -EAGAIN signals that all events have been synced.
+ *
+ * If @ref LIBEVDEV_READ_FLAG_FORCE_SYNC is set, any incomplete frame is
+ * discarded, the device is marked as requiring a sync and
+ * @ref LIBEVDEV_READ_STATUS_SYNC is returned with an empty frame.
+ *
+ * The event types, codes and touch slots that appear in the frame
+ * can be queried with libevdev_frame_has_event_type(),
+ * libevdev_frame_has_event_code() and libevdev_frame_has_slot().
+ *
+ * @note A caller should not mix this function with libevdev_next_event()
+ * or libevdev_next_events(), events of an incomplete frame are not
+ * available to those functions.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param flags Set of flags to determine behaviour, see
+ * libevdev_next_event()
+ * @param[out] events Set to the events of the frame. The array is owned by
+ * libevdev and valid until the next call to libevdev_next_frame() or
+ * libevdev_free().
+ * @param[out] nevents Set to the number of events in the frame
+ *
+ * @return On failure, a negative errno is returned and events is set to
+ * NULL.
+ * @retval LIBEVDEV_READ_STATUS_SUCCESS A complete frame is available
+ * @retval LIBEVDEV_READ_STATUS_SYNC The frame ends in a SYN_DROPPED event,
+ * or a frame of synced events is available
+ * @retval -EAGAIN No complete frame is currently available
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+int libevdev_next_frame(struct libevdev *dev, unsigned int flags,
+			const struct input_event **events, size_t *nevents);
+
+/**
+ * @ingroup events
+ *
+ * Get the next event from the device, waiting until an event is
+ * available or the deadline has passed. This behaves like
+ * libevdev_next_event() except that instead of returning -EAGAIN
+ * immediately, it waits for the fd to become readable. The deadline is
+ * absolute, so a caller can use the same deadline for all events of a
+ * frame or a watchdog period.
+ *
+ * In sync mode no waiting is necessary, -EAGAIN is returned as soon as
+ * all events have been synced.
+ *
+ * @code
+ * struct timespec now;
+ * uint64_t deadline;
+ *
+ * clock_gettime(CLOCK_MONOTONIC, &now);
+ * deadline = now.tv_sec * 1000000000ULL + now.tv_nsec + 100000000; // 100ms
+ *
+ * rc = libevdev_next_event_deadline(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev, deadline);
+ * if (rc == -EAGAIN)
+ *     watchdog_timeout();
+ * @endcode
+ *
+ * @note The fd must be in non-blocking mode, otherwise reading from it
+ * may block past the deadline.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param flags Set of flags to determine behaviour, see
+ * libevdev_next_event()
+ * @param[out] ev On success, set to the current event.
+ * @param deadline_ns The point in time to give up, in nanoseconds on
+ * CLOCK_MONOTONIC. A deadline in the past does not wait at all,
+ * UINT64_MAX waits forever.
+ *
+ * @return The return values of libevdev_next_event(). -EAGAIN means no
+ * event arrived before the deadline, -EINTR that the wait was interrupted
+ * by a signal.
+ *
+ * @see libevdev_next_frame_deadline
+ * @since 1.6
+ */
+int libevdev_next_event_deadline(struct libevdev *dev, unsigned int flags,
+				 struct input_event *ev, uint64_t deadline_ns);
+
+/**
+ * @ingroup events
+ *
+ * Get the next complete frame from the device, waiting until the frame
+ * is complete or the deadline has passed. This behaves like
+ * libevdev_next_frame() except that instead of returning -EAGAIN for an
+ * incomplete frame, it waits for the fd to become readable and continues
+ * the frame. The kernel wakes up readers at the end of a frame, so a
+ * frame usually takes a single wait and a single read.
+ *
+ * On timeout, an incomplete frame is kept as in libevdev_next_frame() and
+ * completed by a later call.
+ *
+ * @note The fd must be in non-blocking mode, otherwise reading from it
+ * may block past the deadline.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param flags Set of flags to determine behaviour, see
+ * libevdev_next_event()
+ * @param[out] events Set to the events of the frame, see
+ * libevdev_next_frame()
+ * @param[out] nevents Set to the number of events in the frame
+ * @param deadline_ns The point in time to give up, in nanoseconds on
+ * CLOCK_MONOTONIC. A deadline in the past does not wait at all,
+ * UINT64_MAX waits forever.
+ *
+ * @return The return values of libevdev_next_frame(). -EAGAIN means no
+ * complete frame arrived before the deadline, -EINTR that the wait was
+ * interrupted by a signal.
+ *
+ * @see libevdev_next_event_deadline
+ * @since 1.6
+ */
+int libevdev_next_frame_deadline(struct libevdev *dev, unsigned int flags,
+				 const struct input_event **events, size_t *nevents,
+				 uint64_t deadline_ns);
+
+/**
+ * @ingroup events
+ *
+ * Get a read-only view of the events currently queued in libevdev, without
+ * removing them from the queue. The events are processed as in
+ * libevdev_next_event(), i.e. the device state has been updated for
+ * each event in the view and events for disabled codes are not part of
+ * it. Once the caller has handled some or all of the events, it must call
+ * libevdev_advance_events() to remove them from the queue.
+ *
+ * Calling this function again before advancing returns the same events,
+ * possibly followed by events read since the last call. The view may
+ * contain fewer events than are queued, the remaining events are available
+ * after advancing. libevdev reads at most once from the fd per call.
+ *
+ * In normal mode, the view ends with an EV_SYN SYN_DROPPED event if one is
+ * encountered and this function returns @ref LIBEVDEV_READ_STATUS_SYNC.
+ * Once the caller has advanced past it, the device needs to be synced
+ * with @ref LIBEVDEV_READ_FLAG_SYNC. In sync mode, the view only contains
+ * events from the device state delta.
+ *
+ * If @ref LIBEVDEV_READ_FLAG_FORCE_SYNC is set, the device is marked as
+ * requiring a sync and @ref LIBEVDEV_READ_STATUS_SYNC is returned with an
+ * empty view.
+ *
+ * Events that have been peeked at but not advanced past are returned by
+ * the other event reading functions as normal.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param flags Set of flags to determine behaviour, see
+ * libevdev_next_event()
+ * @param[out] events Set to the first event in the view. The events are
+ * owned by libevdev and valid until the next call to any function that
+ * reads or advances events on this device.
+ * @param[out] nevents Set to the number of events in the view
+ *
+ * @return On failure, a negative errno is returned and events is set to
+ * NULL.
+ * @retval LIBEVDEV_READ_STATUS_SUCCESS One or more events are available
+ * @retval LIBEVDEV_READ_STATUS_SYNC The view ends in a SYN_DROPPED event,
+ * or the view contains synced events
+ * @retval -EAGAIN No events are currently available
+ *
+ * @note This function is signal-safe.
+ *
+ * @see libevdev_advance_events
+ * @since 1.6
+ */
+int libevdev_peek_events(struct libevdev *dev, unsigned int flags,
+			 const struct input_event **events, size_t *nevents);
+
+/**
+ * @ingroup events
+ *
+ * Remove the first nevents events returned by libevdev_peek_events() from
+ * the queue.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param nevents The number of events to remove, must not exceed the
+ * number of events returned by the last call to libevdev_peek_events()
+ *
+ * @return 0 on success, or -EINVAL if nevents is too large
+ *
+ * @note This function is signal-safe.
+ *
+ * @see libevdev_peek_events
+ * @since 1.6
+ */
+int libevdev_advance_events(struct libevdev *dev, size_t nevents);
+
+/**
+ * @ingroup events
+ *
+ * Check if the frame last returned by libevdev_next_frame() contains an
+ * event of the given type.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param type The event type to check for, e.g. EV_ABS
+ *
+ * @return 1 if the frame contains an event of this type, 0 otherwise
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+int libevdev_frame_has_event_type(const struct libevdev *dev, unsigned int type);
+
+/**
+ * @ingroup events
+ *
+ * Check if the frame last returned by libevdev_next_frame() contains an
+ * event with the given type and code. Only EV_SYN, EV_KEY, EV_REL,
+ * EV_ABS, EV_LED, EV_MSC, EV_SW and EV_SND codes are tracked.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param type The event type for the code to check, e.g. EV_ABS
+ * @param code The event code to check for, e.g. ABS_X
+ *
+ * @return 1 if the frame contains an event with this code, 0 otherwise
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+int libevdev_frame_has_event_code(const struct libevdev *dev, unsigned int type, unsigned int code);
+
+/**
+ * @ingroup mt
+ *
+ * Check if the frame last returned by libevdev_next_frame() changes any
+ * ABS_MT axis in the given slot. Switching to a slot with ABS_MT_SLOT
+ * alone does not count as a change.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param slot The numerical slot number, must be smaller than the total
+ * number of slots on this device
+ *
+ * @return 1 if the slot changed in this frame, 0 otherwise or if the
+ * device is not a multi-touch device
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+int libevdev_frame_has_slot(const struct libevdev *dev, unsigned int slot);
+
 /**
  * @ingroup events
  *
@@ -1143,6 +1793,124 @@ int libevdev_next_event(struct libevdev *dev, unsigned int flags, struct input_e
  */
 int libevdev_has_event_pending(struct libevdev *dev);
 
+/**
+ * @ingroup events
+ *
+ * Runtime statistics libevdev keeps for each device, see
+ * libevdev_get_stat(). All counters start at zero when the device is
+ * initialized and only ever increase, except where noted otherwise.
+ *
+ * @since 1.6
+ */
+enum libevdev_stat {
+	/** Number of events read from the fd */
+	LIBEVDEV_STAT_EVENTS_READ = 0,
+	/** Number of read(2) calls on the fd */
+	LIBEVDEV_STAT_READ_CALLS,
+	/** Number of bytes read from the fd */
+	LIBEVDEV_STAT_BYTES_READ,
+	/** Number of SYN_DROPPED events received from the device */
+	LIBEVDEV_STAT_SYN_DROPPED,
+	/**
+	 * Number of SYN_DROPPED events received right after a sync
+	 * finished, i.e. the caller is not keeping up with the device
+	 */
+	LIBEVDEV_STAT_SYN_DROPPED_AFTER_SYNC,
+	/** Number of times the device state was synced */
+	LIBEVDEV_STAT_SYNCS,
+	/** Total time spent syncing the device state, in nanoseconds */
+	LIBEVDEV_STAT_SYNC_TIME_NS,
+	/** Number of events discarded as invalid, e.g. a double tracking ID */
+	LIBEVDEV_STAT_EVENTS_DISCARDED,
+	/** Maximum number of events queued internally at any time */
+	LIBEVDEV_STAT_QUEUE_HIGH_WATER,
+	/** Size of the internal queue in events. This is not a counter. */
+	LIBEVDEV_STAT_QUEUE_SIZE,
+	/**
+	 * Number of events removed from the queue by merging frames, see
+	 * @ref LIBEVDEV_READ_FLAG_COALESCE_REL
+	 */
+	LIBEVDEV_STAT_EVENTS_COALESCED
+};
+
+/**
+ * @ingroup events
+ *
+ * Get the timestamp of the event most recently processed by libevdev, in
+ * nanoseconds. After a SYN_REPORT, this is the timestamp of the frame.
+ * The timestamp is based on the clock returned by libevdev_get_clock_id().
+ *
+ * @param dev The evdev device
+ *
+ * @return The timestamp in nanoseconds, or 0 if no event was processed yet
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+uint64_t libevdev_get_last_event_time_ns(const struct libevdev *dev);
+
+/**
+ * @ingroup events
+ *
+ * Enable or disable the input latency histogram of this device. When
+ * enabled, libevdev compares the timestamp of each SYN_REPORT with the
+ * clock of the device when the event is handed to the caller and counts
+ * the difference in a logarithmic histogram, see
+ * libevdev_get_latency_histogram(). This costs one clock_gettime(2) per
+ * frame. Synced events are not counted.
+ *
+ * The histogram is reset by this call. It is disabled by default,
+ * libevdev_set_fd() keeps the setting.
+ *
+ * @param dev The evdev device
+ * @param enable Nonzero to enable, zero to disable the histogram
+ *
+ * @return 0 on success
+ *
+ * @since 1.6
+ */
+int libevdev_set_latency_histogram(struct libevdev *dev, int enable);
+
+/**
+ * @ingroup events
+ *
+ * Get the input latency histogram of this device, see
+ * libevdev_set_latency_histogram(). Bucket 0 counts frames with a
+ * latency of less than 1us, bucket n counts latencies from 2^(n-1)us up
+ * to but not including 2^n us. The last bucket also counts all larger
+ * latencies.
+ *
+ * @param dev The evdev device
+ * @param[out] buckets Set to the bucket counters, or NULL to query the
+ * number of buckets
+ * @param nbuckets Number of elements in buckets
+ *
+ * @return The number of buckets written, or the total number of buckets
+ * if buckets is NULL
+ *
+ * @since 1.6
+ */
+int libevdev_get_latency_histogram(const struct libevdev *dev,
+				   uint64_t *buckets, size_t nbuckets);
+
+/**
+ * @ingroup events
+ *
+ * Get the current value of a runtime statistic of this device. The
+ * statistics are updated at most once per read(2) on the fd or when a
+ * rare condition occurs, their cost is negligible.
+ *
+ * @param dev The evdev device
+ * @param stat The statistic to query
+ * @param[out] value Set to the current value of the statistic
+ *
+ * @return 0 on success or -EINVAL if stat is invalid
+ *
+ * @since 1.6
+ */
+int libevdev_get_stat(const struct libevdev *dev, enum libevdev_stat stat,
+		      uint64_t *value);
+
 /**
  * @ingroup bits
  *
@@ -1385,6 +2153,50 @@ int libevdev_has_event_type(const struct libevdev *dev, unsigned int type);
  */
 int libevdev_has_event_code(const struct libevdev *dev, unsigned int type, unsigned int code);
 
+/**
+ * @ingroup bits
+ *
+ * Find the next event code of the given type the device supports. The
+ * cost is proportional to the number of codes supported, not to the
+ * range of the type, so this is the preferred way to list the
+ * capabilities of a device:
+ *
+ * @code
+ * int code;
+ *
+ * for (code = libevdev_get_next_event_code(dev, EV_KEY, 0);
+ *      code != -1;
+ *      code = libevdev_get_next_event_code(dev, EV_KEY, code + 1))
+ *     printf("%s\n", libevdev_event_code_get_name(EV_KEY, code));
+ * @endcode
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param type The event type for the code to query (EV_SYN, EV_REL, etc.)
+ * @param code The first event code to consider
+ *
+ * @return The smallest code equal to or greater than code for which
+ * libevdev_has_event_code() returns 1, or -1 if there is none.
+ *
+ * @note This function is signal-safe.
+ * @see libevdev_get_num_event_codes
+ * @since 1.6
+ */
+int libevdev_get_next_event_code(const struct libevdev *dev, unsigned int type, unsigned int code);
+
+/**
+ * @ingroup bits
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param type The event type to query for (EV_SYN, EV_REL, etc.)
+ *
+ * @return The number of event codes of this type the device supports, or
+ * 0 if the device does not support this event type.
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+int libevdev_get_num_event_codes(const struct libevdev *dev, unsigned int type);
+
 /**
  * @ingroup bits
  *
@@ -1631,6 +2443,58 @@ int libevdev_set_slot_value(struct libevdev *dev, unsigned int slot, unsigned in
  */
 int libevdev_fetch_slot_value(const struct libevdev *dev, unsigned int slot, unsigned int code, int *value);
 
+/**
+ * @ingroup mt
+ *
+ * The set of axes changed in one slot, see libevdev_get_slot_changes().
+ *
+ * @since 1.6
+ */
+struct libevdev_slot_change {
+	unsigned int slot;	/**< The slot number */
+	uint32_t axes;		/**< Bit (code - ABS_MT_SLOT) is set for each ABS_MT
+				  axis changed in this slot */
+};
+
+/**
+ * @ingroup mt
+ *
+ * Get all slots changed in the current frame in one call. The current
+ * frame is made up of the events processed since the last SYN_REPORT
+ * before the most recently processed one, i.e. once a SYN_REPORT was
+ * returned by libevdev_next_event(), this function returns the changes
+ * in the frame it terminates, until the next event is processed. With
+ * libevdev_next_frame(), this is the frame last returned.
+ *
+ * Switching to a slot with ABS_MT_SLOT alone does not count as a change.
+ * The new values are available with libevdev_get_slot_value().
+ *
+ * @code
+ * struct libevdev_slot_change changes[num_slots];
+ * int i, n;
+ *
+ * n = libevdev_get_slot_changes(dev, changes, num_slots);
+ * for (i = 0; i < n; i++) {
+ *     if (changes[i].axes & (1 << (ABS_MT_POSITION_X - ABS_MT_SLOT)))
+ *         x = libevdev_get_slot_value(dev, changes[i].slot, ABS_MT_POSITION_X);
+ * }
+ * @endcode
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param[out] changes Set to the changed slots, in ascending slot order
+ * @param nchanges Number of elements in changes. An array with
+ * libevdev_get_num_slots() elements always fits all changes.
+ *
+ * @return The number of elements filled in, 0 if no slot changed or the
+ * device is not a multi-touch device
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+int libevdev_get_slot_changes(const struct libevdev *dev,
+			      struct libevdev_slot_change *changes,
+			      size_t nchanges);
+
 /**
  * @ingroup mt
  *
@@ -1663,6 +2527,98 @@ int libevdev_get_num_slots(const struct libevdev *dev);
  */
 int libevdev_get_current_slot(const struct libevdev *dev);
 
+/**
+ * @ingroup bits
+ *
+ * Opaque struct holding the state of a device, see libevdev_state_new().
+ */
+struct libevdev_state;
+
+/**
+ * @ingroup bits
+ *
+ * Allocate a state buffer for the device and capture the device's
+ * current state into it: key, LED and switch states, axis values, all
+ * multi-touch slots and the current slot. This is the state libevdev
+ * has processed so far, as returned by libevdev_get_event_value() and
+ * libevdev_get_slot_value().
+ *
+ * The state is independent of the device and must be released with
+ * libevdev_state_free().
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param[out] state The newly allocated state
+ *
+ * @return 0 on success, or a negative errno on failure
+ *
+ * @see libevdev_state_capture
+ * @see libevdev_state_diff
+ * @since 1.6
+ */
+int libevdev_state_new(const struct libevdev *dev, struct libevdev_state **state);
+
+/**
+ * @ingroup bits
+ *
+ * Capture the device's current state into an existing state buffer.
+ * This copies the state in bulk and does not allocate, so it is cheap
+ * enough to call once per frame.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param state A state created with libevdev_state_new() for this device
+ * or another device with the same number of slots
+ *
+ * @return 0 on success, or -EINVAL if the number of slots differs
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+int libevdev_state_capture(const struct libevdev *dev, struct libevdev_state *state);
+
+/**
+ * @ingroup bits
+ *
+ * Release the memory associated with a state. If state is NULL, this
+ * function does nothing.
+ *
+ * @param state The state, created with libevdev_state_new()
+ *
+ * @since 1.6
+ */
+void libevdev_state_free(struct libevdev_state *state);
+
+/**
+ * @ingroup bits
+ *
+ * Compute the events that take a device from one state to another, in
+ * the order libevdev_next_event() returns the events after a SYN_DROPPED:
+ * key, LED, switch and axis changes, then the multi-touch slots, then a
+ * final EV_SYN SYN_REPORT. A touch that changes its tracking ID is ended
+ * in a separate frame first, so the touches of each frame remain valid.
+ * The events carry the timestamp of the last event processed before to
+ * was captured.
+ *
+ * This can for example restore a client's view of a device after a VT
+ * switch: capture the state when leaving, and pass the difference to the
+ * current state to the client when coming back.
+ *
+ * @param from The old state
+ * @param to The new state, captured from a device with the same number of
+ * slots
+ * @param[out] events Set to the events, may be NULL if nevents is 0
+ * @param nevents The maximum number of events to write
+ *
+ * @return The number of events needed, 0 if the states are the same, or
+ * -EINVAL if the number of slots differs. If the return value is larger
+ * than nevents, only the first nevents events were written.
+ *
+ * @note This function is signal-safe.
+ * @since 1.6
+ */
+int libevdev_state_diff(const struct libevdev_state *from,
+			const struct libevdev_state *to,
+			struct input_event *events, size_t nevents);
+
 /**
  * @ingroup kernel
  *
@@ -1925,13 +2881,63 @@ int libevdev_kernel_set_led_values(struct libevdev *dev, ...);
  * This is a modification only affecting this representation of
  * this device.
  *
+ * The clock is remembered and set again on the new fd by
+ * libevdev_change_fd(). libevdev_set_fd() resets it to CLOCK_REALTIME.
+ *
  * @param dev The evdev device, already initialized with libevdev_set_fd()
  * @param clockid The clock to use for future events. Permitted values
  * are CLOCK_MONOTONIC and CLOCK_REALTIME (the default).
  * @return 0 on success, or a negative errno on failure
+ *
+ * @see libevdev_get_clock_id
  */
 int libevdev_set_clock_id(struct libevdev *dev, int clockid);
 
+/**
+ * @ingroup kernel
+ *
+ * Get the clock the event timestamps on this device are based on, as
+ * set with libevdev_set_clock_id().
+ *
+ * @note Events read off the fd before the clock was changed but not yet
+ * processed still carry timestamps of the previous clock.
+ *
+ * @param dev The evdev device
+ *
+ * @return The clock ID, CLOCK_REALTIME unless changed
+ *
+ * @since 1.6
+ */
+int libevdev_get_clock_id(const struct libevdev *dev);
+
+/**
+ * @ingroup kernel
+ *
+ * Mirror the set of enabled event codes in the kernel with the EVIOCSMASK
+ * ioctl. Once enabled, events for codes disabled with
+ * libevdev_disable_event_code() or libevdev_disable_event_type() are
+ * dropped by the kernel and never read by libevdev. libevdev re-sends the
+ * mask whenever an event type or code is enabled or disabled.
+ *
+ * libevdev filters these events in any case, so this only reduces the
+ * number of events read from the device and the likelihood of a
+ * SYN_DROPPED. If the kernel does not support EVIOCSMASK, this function
+ * returns -EINVAL and libevdev continues filtering in userspace only.
+ *
+ * This is a modification only affecting this representation of
+ * this device.
+ *
+ * @param dev The evdev device, already initialized with libevdev_set_fd()
+ * @param enable Nonzero to push the event mask to the kernel, zero to
+ * remove it again
+ * @return 0 on success, or a negative errno on failure
+ *
+ * @see libevdev_disable_event_code
+ *
+ * @since 1.6
+ */
+int libevdev_kernel_set_event_mask(struct libevdev *dev, int enable);
+
 /**
  * @ingroup misc
  *
@@ -1980,6 +2986,19 @@ int libevdev_event_is_type(const struct input_event *ev, unsigned int type);
  */
 int libevdev_event_is_code(const struct input_event *ev, unsigned int type, unsigned int code);
 
+/**
+ * @ingroup misc
+ *
+ * Helper function to get the timestamp of an event in nanoseconds.
+ *
+ * @param ev The input event
+ *
+ * @return The timestamp of the event in nanoseconds
+ *
+ * @since 1.6
+ */
+uint64_t libevdev_event_get_time_ns(const struct input_event *ev);
+
 /**
  * @ingroup misc
  *
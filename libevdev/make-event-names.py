@@ -115,15 +115,113 @@ def print_python_map(bits):
 	print("}")
 	print("")
 
-def print_lookup(bits, prefix):
+def lookup_names(bits, prefix):
 	if not hasattr(bits, prefix):
-		return
+		return []
 
 	names = list(getattr(bits, prefix).items())
 	if prefix == "btn":
 		names = names + btn_additional;
 
-	for val, name in sorted(names, key=lambda e: e[1]):
+	return [name for val, name in sorted(names, key=lambda e: e[1])]
+
+def code_type(name, ev_names):
+	# same rules as the lookup by prefix: BTN_ is EV_KEY and FF_STATUS_
+	# must be tested before FF_
+	if name.startswith("BTN_"):
+		return "EV_KEY"
+	if name.startswith("FF_STATUS_"):
+		return "EV_FF_STATUS"
+	for ev in ev_names:
+		if name.startswith(ev[3:] + "_"):
+			return ev
+	raise ValueError("No type for %s" % name)
+
+def name_hash(seed, name):
+	# 32-bit FNV-1a, the initial value is mixed with the seed. The final
+	# mix makes the low bits depend on all bits. This must match
+	# name_hash() in libevdev-names.c
+	h = 0x811c9dc5 ^ seed
+	for c in name:
+		h ^= ord(c)
+		h = (h * 0x01000193) & 0xffffffff
+	h ^= h >> 16
+	h = (h * 0x85ebca6b) & 0xffffffff
+	h ^= h >> 13
+	return h
+
+def perfect_hash(names):
+	"""
+	Hash and displace: the first-level hash picks a bucket. Buckets with
+	several names get a seed that maps all their names to free slots,
+	buckets with a single name point directly to a free slot with a
+	negative displacement of -(slot + 1).
+	"""
+	n = len(names)
+	buckets = [[] for i in range(n)]
+	for i, name in enumerate(names):
+		buckets[name_hash(0, name) % n].append(i)
+
+	displacement = [0] * n
+	slots = [None] * n
+
+	order = sorted(range(n), key=lambda b: -len(buckets[b]))
+	for b in order:
+		items = buckets[b]
+		if len(items) <= 1:
+			break
+
+		seed = 1
+		while True:
+			placed = []
+			for i in items:
+				slot = name_hash(seed, names[i]) % n
+				if slots[slot] is not None or slot in placed:
+					break
+				placed.append(slot)
+			if len(placed) == len(items):
+				break
+			seed += 1
+
+		displacement[b] = seed
+		for i, slot in zip(items, placed):
+			slots[slot] = i
+
+	free = [slot for slot in range(n) if slots[slot] is None]
+	for b in order:
+		if len(buckets[b]) != 1:
+			continue
+		slot = free.pop()
+		slots[slot] = buckets[b][0]
+		displacement[b] = -slot - 1
+
+	return displacement, slots
+
+def print_hash(table, names):
+	if len(set(names)) != len(names):
+		raise ValueError("Duplicate names in %s" % table)
+
+	displacement, slots = perfect_hash(names)
+
+	print("static const int %s_displacement[] = {" % table)
+	for i in range(0, len(displacement), 8):
+		print("	" + " ".join("%d," % d for d in displacement[i:i + 8]))
+	print("};")
+	print("")
+	print("static const unsigned short %s_slots[] = {" % table)
+	for i in range(0, len(slots), 8):
+		print("	" + " ".join("%d," % s for s in slots[i:i + 8]))
+	print("};")
+	print("")
+	print("static const struct name_hash %s_hash = {" % table)
+	print("	.displacement = %s_displacement," % table)
+	print("	.slots = %s_slots," % table)
+	print("	.size = %d," % len(names))
+	print("};")
+	print("")
+
+def print_lookup(names):
+	for name in names:
 		print("	{ .name = \"%s\", .value = %s }," % (name, name))
 
 def print_lookup_table(bits):
@@ -132,20 +230,42 @@ def print_lookup_table(bits):
 	print("	unsigned int value;")
 	print("};")
 	print("")
+	print("/* perfect hash over a name_entry array, see lookup_name() */")
+	print("struct name_hash {")
+	print("	const int *displacement;")
+	print("	const unsigned short *slots;")
+	print("	unsigned int size;")
+	print("};")
+	print("")
+
+	ev_names = lookup_names(bits, "ev")
 	print("static const struct name_entry ev_names[] = {")
-	print_lookup(bits, "ev")
+	print_lookup(ev_names)
 	print("};")
 	print("")
+	print_hash("ev_names", ev_names)
 
-	print("static const struct name_entry code_names[] = {")
+	code_names = []
 	for prefix in sorted(names, key=lambda e: e):
-		print_lookup(bits, prefix[:-1].lower())
+		code_names += lookup_names(bits, prefix[:-1].lower())
+	print("static const struct name_entry code_names[] = {")
+	print_lookup(code_names)
 	print("};")
 	print("")
+	print("/* the event type of each entry in code_names */")
+	print("static const unsigned char code_types[] = {")
+	for name in code_names:
+		print("	%s," % code_type(name, ev_names))
+	print("};")
+	print("")
+	print_hash("code_names", code_names)
+
+	prop_names = lookup_names(bits, "input_prop")
 	print("static const struct name_entry prop_names[] = {")
-	print_lookup(bits, "input_prop")
+	print_lookup(prop_names)
 	print("};")
 	print("")
+	print_hash("prop_names", prop_names)
 
 def print_mapping_table(bits):
 	print("/* THIS FILE IS GENERATED, DO NOT EDIT */")
@@ -1,5 +1,9 @@
 #include <libevdev/libevdev.h>
 #include <libevdev/libevdev-uinput.h>
+#include <libevdev/libevdev-hub.h>
+#include <libevdev/libevdev-mux.h>
+#include <libevdev/libevdev-reader.h>
+#include <libevdev/libevdev-record.h>
 
 int main(void) {
 	return 0;
@@ -0,0 +1,389 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <linux/input.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <libevdev/libevdev-hub.h>
+#include <libevdev/libevdev-util.h>
+
+#include "test-common.h"
+
+START_TEST(test_hub_events)
+{
+	struct uinput_device *uidev1, *uidev2;
+	struct libevdev *dev1, *dev2, *dev;
+	struct libevdev_hub *hub;
+	struct input_event ev;
+	int rc;
+	int x1 = 0, x2 = 0;
+
+	test_create_device(&uidev1, &dev1,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+	test_create_device(&uidev2, &dev2,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_hub_new(&hub);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_gt(libevdev_hub_get_fd(hub), -1);
+
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev1), 0);
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev2), 0);
+
+	rc = libevdev_hub_next_event(hub, &dev, &ev);
+	ck_assert_int_eq(rc, -EAGAIN);
+	ck_assert(dev == NULL);
+
+	uinput_device_event(uidev1, EV_REL, REL_X, 1);
+	uinput_device_event(uidev1, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev1, EV_REL, REL_X, 2);
+	uinput_device_event(uidev1, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev2, EV_REL, REL_X, 1);
+	uinput_device_event(uidev2, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev2, EV_REL, REL_X, 2);
+	uinput_device_event(uidev2, EV_SYN, SYN_REPORT, 0);
+
+	while ((rc = libevdev_hub_next_event(hub, &dev, &ev)) == LIBEVDEV_READ_STATUS_SUCCESS) {
+		int *x = (dev == dev1) ? &x1 : &x2;
+
+		ck_assert(dev == dev1 || dev == dev2);
+
+		if (ev.type == EV_REL) {
+			ck_assert_int_eq(ev.code, REL_X);
+			ck_assert_int_eq(ev.value, *x + 1);
+			*x = ev.value;
+
+			/* frames of the two devices alternate */
+			ck_assert_int_le(abs(x1 - x2), 1);
+		} else {
+			ck_assert_int_eq(ev.type, EV_SYN);
+			ck_assert_int_eq(ev.code, SYN_REPORT);
+		}
+	}
+
+	ck_assert_int_eq(rc, -EAGAIN);
+	ck_assert_int_eq(x1, 2);
+	ck_assert_int_eq(x2, 2);
+
+	libevdev_hub_free(hub);
+	libevdev_free(dev1);
+	libevdev_free(dev2);
+	uinput_device_free(uidev1);
+	uinput_device_free(uidev2);
+}
+END_TEST
+
+START_TEST(test_hub_next_events)
+{
+	struct uinput_device *uidev1, *uidev2;
+	struct libevdev *dev1, *dev2, *dev, *prev = NULL;
+	struct libevdev_hub *hub;
+	struct input_event evs[4];
+	int i, rc;
+	int total = 0;
+
+	test_create_device(&uidev1, &dev1,
+			   EV_REL, REL_X,
+			   -1);
+	test_create_device(&uidev2, &dev2,
+			   EV_REL, REL_X,
+			   -1);
+
+	rc = libevdev_hub_new(&hub);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev1), 0);
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev2), 0);
+
+	rc = libevdev_hub_next_events(hub, &dev, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, -EAGAIN);
+	ck_assert(dev == NULL);
+
+	for (i = 0; i < 4; i++) {
+		uinput_device_event(uidev1, EV_REL, REL_X, 1);
+		uinput_device_event(uidev1, EV_SYN, SYN_REPORT, 0);
+		uinput_device_event(uidev2, EV_REL, REL_X, 1);
+		uinput_device_event(uidev2, EV_SYN, SYN_REPORT, 0);
+	}
+
+	/* full batches, the devices take turns */
+	while ((rc = libevdev_hub_next_events(hub, &dev, evs, ARRAY_LENGTH(evs))) > 0) {
+		ck_assert(dev == dev1 || dev == dev2);
+		ck_assert(dev != prev);
+		ck_assert_int_eq(rc, 4);
+		prev = dev;
+		total += rc;
+	}
+
+	ck_assert_int_eq(rc, -EAGAIN);
+	ck_assert_int_eq(total, 16);
+
+	libevdev_hub_free(hub);
+	libevdev_free(dev1);
+	libevdev_free(dev2);
+	uinput_device_free(uidev1);
+	uinput_device_free(uidev2);
+}
+END_TEST
+
+START_TEST(test_hub_add_remove)
+{
+	struct uinput_device *uidev1, *uidev2;
+	struct libevdev *dev1, *dev2, *dev;
+	struct libevdev_hub *hub;
+	struct input_event ev;
+	int rc;
+
+	test_create_device(&uidev1, &dev1,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+	test_create_device(&uidev2, &dev2,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_hub_new(&hub);
+	ck_assert_int_eq(rc, 0);
+
+	ck_assert_int_eq(libevdev_hub_remove_device(hub, dev1), -ENOENT);
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev1), 0);
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev1), -EEXIST);
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev2), 0);
+
+	uinput_device_event(uidev1, EV_REL, REL_X, 1);
+	uinput_device_event(uidev1, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev2, EV_REL, REL_X, 2);
+	uinput_device_event(uidev2, EV_SYN, SYN_REPORT, 0);
+
+	ck_assert_int_eq(libevdev_hub_remove_device(hub, dev1), 0);
+	ck_assert_int_eq(libevdev_hub_remove_device(hub, dev1), -ENOENT);
+
+	rc = libevdev_hub_next_event(hub, &dev, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert(dev == dev2);
+	ck_assert_int_eq(ev.type, EV_REL);
+	ck_assert_int_eq(ev.value, 2);
+
+	rc = libevdev_hub_next_event(hub, &dev, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert(dev == dev2);
+	ck_assert_int_eq(ev.type, EV_SYN);
+
+	rc = libevdev_hub_next_event(hub, &dev, &ev);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	/* the removed device's events are still there */
+	rc = libevdev_next_event(dev1, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_REL);
+	ck_assert_int_eq(ev.value, 1);
+
+	libevdev_hub_free(hub);
+	libevdev_free(dev1);
+	libevdev_free(dev2);
+	uinput_device_free(uidev1);
+	uinput_device_free(uidev2);
+}
+END_TEST
+
+START_TEST(test_hub_syn_dropped)
+{
+	struct uinput_device *uidev;
+	struct libevdev *dev, *d;
+	struct libevdev_hub *hub;
+	struct input_event ev;
+	int rc;
+	int pipefd[2];
+
+	test_create_device(&uidev, &dev,
+			   EV_SYN, SYN_REPORT,
+			   EV_SYN, SYN_DROPPED,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_hub_new(&hub);
+	ck_assert_int_eq(rc, 0);
+
+	/* see test_syn_dropped_event, the SYN_DROPPED comes through a pipe */
+	rc = pipe2(pipefd, O_NONBLOCK);
+	ck_assert_int_eq(rc, 0);
+
+	libevdev_change_fd(dev, pipefd[0]);
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev), 0);
+
+	ev.type = EV_SYN;
+	ev.code = SYN_DROPPED;
+	ev.value = 0;
+	rc = write(pipefd[1], &ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+
+	rc = libevdev_hub_next_event(hub, &d, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SYNC);
+	ck_assert(d == dev);
+	ck_assert_int_eq(ev.type, EV_SYN);
+	ck_assert_int_eq(ev.code, SYN_DROPPED);
+
+	/* the sync needs the real device, re-add it with that fd */
+	ck_assert_int_eq(libevdev_hub_remove_device(hub, dev), 0);
+	libevdev_change_fd(dev, uinput_device_get_fd(uidev));
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev), 0);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_hub_next_event(hub, &d, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SYNC);
+	ck_assert(d == dev);
+	ck_assert_int_eq(ev.type, EV_KEY);
+	ck_assert_int_eq(ev.code, BTN_LEFT);
+	ck_assert_int_eq(ev.value, 1);
+
+	rc = libevdev_hub_next_event(hub, &d, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SYNC);
+	ck_assert_int_eq(ev.type, EV_SYN);
+	ck_assert_int_eq(ev.code, SYN_REPORT);
+
+	/* the events from the device were drained by the sync */
+	uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_hub_next_event(hub, &d, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert(d == dev);
+	ck_assert_int_eq(ev.type, EV_REL);
+	ck_assert_int_eq(ev.code, REL_X);
+
+	rc = libevdev_hub_next_event(hub, &d, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_SYN);
+	ck_assert_int_eq(ev.code, SYN_REPORT);
+
+	rc = libevdev_hub_next_event(hub, &d, &ev);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_hub_free(hub);
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+}
+END_TEST
+
+START_TEST(test_hub_io_uring)
+{
+	struct uinput_device *uidev1, *uidev2;
+	struct libevdev *dev1, *dev2, *dev;
+	struct libevdev_hub *hub;
+	struct input_event ev;
+	int rc;
+	int x1 = 0, x2 = 0;
+
+	test_create_device(&uidev1, &dev1,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+	test_create_device(&uidev2, &dev2,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_hub_new(&hub);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(libevdev_hub_get_backend(hub), LIBEVDEV_HUB_BACKEND_EPOLL);
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev1), 0);
+
+	rc = libevdev_hub_set_backend(hub, LIBEVDEV_HUB_BACKEND_IO_URING);
+	if (rc == -ENOTSUP || rc == -ENOSYS || rc == -EPERM) {
+		ck_assert_int_eq(libevdev_hub_get_backend(hub), LIBEVDEV_HUB_BACKEND_EPOLL);
+		goto out;
+	}
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(libevdev_hub_get_backend(hub), LIBEVDEV_HUB_BACKEND_IO_URING);
+	ck_assert_int_eq(libevdev_hub_add_device(hub, dev2), 0);
+
+	uinput_device_event(uidev1, EV_REL, REL_X, 1);
+	uinput_device_event(uidev1, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev2, EV_REL, REL_X, 1);
+	uinput_device_event(uidev2, EV_SYN, SYN_REPORT, 0);
+
+	/* devices in the hub are read by the hub only */
+	rc = libevdev_next_event(dev1, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	while ((rc = libevdev_hub_next_event(hub, &dev, &ev)) == LIBEVDEV_READ_STATUS_SUCCESS) {
+		ck_assert(dev == dev1 || dev == dev2);
+		if (ev.type == EV_REL && dev == dev1)
+			x1++;
+		else if (ev.type == EV_REL)
+			x2++;
+	}
+	ck_assert_int_eq(rc, -EAGAIN);
+	ck_assert_int_eq(x1, 1);
+	ck_assert_int_eq(x2, 1);
+
+	/* a removed device reads its fd again */
+	uinput_device_event(uidev2, EV_REL, REL_X, 1);
+	uinput_device_event(uidev2, EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libevdev_hub_remove_device(hub, dev2), 0);
+	rc = libevdev_next_event(dev2, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_REL);
+
+	ck_assert_int_eq(libevdev_hub_set_backend(hub, LIBEVDEV_HUB_BACKEND_EPOLL), 0);
+	ck_assert_int_eq(libevdev_hub_get_backend(hub), LIBEVDEV_HUB_BACKEND_EPOLL);
+
+out:
+	libevdev_hub_free(hub);
+	libevdev_free(dev1);
+	libevdev_free(dev2);
+	uinput_device_free(uidev1);
+	uinput_device_free(uidev2);
+}
+END_TEST
+
+Suite *
+libevdev_hub_test(void)
+{
+	Suite *s = suite_create("libevdev hub tests");
+
+	TCase *tc = tcase_create("hub events");
+	tcase_add_test(tc, test_hub_events);
+	tcase_add_test(tc, test_hub_next_events);
+	tcase_add_test(tc, test_hub_add_remove);
+	tcase_add_test(tc, test_hub_syn_dropped);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("hub backends");
+	tcase_add_test(tc, test_hub_io_uring);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -40,11 +40,13 @@ START_TEST(test_queue_alloc)
 	ck_assert_int_eq(rc, 0);
 
 	ck_assert_int_eq(dev.queue_size, 100);
-	ck_assert_int_eq(dev.queue_next, 0);
+	ck_assert_int_eq(dev.queue_head, 0);
+	ck_assert_int_eq(dev.queue_nelem, 0);
 
 	queue_free(&dev);
 	ck_assert_int_eq(dev.queue_size, 0);
-	ck_assert_int_eq(dev.queue_next, 0);
+	ck_assert_int_eq(dev.queue_head, 0);
+	ck_assert_int_eq(dev.queue_nelem, 0);
 
 }
 END_TEST
@@ -329,6 +331,147 @@ START_TEST(test_queue_set_num_elements)
 }
 END_TEST
 
+START_TEST(test_queue_wraparound)
+{
+	struct libevdev dev = {0};
+	struct input_event ev, *e;
+	struct input_event events[4];
+	int i, rc;
+
+	queue_alloc(&dev, 4);
+
+	/* fill and partially drain so the head moves off index 0 */
+	for (i = 0; i < 3; i++) {
+		e = queue_push(&dev);
+		ck_assert(e != NULL);
+		memset(e, i, sizeof(*e));
+	}
+
+	rc = queue_shift_multiple(&dev, 2, events);
+	ck_assert_int_eq(rc, 2);
+	ck_assert_int_eq(queue_num_elements(&dev), 1);
+	ck_assert_int_eq(queue_num_free_elements(&dev), 3);
+	ck_assert_int_eq(dev.queue_head, 2);
+
+	/* these three wrap around the end of the buffer */
+	for (i = 3; i < 6; i++) {
+		e = queue_push(&dev);
+		ck_assert(e != NULL);
+		memset(e, i, sizeof(*e));
+	}
+	ck_assert(queue_push(&dev) == NULL);
+	ck_assert(queue_next_element(&dev) == NULL);
+	ck_assert_int_eq(queue_num_elements(&dev), 4);
+	ck_assert_int_eq(queue_num_free_elements(&dev), 0);
+	ck_assert_int_eq(queue_num_free_elements_contiguous(&dev), 0);
+
+	/* peek on either side of the wrap */
+	for (i = 0; i < 4; i++) {
+		rc = queue_peek(&dev, i, &ev);
+		ck_assert_int_eq(rc, 0);
+		memset(&events[0], i + 2, sizeof(events[0]));
+		ck_assert_int_eq(memcmp(&ev, &events[0], sizeof(ev)), 0);
+	}
+	ck_assert_int_eq(queue_peek(&dev, 4, &ev), 1);
+
+	/* pop removes the last one, i.e. the one at the start of the buffer */
+	rc = queue_pop(&dev, &ev);
+	ck_assert_int_eq(rc, 0);
+	memset(&events[0], 5, sizeof(events[0]));
+	ck_assert_int_eq(memcmp(&ev, &events[0], sizeof(ev)), 0);
+	ck_assert_int_eq(queue_num_elements(&dev), 3);
+
+	/* shifting across the wrap gives the events in order */
+	rc = queue_shift_multiple(&dev, 4, events);
+	ck_assert_int_eq(rc, 3);
+	for (i = 0; i < 3; i++) {
+		memset(&ev, i + 2, sizeof(ev));
+		ck_assert_int_eq(memcmp(&ev, &events[i], sizeof(ev)), 0);
+	}
+
+	ck_assert_int_eq(queue_num_elements(&dev), 0);
+	ck_assert_int_eq(queue_shift(&dev, &ev), 1);
+
+	queue_free(&dev);
+}
+END_TEST
+
+START_TEST(test_queue_wraparound_shift)
+{
+	struct libevdev dev = {0};
+	struct input_event ev, *e;
+	int i, rc;
+
+	queue_alloc(&dev, 3);
+
+	/* push/shift well past the buffer size, the queue must keep
+	   returning events in order */
+	for (i = 0; i < 20; i++) {
+		e = queue_push(&dev);
+		ck_assert(e != NULL);
+		e->type = EV_REL;
+		e->code = REL_X;
+		e->value = i;
+
+		if (i > 0) {
+			rc = queue_shift(&dev, &ev);
+			ck_assert_int_eq(rc, 0);
+			ck_assert_int_eq(ev.value, i - 1);
+		}
+		ck_assert_int_eq(queue_num_elements(&dev), 1);
+	}
+
+	rc = queue_shift(&dev, &ev);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(ev.value, 19);
+	ck_assert_int_eq(queue_num_elements(&dev), 0);
+
+	queue_free(&dev);
+}
+END_TEST
+
+START_TEST(test_queue_wraparound_next_element)
+{
+	struct libevdev dev = {0};
+	struct input_event ev, *e;
+	int rc;
+
+	queue_alloc(&dev, 4);
+
+	e = queue_push(&dev);
+	e = queue_push(&dev);
+	e = queue_push(&dev);
+	ck_assert_int_eq(queue_num_free_elements_contiguous(&dev), 1);
+
+	queue_shift(&dev, &ev);
+	queue_shift(&dev, &ev);
+
+	/* free space is [3] and [0..1], only [3] is contiguous */
+	ck_assert_int_eq(queue_num_free_elements(&dev), 3);
+	ck_assert_int_eq(queue_num_free_elements_contiguous(&dev), 1);
+	e = queue_next_element(&dev);
+	ck_assert(e == dev.queue + 3);
+	memset(e, 0xab, sizeof(*e));
+	queue_set_num_elements(&dev, 2);
+
+	/* now the free space wrapped */
+	ck_assert_int_eq(queue_num_free_elements_contiguous(&dev), 2);
+	e = queue_next_element(&dev);
+	ck_assert(e == dev.queue);
+
+	rc = queue_peek(&dev, 1, &ev);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(memcmp(&ev, dev.queue + 3, sizeof(ev)), 0);
+
+	/* an empty queue starts at the beginning of the buffer again */
+	ck_assert_int_eq(queue_shift_multiple(&dev, 2, NULL), 2);
+	ck_assert_int_eq(dev.queue_head, 0);
+	ck_assert_int_eq(queue_num_free_elements_contiguous(&dev), 4);
+
+	queue_free(&dev);
+}
+END_TEST
+
 Suite *
 queue_suite(void)
 {
@@ -355,5 +498,11 @@ queue_suite(void)
 	tcase_add_test(tc, test_queue_set_num_elements);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("Queue wraparound");
+	tcase_add_test(tc, test_queue_wraparound);
+	tcase_add_test(tc, test_queue_wraparound_shift);
+	tcase_add_test(tc, test_queue_wraparound_next_element);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -160,6 +160,96 @@ out:
 }
 END_TEST
 
+START_TEST(test_event_mask)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event ev[8];
+	ssize_t len;
+
+	test_create_device(&uidev, &dev,
+			   EV_SYN, SYN_REPORT,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_MSC, MSC_SCAN,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_kernel_set_event_mask(dev, 1);
+	if (rc == -EINVAL) {
+		fprintf(stderr, "WARNING: skipping EVIOCSMASK test, not suported by current kernel\n");
+		goto out;
+	}
+	ck_assert_int_eq(rc, 0);
+
+	libevdev_disable_event_code(dev, EV_REL, REL_Y);
+	libevdev_disable_event_type(dev, EV_MSC);
+
+	uinput_device_event(uidev, EV_MSC, MSC_SCAN, 4);
+	uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_REL, REL_Y, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	/* read from the fd directly, the kernel must have dropped the
+	 * disabled codes */
+	len = read(libevdev_get_fd(dev), ev, sizeof(ev));
+	ck_assert_int_eq(len, 2 * sizeof(ev[0]));
+	ck_assert_int_eq(ev[0].type, EV_REL);
+	ck_assert_int_eq(ev[0].code, REL_X);
+	ck_assert_int_eq(ev[1].type, EV_SYN);
+	ck_assert_int_eq(ev[1].code, SYN_REPORT);
+
+	/* re-enabling re-sends the mask */
+	rc = libevdev_enable_event_code(dev, EV_REL, REL_Y, NULL);
+	ck_assert_int_eq(rc, 0);
+
+	uinput_device_event(uidev, EV_REL, REL_Y, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev[0]);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev[0].type, EV_REL);
+	ck_assert_int_eq(ev[0].code, REL_Y);
+
+	/* removing the mask gives us everything again */
+	rc = libevdev_kernel_set_event_mask(dev, 0);
+	ck_assert_int_eq(rc, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev[0]);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+
+	uinput_device_event(uidev, EV_MSC, MSC_SCAN, 4);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	len = read(libevdev_get_fd(dev), ev, sizeof(ev));
+	ck_assert_int_eq(len, 2 * sizeof(ev[0]));
+	ck_assert_int_eq(ev[0].type, EV_MSC);
+
+	/* the userspace filter is still in place */
+	uinput_device_event(uidev, EV_MSC, MSC_SCAN, 4);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev[0]);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev[0].type, EV_SYN);
+
+out:
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_event_mask_invalid_fd)
+{
+	struct libevdev *dev;
+	int rc;
+
+	libevdev_set_log_function(test_logfunc_ignore_error, NULL);
+
+	dev = libevdev_new();
+	rc = libevdev_kernel_set_event_mask(dev, 1);
+	ck_assert_int_eq(rc, -EBADF);
+	libevdev_free(dev);
+}
+END_TEST
+
 int main(int argc, char **argv)
 {
 	SRunner *sr;
@@ -175,6 +265,11 @@ int main(int argc, char **argv)
 	tcase_add_test(tc, test_revoke_fail_after);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("EVIOCSMASK");
+	tcase_add_test(tc, test_event_mask);
+	tcase_add_test(tc, test_event_mask_invalid_fd);
+	suite_add_tcase(s, tc);
+
 	sr = srunner_create(s);
 	srunner_run_all(sr, CK_NORMAL);
 
@@ -26,6 +26,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <time.h>
 #include <libevdev/libevdev-util.h>
 
 #include "test-common.h"
@@ -331,6 +332,99 @@ START_TEST(test_event_type_filtered)
 }
 END_TEST
 
+START_TEST(test_event_type_filtered_reenabled)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event ev;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	libevdev_disable_event_code(dev, EV_REL, REL_Y);
+	libevdev_disable_event_type(dev, EV_REL);
+	libevdev_enable_event_type(dev, EV_REL);
+
+	uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_REL, REL_Y, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_REL);
+	ck_assert_int_eq(ev.code, REL_X);
+	ck_assert_int_eq(ev.value, 1);
+
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_SYN);
+	ck_assert_int_eq(ev.code, SYN_REPORT);
+
+	libevdev_enable_event_code(dev, EV_REL, REL_Y, NULL);
+	uinput_device_event(uidev, EV_REL, REL_Y, 2);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_REL);
+	ck_assert_int_eq(ev.code, REL_Y);
+	ck_assert_int_eq(ev.value, 2);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_event_type_state_reenabled)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event ev;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	/* no state is kept for a disabled type */
+	libevdev_disable_event_type(dev, EV_KEY);
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_SYN);
+	ck_assert_int_eq(ev.code, SYN_REPORT);
+
+	libevdev_enable_event_type(dev, EV_KEY);
+	libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, NULL);
+	ck_assert_int_eq(libevdev_get_event_value(dev, EV_KEY, BTN_LEFT), 0);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 0);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert(libevdev_event_is_code(&ev, EV_KEY, BTN_LEFT));
+	ck_assert_int_eq(ev.value, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert(libevdev_event_is_code(&ev, EV_SYN, SYN_REPORT));
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert(libevdev_event_is_code(&ev, EV_KEY, BTN_LEFT));
+	ck_assert_int_eq(ev.value, 1);
+	ck_assert_int_eq(libevdev_get_event_value(dev, EV_KEY, BTN_LEFT), 1);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
 START_TEST(test_event_code_filtered)
 {
 	struct uinput_device* uidev;
@@ -344,31 +438,899 @@ START_TEST(test_event_code_filtered)
 			   EV_KEY, BTN_LEFT,
 			   -1);
 
-	libevdev_disable_event_code(dev, EV_REL, REL_X);
+	libevdev_disable_event_code(dev, EV_REL, REL_X);
+
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_REL, REL_Y, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_REL);
+	ck_assert_int_eq(ev.code, REL_Y);
+	ck_assert_int_eq(ev.value, 1);
+
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_SYN);
+	ck_assert_int_eq(ev.code, SYN_REPORT);
+
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+
+}
+END_TEST
+
+START_TEST(test_next_events)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event evs[8];
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL, evs, 0);
+	ck_assert_int_eq(rc, 0);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_REL, REL_X, 2);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev, EV_REL, REL_Y, 3);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL, evs, 2);
+	ck_assert_int_eq(rc, 2);
+	ck_assert_int_eq(evs[0].type, EV_KEY);
+	ck_assert_int_eq(evs[0].code, BTN_LEFT);
+	ck_assert_int_eq(evs[0].value, 1);
+	ck_assert_int_eq(evs[1].type, EV_REL);
+	ck_assert_int_eq(evs[1].code, REL_X);
+	ck_assert_int_eq(evs[1].value, 2);
+	ck_assert_int_eq(libevdev_get_event_value(dev, EV_KEY, BTN_LEFT), 1);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, 3);
+	ck_assert_int_eq(evs[0].type, EV_SYN);
+	ck_assert_int_eq(evs[0].code, SYN_REPORT);
+	ck_assert_int_eq(evs[1].type, EV_REL);
+	ck_assert_int_eq(evs[1].code, REL_Y);
+	ck_assert_int_eq(evs[1].value, 3);
+	ck_assert_int_eq(evs[2].type, EV_SYN);
+	ck_assert_int_eq(evs[2].code, SYN_REPORT);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_next_events_filtered)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event evs[8];
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	libevdev_disable_event_code(dev, EV_REL, REL_X);
+
+	uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_REL, REL_Y, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, 3);
+	ck_assert_int_eq(evs[0].type, EV_REL);
+	ck_assert_int_eq(evs[0].code, REL_Y);
+	ck_assert_int_eq(evs[1].type, EV_SYN);
+	ck_assert_int_eq(evs[1].code, SYN_REPORT);
+	ck_assert_int_eq(evs[2].type, EV_SYN);
+	ck_assert_int_eq(evs[2].code, SYN_REPORT);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_next_events_syn_dropped)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event ev, evs[8];
+	int pipefd[2];
+
+	test_create_device(&uidev, &dev,
+			   EV_SYN, SYN_REPORT,
+			   EV_SYN, SYN_DROPPED,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	/* see test_syn_dropped_event, the SYN_DROPPED comes through a pipe */
+	rc = pipe2(pipefd, O_NONBLOCK);
+	ck_assert_int_eq(rc, 0);
+
+	libevdev_change_fd(dev, pipefd[0]);
+	ev.type = EV_REL;
+	ev.code = REL_X;
+	ev.value = 1;
+	rc = write(pipefd[1], &ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+	ev.type = EV_SYN;
+	ev.code = SYN_DROPPED;
+	ev.value = 0;
+	rc = write(pipefd[1], &ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+	ev.type = EV_REL;
+	ev.code = REL_X;
+	ev.value = 2;
+	rc = write(pipefd[1], &ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+
+	/* the batch stops at the SYN_DROPPED */
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL, evs, ARRAY_LENGTH(evs));
+	libevdev_change_fd(dev, uinput_device_get_fd(uidev));
+
+	ck_assert_int_eq(rc, 2);
+	ck_assert_int_eq(evs[0].type, EV_REL);
+	ck_assert_int_eq(evs[0].code, REL_X);
+	ck_assert_int_eq(evs[1].type, EV_SYN);
+	ck_assert_int_eq(evs[1].code, SYN_DROPPED);
+
+	/* nothing changed on the device, so the sync is empty */
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_SYNC, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+}
+END_TEST
+
+START_TEST(test_next_events_sync)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event evs[8];
+
+	test_create_device(&uidev, &dev,
+			   EV_SYN, SYN_REPORT,
+			   EV_KEY, BTN_LEFT,
+			   EV_KEY, BTN_MIDDLE,
+			   EV_KEY, BTN_RIGHT,
+			   -1);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_KEY, BTN_RIGHT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_FORCE_SYNC, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, 0);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_SYNC, evs, 2);
+	ck_assert_int_eq(rc, 2);
+	ck_assert_int_eq(evs[0].type, EV_KEY);
+	ck_assert_int_eq(evs[0].code, BTN_LEFT);
+	ck_assert_int_eq(evs[0].value, 1);
+	ck_assert_int_eq(evs[1].type, EV_KEY);
+	ck_assert_int_eq(evs[1].code, BTN_RIGHT);
+	ck_assert_int_eq(evs[1].value, 1);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_SYNC, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, 1);
+	ck_assert_int_eq(evs[0].type, EV_SYN);
+	ck_assert_int_eq(evs[0].code, SYN_REPORT);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_SYNC, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	ck_assert_int_eq(libevdev_get_event_value(dev, EV_KEY, BTN_LEFT), 1);
+	ck_assert_int_eq(libevdev_get_event_value(dev, EV_KEY, BTN_RIGHT), 1);
+
+	rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL, evs, ARRAY_LENGTH(evs));
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_next_frame)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	const struct input_event *evs;
+	size_t nevs;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, -EAGAIN);
+	ck_assert(evs == NULL);
+	ck_assert_int_eq(nevs, 0);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_REL, REL_X, 2);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev, EV_REL, REL_Y, 3);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(nevs, 3);
+	ck_assert_int_eq(evs[0].type, EV_KEY);
+	ck_assert_int_eq(evs[0].code, BTN_LEFT);
+	ck_assert_int_eq(evs[1].type, EV_REL);
+	ck_assert_int_eq(evs[1].code, REL_X);
+	ck_assert_int_eq(evs[2].type, EV_SYN);
+	ck_assert_int_eq(evs[2].code, SYN_REPORT);
+
+	ck_assert(libevdev_frame_has_event_type(dev, EV_KEY));
+	ck_assert(libevdev_frame_has_event_type(dev, EV_REL));
+	ck_assert(!libevdev_frame_has_event_type(dev, EV_ABS));
+	ck_assert(libevdev_frame_has_event_code(dev, EV_KEY, BTN_LEFT));
+	ck_assert(libevdev_frame_has_event_code(dev, EV_REL, REL_X));
+	ck_assert(!libevdev_frame_has_event_code(dev, EV_REL, REL_Y));
+	ck_assert(!libevdev_frame_has_slot(dev, 0));
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(nevs, 2);
+	ck_assert_int_eq(evs[0].type, EV_REL);
+	ck_assert_int_eq(evs[0].code, REL_Y);
+	ck_assert_int_eq(evs[1].type, EV_SYN);
+	ck_assert_int_eq(evs[1].code, SYN_REPORT);
+
+	ck_assert(!libevdev_frame_has_event_type(dev, EV_KEY));
+	ck_assert(!libevdev_frame_has_event_code(dev, EV_REL, REL_X));
+	ck_assert(libevdev_frame_has_event_code(dev, EV_REL, REL_Y));
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_next_frame_incomplete)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event ev;
+	const struct input_event *evs;
+	size_t nevs;
+	int pipefd[2];
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   -1);
+
+	/* use a pipe so we control where the frame is split */
+	rc = pipe2(pipefd, O_NONBLOCK);
+	ck_assert_int_eq(rc, 0);
+	libevdev_change_fd(dev, pipefd[0]);
+
+	ev.type = EV_REL;
+	ev.code = REL_X;
+	ev.value = 1;
+	rc = write(pipefd[1], &ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	ev.type = EV_REL;
+	ev.code = REL_Y;
+	ev.value = 2;
+	rc = write(pipefd[1], &ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+	ev.type = EV_SYN;
+	ev.code = SYN_REPORT;
+	ev.value = 0;
+	rc = write(pipefd[1], &ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(nevs, 3);
+	ck_assert_int_eq(evs[0].code, REL_X);
+	ck_assert_int_eq(evs[1].code, REL_Y);
+	ck_assert_int_eq(evs[2].code, SYN_REPORT);
+	ck_assert(libevdev_frame_has_event_code(dev, EV_REL, REL_X));
+	ck_assert(libevdev_frame_has_event_code(dev, EV_REL, REL_Y));
+
+	libevdev_change_fd(dev, uinput_device_get_fd(uidev));
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+}
+END_TEST
+
+START_TEST(test_next_frame_mt)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	const struct input_event *evs;
+	size_t nevs;
+	struct input_absinfo abs[5];
+
+	memset(abs, 0, sizeof(abs));
+	abs[0].value = ABS_X;
+	abs[0].maximum = 1000;
+	abs[1].value = ABS_MT_POSITION_X;
+	abs[1].maximum = 1000;
+	abs[2].value = ABS_Y;
+	abs[2].maximum = 1000;
+	abs[3].value = ABS_MT_POSITION_Y;
+	abs[3].maximum = 1000;
+	abs[4].value = ABS_MT_SLOT;
+	abs[4].maximum = 2;
+
+	test_create_abs_device(&uidev, &dev,
+			       5, abs,
+			       EV_SYN, SYN_REPORT,
+			       -1);
+
+	uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, 0);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_X, 100);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, 2);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_Y, 5);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(evs[nevs - 1].type, EV_SYN);
+	ck_assert_int_eq(evs[nevs - 1].code, SYN_REPORT);
+
+	ck_assert(libevdev_frame_has_event_type(dev, EV_ABS));
+	ck_assert(libevdev_frame_has_event_code(dev, EV_ABS, ABS_MT_POSITION_X));
+	ck_assert(libevdev_frame_has_event_code(dev, EV_ABS, ABS_MT_POSITION_Y));
+	ck_assert(!libevdev_frame_has_event_code(dev, EV_ABS, ABS_X));
+	ck_assert(libevdev_frame_has_slot(dev, 0));
+	ck_assert(!libevdev_frame_has_slot(dev, 1));
+	ck_assert(libevdev_frame_has_slot(dev, 2));
+	ck_assert(!libevdev_frame_has_slot(dev, 3));
+
+	/* a slot switch on its own is not a change */
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert(libevdev_frame_has_event_code(dev, EV_ABS, ABS_MT_SLOT));
+	ck_assert(!libevdev_frame_has_slot(dev, 0));
+	ck_assert(!libevdev_frame_has_slot(dev, 1));
+	ck_assert(!libevdev_frame_has_slot(dev, 2));
+	ck_assert_int_eq(libevdev_get_current_slot(dev), 1);
+
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_next_frame_sync)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	const struct input_event *evs;
+	size_t nevs;
+
+	test_create_device(&uidev, &dev,
+			   EV_SYN, SYN_REPORT,
+			   EV_KEY, BTN_LEFT,
+			   EV_KEY, BTN_RIGHT,
+			   -1);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_FORCE_SYNC, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SYNC);
+	ck_assert_int_eq(nevs, 0);
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_SYNC, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SYNC);
+	ck_assert_int_eq(nevs, 2);
+	ck_assert_int_eq(evs[0].type, EV_KEY);
+	ck_assert_int_eq(evs[0].code, BTN_LEFT);
+	ck_assert_int_eq(evs[0].value, 1);
+	ck_assert_int_eq(evs[1].type, EV_SYN);
+	ck_assert_int_eq(evs[1].code, SYN_REPORT);
+	ck_assert(libevdev_frame_has_event_code(dev, EV_KEY, BTN_LEFT));
+	ck_assert(!libevdev_frame_has_event_code(dev, EV_KEY, BTN_RIGHT));
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_SYNC, &evs, &nevs);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	rc = libevdev_next_frame(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+START_TEST(test_next_event_deadline)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event ev;
+	uint64_t start;
+
+	test_create_device(&uidev, &dev,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_next_event_deadline(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev, 0);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	start = now_ns();
+	rc = libevdev_next_event_deadline(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev,
+					  start + 20000000);
+	ck_assert_int_eq(rc, -EAGAIN);
+	ck_assert_int_ge(now_ns() - start, 20000000);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_next_event_deadline(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev,
+					  UINT64_MAX);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_KEY);
+	ck_assert_int_eq(ev.code, BTN_LEFT);
+
+	/* nothing to wait for in sync mode */
+	rc = libevdev_next_event_deadline(dev, LIBEVDEV_READ_FLAG_SYNC, &ev,
+					  UINT64_MAX);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_next_frame_deadline)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event ev;
+	const struct input_event *evs;
+	size_t nevs;
+	int pipefd[2];
+	uint64_t start;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   -1);
+
+	rc = pipe2(pipefd, O_NONBLOCK);
+	ck_assert_int_eq(rc, 0);
+	libevdev_change_fd(dev, pipefd[0]);
+
+	ev.type = EV_REL;
+	ev.code = REL_X;
+	ev.value = 1;
+	rc = write(pipefd[1], &ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+
+	/* the incomplete frame times out and is kept */
+	start = now_ns();
+	rc = libevdev_next_frame_deadline(dev, LIBEVDEV_READ_FLAG_NORMAL,
+					  &evs, &nevs, start + 20000000);
+	ck_assert_int_eq(rc, -EAGAIN);
+	ck_assert_int_ge(now_ns() - start, 20000000);
+
+	ev.type = EV_SYN;
+	ev.code = SYN_REPORT;
+	ev.value = 0;
+	rc = write(pipefd[1], &ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+
+	rc = libevdev_next_frame_deadline(dev, LIBEVDEV_READ_FLAG_NORMAL,
+					  &evs, &nevs, UINT64_MAX);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(nevs, 2);
+	ck_assert_int_eq(evs[0].code, REL_X);
+	ck_assert_int_eq(evs[1].code, SYN_REPORT);
+
+	libevdev_change_fd(dev, uinput_device_get_fd(uidev));
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+}
+END_TEST
+
+START_TEST(test_peek_events)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	const struct input_event *evs;
+	size_t nevs, nevs2;
+	struct input_event ev;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_peek_events(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev, EV_REL, REL_X, 2);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_peek_events(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(nevs, 4);
+	ck_assert_int_eq(evs[0].type, EV_KEY);
+	ck_assert_int_eq(evs[0].code, BTN_LEFT);
+	ck_assert_int_eq(evs[0].value, 1);
+	ck_assert_int_eq(evs[2].type, EV_REL);
+	ck_assert_int_eq(evs[2].code, REL_X);
+	ck_assert_int_eq(libevdev_get_event_value(dev, EV_KEY, BTN_LEFT), 1);
+
+	/* peeking again returns the same events */
+	rc = libevdev_peek_events(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs2);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(nevs2, 4);
+
+	ck_assert_int_eq(libevdev_advance_events(dev, 2), 0);
+
+	/* already peeked events are not processed twice */
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_REL);
+	ck_assert_int_eq(ev.code, REL_X);
+	ck_assert_int_eq(ev.value, 2);
+
+	rc = libevdev_peek_events(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(nevs, 1);
+	ck_assert_int_eq(evs[0].type, EV_SYN);
+	ck_assert_int_eq(libevdev_advance_events(dev, 1), 0);
+
+	rc = libevdev_peek_events(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_set_log_function(test_logfunc_ignore_error, NULL);
+	rc = libevdev_advance_events(dev, 1);
+	ck_assert_int_eq(rc, -EINVAL);
+	libevdev_set_log_function(test_logfunc_abort_on_error, NULL);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_peek_events_filtered)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	const struct input_event *evs;
+	size_t nevs;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   -1);
+
+	libevdev_disable_event_code(dev, EV_REL, REL_Y);
+
+	uinput_device_event(uidev, EV_REL, REL_Y, 1);
+	uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_REL, REL_Y, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	rc = libevdev_peek_events(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(nevs, 1);
+	ck_assert_int_eq(evs[0].type, EV_REL);
+	ck_assert_int_eq(evs[0].code, REL_X);
+	ck_assert_int_eq(libevdev_advance_events(dev, 1), 0);
+
+	rc = libevdev_peek_events(dev, LIBEVDEV_READ_FLAG_NORMAL, &evs, &nevs);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(nevs, 1);
+	ck_assert_int_eq(evs[0].type, EV_SYN);
+	ck_assert_int_eq(evs[0].code, SYN_REPORT);
+	ck_assert_int_eq(libevdev_advance_events(dev, 1), 0);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_stats)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event ev;
+	uint64_t value;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_get_stat(dev, LIBEVDEV_STAT_EVENTS_READ, &value);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(value, 0);
+
+	uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_REL, REL_Y, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	do {
+		rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	} while (rc == LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_get_stat(dev, LIBEVDEV_STAT_EVENTS_READ, &value);
+	ck_assert_int_eq(value, 3);
+	libevdev_get_stat(dev, LIBEVDEV_STAT_BYTES_READ, &value);
+	ck_assert_int_eq(value, 3 * sizeof(ev));
+	libevdev_get_stat(dev, LIBEVDEV_STAT_READ_CALLS, &value);
+	ck_assert_int_ge(value, 1);
+	libevdev_get_stat(dev, LIBEVDEV_STAT_QUEUE_HIGH_WATER, &value);
+	ck_assert_int_eq(value, 3);
+	libevdev_get_stat(dev, LIBEVDEV_STAT_QUEUE_SIZE, &value);
+	ck_assert_int_ge(value, 3);
+	libevdev_get_stat(dev, LIBEVDEV_STAT_SYN_DROPPED, &value);
+	ck_assert_int_eq(value, 0);
+
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_FORCE_SYNC, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SYNC);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_SYNC, &ev);
+	ck_assert_int_eq(rc, -EAGAIN);
+	libevdev_get_stat(dev, LIBEVDEV_STAT_SYNCS, &value);
+	ck_assert_int_eq(value, 1);
+
+	rc = libevdev_get_stat(dev, LIBEVDEV_STAT_EVENTS_COALESCED + 1, &value);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_coalesce_rel)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	int i;
+	struct input_event ev;
+	int x = 0, y = 0;
+	int nevents = 0, nframes = 0;
+	bool key_seen = false;
+	uint64_t coalesced, read;
+	const unsigned int flags = LIBEVDEV_READ_FLAG_NORMAL |
+				   LIBEVDEV_READ_FLAG_COALESCE_REL;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+	ck_assert_int_eq(libevdev_set_queue_size(dev, 16), 0);
+
+	for (i = 0; i < 10; i++) {
+		uinput_device_event(uidev, EV_REL, REL_X, 1);
+		uinput_device_event(uidev, EV_REL, REL_Y, 2);
+		uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	}
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	for (i = 0; i < 5; i++) {
+		uinput_device_event(uidev, EV_REL, REL_X, 1);
+		uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	}
 
-	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	while ((rc = libevdev_next_event(dev, flags, &ev)) == LIBEVDEV_READ_STATUS_SUCCESS) {
+		nevents++;
+		if (ev.type == EV_REL && ev.code == REL_X)
+			x += ev.value;
+		else if (ev.type == EV_REL && ev.code == REL_Y)
+			y += ev.value;
+		else if (ev.type == EV_SYN)
+			nframes++;
+		else if (ev.type == EV_KEY) {
+			/* motion is never merged across the button press */
+			ck_assert_int_eq(x, 10);
+			ck_assert_int_eq(y, 20);
+			key_seen = true;
+		}
+	}
 	ck_assert_int_eq(rc, -EAGAIN);
+	ck_assert(key_seen);
+	ck_assert_int_eq(x, 15);
+	ck_assert_int_eq(y, 20);
+	ck_assert_int_lt(nframes, 16);
+
+	libevdev_get_stat(dev, LIBEVDEV_STAT_EVENTS_READ, &read);
+	libevdev_get_stat(dev, LIBEVDEV_STAT_EVENTS_COALESCED, &coalesced);
+	ck_assert_int_eq(read, 42);
+	ck_assert_int_gt(coalesced, 0);
+	ck_assert_int_eq(nevents + coalesced, read);
+
+	/* without the flag, nothing is merged */
+	for (i = 0; i < 10; i++) {
+		uinput_device_event(uidev, EV_REL, REL_X, 1);
+		uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	}
 
-	uinput_device_event(uidev, EV_REL, REL_X, 1);
-	uinput_device_event(uidev, EV_REL, REL_Y, 1);
-	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
-	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
-	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
-	ck_assert_int_eq(ev.type, EV_REL);
-	ck_assert_int_eq(ev.code, REL_Y);
-	ck_assert_int_eq(ev.value, 1);
+	nframes = 0;
+	while (libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev) == LIBEVDEV_READ_STATUS_SUCCESS)
+		if (ev.type == EV_SYN)
+			nframes++;
+	ck_assert_int_eq(nframes, 10);
 
-	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_coalesce_rel_blocking)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int fd, flags;
+	int rc;
+	int i;
+	struct input_event ev;
+	int x = 0;
+	const unsigned int read_flags = LIBEVDEV_READ_FLAG_NORMAL |
+					LIBEVDEV_READ_FLAG_BLOCKING |
+					LIBEVDEV_READ_FLAG_COALESCE_REL;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   -1);
+	ck_assert_int_eq(libevdev_set_queue_size(dev, 16), 0);
+
+	fd = libevdev_get_fd(dev);
+	flags = fcntl(fd, F_GETFL) & ~O_NONBLOCK;
+	rc = fcntl(fd, F_SETFL, flags);
+	ck_assert_int_eq(rc, 0);
+
+	/* exactly one queue full: after coalescing, there is nothing left
+	   to read and a refill would block */
+	for (i = 0; i < 8; i++) {
+		uinput_device_event(uidev, EV_REL, REL_X, 1);
+		uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	}
+
+	while (x < 8) {
+		rc = libevdev_next_event(dev, read_flags, &ev);
+		ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+		if (ev.type == EV_REL)
+			x += ev.value;
+	}
+	rc = libevdev_next_event(dev, read_flags, &ev);
 	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
 	ck_assert_int_eq(ev.type, EV_SYN);
-	ck_assert_int_eq(ev.code, SYN_REPORT);
+	ck_assert_int_eq(libevdev_has_event_pending(dev), 0);
 
-	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	libevdev_free(dev);
+	uinput_device_free(uidev);
+}
+END_TEST
+
+START_TEST(test_latency_histogram)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	int i, nbuckets;
+	struct input_event ev;
+	uint64_t buckets[64];
+	uint64_t total = 0;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	nbuckets = libevdev_get_latency_histogram(dev, NULL, 0);
+	ck_assert_int_gt(nbuckets, 0);
+	ck_assert_int_le(nbuckets, 64);
+
+	ck_assert_int_eq(libevdev_set_latency_histogram(dev, 1), 0);
+
+	for (i = 0; i < 3; i++) {
+		uinput_device_event(uidev, EV_REL, REL_X, 1);
+		uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	}
+
+	do {
+		rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+		if (rc == LIBEVDEV_READ_STATUS_SUCCESS)
+			ck_assert_int_eq(libevdev_get_last_event_time_ns(dev),
+					 libevdev_event_get_time_ns(&ev));
+	} while (rc == LIBEVDEV_READ_STATUS_SUCCESS);
 	ck_assert_int_eq(rc, -EAGAIN);
 
+	ck_assert_int_eq(libevdev_get_latency_histogram(dev, buckets, 64), nbuckets);
+	for (i = 0; i < nbuckets; i++)
+		total += buckets[i];
+	ck_assert_int_eq(total, 3);
+
+	/* disabling resets the histogram */
+	libevdev_set_latency_histogram(dev, 0);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	libevdev_get_latency_histogram(dev, buckets, 64);
+	for (i = 0; i < nbuckets; i++)
+		ck_assert_int_eq(buckets[i], 0);
+
 	libevdev_free(dev);
 	uinput_device_free(uidev);
-
 }
 END_TEST
 
@@ -1607,6 +2569,68 @@ START_TEST(test_mt_event_values)
 }
 END_TEST
 
+START_TEST(test_mt_slot_changes)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+	struct input_event ev;
+	struct input_absinfo abs[3];
+	struct libevdev_slot_change changes[3];
+
+	memset(abs, 0, sizeof(abs));
+	abs[0].value = ABS_MT_POSITION_X;
+	abs[0].maximum = 1000;
+	abs[1].value = ABS_MT_POSITION_Y;
+	abs[1].maximum = 1000;
+	abs[2].value = ABS_MT_SLOT;
+	abs[2].maximum = 2;
+
+	test_create_abs_device(&uidev, &dev,
+			       3, abs,
+			       EV_SYN, SYN_REPORT,
+			       -1);
+
+	ck_assert_int_eq(libevdev_get_slot_changes(dev, changes, 3), 0);
+
+	uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, 0);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_X, 100);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_Y, 500);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, 2);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_Y, 5);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	do {
+		rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+		ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	} while (ev.type != EV_SYN);
+
+	ck_assert_int_eq(libevdev_get_slot_changes(dev, changes, 3), 2);
+	ck_assert_int_eq(changes[0].slot, 0);
+	ck_assert_int_eq(changes[0].axes,
+			 (1 << (ABS_MT_POSITION_X - ABS_MT_SLOT)) |
+			 (1 << (ABS_MT_POSITION_Y - ABS_MT_SLOT)));
+	ck_assert_int_eq(changes[1].slot, 2);
+	ck_assert_int_eq(changes[1].axes, 1 << (ABS_MT_POSITION_Y - ABS_MT_SLOT));
+
+	/* only as many as fit */
+	ck_assert_int_eq(libevdev_get_slot_changes(dev, changes, 1), 1);
+	ck_assert_int_eq(changes[0].slot, 0);
+
+	/* switching the slot is not a change, but updates the values */
+	uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, 0);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(libevdev_get_slot_changes(dev, changes, 3), 0);
+	ck_assert_int_eq(libevdev_get_event_value(dev, EV_ABS, ABS_MT_POSITION_Y), 500);
+	ck_assert_int_eq(libevdev_get_abs_info(dev, ABS_MT_POSITION_X)->value, 100);
+
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
 START_TEST(test_mt_event_values_invalid)
 {
 	struct uinput_device* uidev;
@@ -1724,6 +2748,108 @@ START_TEST(test_mt_slot_ranges_invalid)
 }
 END_TEST
 
+struct log_msgs {
+	unsigned int count;
+	unsigned int suppressed;
+	enum libevdev_log_msg_id last;
+};
+
+static void
+log_msg_func(const struct libevdev *dev,
+	     enum libevdev_log_priority priority,
+	     void *data,
+	     enum libevdev_log_msg_id id,
+	     const int *args,
+	     unsigned int nargs)
+{
+	struct log_msgs *msgs = data;
+
+	if (id == LIBEVDEV_LOG_MSG_SUPPRESSED) {
+		ck_assert_int_eq(nargs, 2);
+		ck_assert_int_eq(args[1], LIBEVDEV_LOG_MSG_INVALID_SLOT);
+		msgs->suppressed += args[0];
+	} else {
+		ck_assert_int_eq(id, LIBEVDEV_LOG_MSG_INVALID_SLOT);
+		ck_assert_int_eq(priority, LIBEVDEV_LOG_ERROR);
+		ck_assert_int_eq(nargs, 2);
+		ck_assert_int_eq(args[0], 5);
+		ck_assert_int_eq(args[1], 1);
+		msgs->count++;
+	}
+	msgs->last = id;
+}
+
+START_TEST(test_mt_slot_log_ratelimit)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc, i;
+	struct input_event ev[2];
+	struct input_absinfo abs[2];
+	int pipefd[2];
+	struct log_msgs msgs = {0};
+
+	memset(abs, 0, sizeof(abs));
+	abs[0].value = ABS_MT_POSITION_X;
+	abs[0].maximum = 1000;
+	abs[1].value = ABS_MT_SLOT;
+	abs[1].maximum = 1;
+
+	test_create_abs_device(&uidev, &dev,
+			       2, abs,
+			       EV_SYN, SYN_REPORT,
+			       -1);
+
+	rc = pipe2(pipefd, O_NONBLOCK);
+	ck_assert_int_eq(rc, 0);
+	libevdev_change_fd(dev, pipefd[0]);
+
+	libevdev_set_device_log_msg_function(dev, log_msg_func,
+					     LIBEVDEV_LOG_ERROR, &msgs);
+	libevdev_set_device_log_ratelimit(dev, 3, 50);
+
+	memset(ev, 0, sizeof(ev));
+	ev[0].type = EV_ABS;
+	ev[0].code = ABS_MT_SLOT;
+	ev[0].value = 5;
+	ev[1].type = EV_SYN;
+	ev[1].code = SYN_REPORT;
+	ev[1].value = 0;
+
+	for (i = 0; i < 20; i++) {
+		rc = write(pipefd[1], ev, sizeof(ev));
+		ck_assert_int_eq(rc, sizeof(ev));
+		rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev[0]);
+		ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+		libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev[0]);
+		ev[0].type = EV_ABS;
+		ev[0].code = ABS_MT_SLOT;
+		ev[0].value = 5;
+	}
+
+	ck_assert_int_eq(msgs.count, 3);
+	ck_assert_int_eq(msgs.suppressed, 0);
+
+	/* the next interval reports the suppressed messages first */
+	usleep(60000);
+	rc = write(pipefd[1], ev, sizeof(ev));
+	ck_assert_int_eq(rc, sizeof(ev));
+	libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev[0]);
+
+	ck_assert_int_eq(msgs.count, 4);
+	ck_assert_int_eq(msgs.suppressed, 17);
+	ck_assert_int_eq(msgs.last, LIBEVDEV_LOG_MSG_INVALID_SLOT);
+
+	libevdev_change_fd(dev, uinput_device_get_fd(uidev));
+
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+}
+END_TEST
+
 START_TEST(test_mt_tracking_id_discard)
 {
 	struct uinput_device* uidev;
@@ -2140,6 +3266,94 @@ START_TEST(test_event_mt_value_setters_current_slot)
 }
 END_TEST
 
+static void
+assert_event(const struct input_event *ev, unsigned int type,
+	     unsigned int code, int value)
+{
+	ck_assert_int_eq(ev->type, type);
+	ck_assert_int_eq(ev->code, code);
+	ck_assert_int_eq(ev->value, value);
+}
+
+START_TEST(test_state_diff)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	struct libevdev_state *before, *after;
+	struct input_event ev, events[16];
+	struct input_absinfo abs[4];
+	int rc;
+
+	memset(abs, 0, sizeof(abs));
+	abs[0].value = ABS_X;
+	abs[0].maximum = 1000;
+	abs[1].value = ABS_MT_POSITION_X;
+	abs[1].maximum = 1000;
+	abs[2].value = ABS_MT_SLOT;
+	abs[2].maximum = 1;
+	abs[3].value = ABS_MT_TRACKING_ID;
+	abs[3].minimum = -1;
+	abs[3].maximum = 2;
+
+	test_create_abs_device(&uidev, &dev,
+			       4, abs,
+			       EV_SYN, SYN_REPORT,
+			       EV_KEY, BTN_LEFT,
+			       -1);
+
+	rc = libevdev_state_new(dev, &before);
+	ck_assert_int_eq(rc, 0);
+	rc = libevdev_state_new(dev, &after);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(libevdev_state_diff(before, after, NULL, 0), 0);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_ABS, ABS_X, 100);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, 1);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_X, 100);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_TRACKING_ID, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	do {
+		rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	} while (rc == LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	rc = libevdev_state_capture(dev, after);
+	ck_assert_int_eq(rc, 0);
+
+	rc = libevdev_state_diff(before, after, events, 16);
+	ck_assert_int_eq(rc, 6);
+	assert_event(&events[0], EV_KEY, BTN_LEFT, 1);
+	assert_event(&events[1], EV_ABS, ABS_X, 100);
+	assert_event(&events[2], EV_ABS, ABS_MT_SLOT, 1);
+	assert_event(&events[3], EV_ABS, ABS_MT_POSITION_X, 100);
+	assert_event(&events[4], EV_ABS, ABS_MT_TRACKING_ID, 1);
+	assert_event(&events[5], EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(events[0].time.tv_sec, ev.time.tv_sec);
+	ck_assert_int_eq(events[0].time.tv_usec, ev.time.tv_usec);
+
+	/* only the first events fit, the count is still the total */
+	rc = libevdev_state_diff(before, after, events, 2);
+	ck_assert_int_eq(rc, 6);
+
+	rc = libevdev_state_diff(after, before, events, 16);
+	ck_assert_int_eq(rc, 7);
+	assert_event(&events[0], EV_KEY, BTN_LEFT, 0);
+	assert_event(&events[1], EV_ABS, ABS_X, 0);
+	assert_event(&events[2], EV_ABS, ABS_MT_SLOT, 1);
+	assert_event(&events[3], EV_ABS, ABS_MT_POSITION_X, 0);
+	assert_event(&events[4], EV_ABS, ABS_MT_TRACKING_ID, -1);
+	assert_event(&events[5], EV_ABS, ABS_MT_SLOT, 0);
+	assert_event(&events[6], EV_SYN, SYN_REPORT, 0);
+
+	libevdev_state_free(before);
+	libevdev_state_free(after);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
 Suite *
 libevdev_events(void)
 {
@@ -2153,10 +3367,46 @@ libevdev_events(void)
 	tcase_add_test(tc, test_double_syn_dropped_event);
 	tcase_add_test(tc, test_event_type_filtered);
 	tcase_add_test(tc, test_event_code_filtered);
+	tcase_add_test(tc, test_event_type_filtered_reenabled);
+	tcase_add_test(tc, test_event_type_state_reenabled);
 	tcase_add_test(tc, test_has_event_pending);
 	tcase_add_test(tc, test_has_event_pending_invalid_fd);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("event batches");
+	tcase_add_test(tc, test_next_events);
+	tcase_add_test(tc, test_next_events_filtered);
+	tcase_add_test(tc, test_next_events_syn_dropped);
+	tcase_add_test(tc, test_next_events_sync);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("event frames");
+	tcase_add_test(tc, test_next_frame);
+	tcase_add_test(tc, test_next_frame_incomplete);
+	tcase_add_test(tc, test_next_frame_mt);
+	tcase_add_test(tc, test_next_frame_sync);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("event deadlines");
+	tcase_add_test(tc, test_next_event_deadline);
+	tcase_add_test(tc, test_next_frame_deadline);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("event peeking");
+	tcase_add_test(tc, test_peek_events);
+	tcase_add_test(tc, test_peek_events_filtered);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("event statistics");
+	tcase_add_test(tc, test_stats);
+	tcase_add_test(tc, test_latency_histogram);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("event coalescing");
+	tcase_add_test(tc, test_coalesce_rel);
+	tcase_add_test(tc, test_coalesce_rel_blocking);
+	suite_add_tcase(s, tc);
+
 	tc = tcase_create("SYN_DROPPED deltas");
 	tcase_add_test(tc, test_syn_delta_button);
 	tcase_add_test(tc, test_syn_delta_abs);
@@ -2180,7 +3430,9 @@ libevdev_events(void)
 	tcase_add_test(tc, test_event_values_invalid);
 	tcase_add_test(tc, test_mt_event_values);
 	tcase_add_test(tc, test_mt_event_values_invalid);
+	tcase_add_test(tc, test_mt_slot_changes);
 	tcase_add_test(tc, test_mt_slot_ranges_invalid);
+	tcase_add_test(tc, test_mt_slot_log_ratelimit);
 	tcase_add_test(tc, test_mt_tracking_id_discard);
 	tcase_add_test(tc, test_mt_tracking_id_discard_neg_1);
 	tcase_add_test(tc, test_ev_rep_values);
@@ -2194,5 +3446,9 @@ libevdev_events(void)
 	tcase_add_test(tc, test_event_mt_value_setters_current_slot);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("state snapshots");
+	tcase_add_test(tc, test_state_diff);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
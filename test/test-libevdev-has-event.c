@@ -184,6 +184,48 @@ START_TEST(test_event_code_limits)
 }
 END_TEST
 
+START_TEST(test_event_code_iteration)
+{
+	struct libevdev *dev;
+	const int keys[] = { KEY_ESC, KEY_A, BTN_LEFT, BTN_TOUCH, KEY_MAX };
+	unsigned int i;
+	int code;
+
+	dev = libevdev_new();
+	ck_assert_int_eq(libevdev_get_next_event_code(dev, EV_KEY, 0), -1);
+	ck_assert_int_eq(libevdev_get_num_event_codes(dev, EV_KEY), 0);
+	ck_assert_int_eq(libevdev_get_num_event_codes(dev, EV_SYN), SYN_CNT);
+	ck_assert_int_eq(libevdev_get_next_event_code(dev, EV_SYN, SYN_DROPPED), SYN_DROPPED);
+	ck_assert_int_eq(libevdev_get_next_event_code(dev, EV_PWR, 0), -1);
+	ck_assert_int_eq(libevdev_get_num_event_codes(dev, EV_MAX + 1), 0);
+
+	for (i = 0; i < sizeof(keys)/sizeof(keys[0]); i++)
+		libevdev_enable_event_code(dev, EV_KEY, keys[i], NULL);
+
+	i = 0;
+	for (code = libevdev_get_next_event_code(dev, EV_KEY, 0);
+	     code != -1;
+	     code = libevdev_get_next_event_code(dev, EV_KEY, code + 1)) {
+		ck_assert_int_lt(i, sizeof(keys)/sizeof(keys[0]));
+		ck_assert_int_eq(code, keys[i]);
+		i++;
+	}
+	ck_assert_int_eq(i, sizeof(keys)/sizeof(keys[0]));
+	ck_assert_int_eq(libevdev_get_num_event_codes(dev, EV_KEY), i);
+
+	ck_assert_int_eq(libevdev_get_next_event_code(dev, EV_KEY, KEY_A), KEY_A);
+	ck_assert_int_eq(libevdev_get_next_event_code(dev, EV_KEY, KEY_A + 1), BTN_LEFT);
+	ck_assert_int_eq(libevdev_get_next_event_code(dev, EV_KEY, KEY_MAX + 1), -1);
+	ck_assert_int_eq(libevdev_get_next_event_code(dev, EV_KEY, UINT_MAX), -1);
+
+	libevdev_disable_event_type(dev, EV_KEY);
+	ck_assert_int_eq(libevdev_get_next_event_code(dev, EV_KEY, 0), -1);
+	ck_assert_int_eq(libevdev_get_num_event_codes(dev, EV_KEY), 0);
+
+	libevdev_free(dev);
+}
+END_TEST
+
 START_TEST(test_ev_rep)
 {
 	struct libevdev *dev;
@@ -1155,6 +1197,7 @@ libevdev_has_event_test(void)
 	tc = tcase_create("event codes");
 	tcase_add_test(tc, test_event_codes);
 	tcase_add_test(tc, test_event_code_limits);
+	tcase_add_test(tc, test_event_code_iteration);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("ev_rep");
@@ -23,6 +23,7 @@
 #include <config.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <time.h>
 #include <sys/types.h>
@@ -484,14 +485,18 @@ START_TEST(test_set_clock_id)
 			   EV_KEY, BTN_RIGHT,
 			   -1);
 
+	ck_assert_int_eq(libevdev_get_clock_id(dev), CLOCK_REALTIME);
+
 	rc = libevdev_set_clock_id(dev, CLOCK_REALTIME);
 	ck_assert_int_eq(rc, 0);
 
 	rc = libevdev_set_clock_id(dev, CLOCK_MONOTONIC);
 	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(libevdev_get_clock_id(dev), CLOCK_MONOTONIC);
 
 	rc = libevdev_set_clock_id(dev, CLOCK_MONOTONIC_RAW);
 	ck_assert_int_eq(rc, -EINVAL);
+	ck_assert_int_eq(libevdev_get_clock_id(dev), CLOCK_MONOTONIC);
 
 	uinput_device_free(uidev);
 	libevdev_free(dev);
@@ -596,6 +601,293 @@ START_TEST(test_clock_id_events)
 }
 END_TEST
 
+START_TEST(test_queue_size)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev;
+	int rc;
+
+	rc = uinput_device_new_with_events(&uidev,
+					   TEST_DEVICE_NAME, DEFAULT_IDS,
+					   EV_SYN, SYN_REPORT,
+					   EV_REL, REL_X,
+					   EV_REL, REL_Y,
+					   EV_KEY, BTN_LEFT,
+					   -1);
+	ck_assert_msg(rc == 0, "Failed to create uinput device: %s", strerror(-rc));
+
+	dev = libevdev_new();
+	ck_assert(dev != NULL);
+	ck_assert_int_eq(libevdev_get_queue_size(dev), 0);
+	ck_assert_int_eq(libevdev_set_queue_size(dev, 0), -EINVAL);
+	ck_assert_int_eq(libevdev_set_queue_size(dev, 1000), 0);
+	ck_assert_int_eq(libevdev_set_queue_max_size(dev, 4000), 0);
+
+	rc = libevdev_set_fd(dev, uinput_device_get_fd(uidev));
+	ck_assert_msg(rc == 0, "Failed to init device: %s", strerror(-rc));
+	ck_assert_int_eq(libevdev_get_queue_size(dev), 1000);
+
+	ck_assert_int_eq(libevdev_set_queue_size(dev, 2000), 0);
+	ck_assert_int_eq(libevdev_get_queue_size(dev), 2000);
+
+	/* too small to hold a sync */
+	ck_assert_int_eq(libevdev_set_queue_size(dev, 2), -EINVAL);
+	ck_assert_int_eq(libevdev_get_queue_size(dev), 2000);
+
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_snapshot)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev, *dev2;
+	struct libevdev_snapshot *snapshot;
+	struct input_absinfo abs[4];
+	struct input_event ev;
+	int rc, fd;
+
+	memset(abs, 0, sizeof(abs));
+	abs[0].value = ABS_X;
+	abs[0].maximum = 1000;
+	abs[1].value = ABS_MT_POSITION_X;
+	abs[1].maximum = 1000;
+	abs[2].value = ABS_MT_TRACKING_ID;
+	abs[2].maximum = 10;
+	abs[3].value = ABS_MT_SLOT;
+	abs[3].maximum = 2;
+
+	test_create_abs_device(&uidev, &dev,
+			       4, abs,
+			       EV_SYN, SYN_REPORT,
+			       EV_KEY, BTN_LEFT,
+			       EV_KEY, BTN_TOUCH,
+			       -1);
+
+	rc = libevdev_snapshot_new(dev, &snapshot);
+	ck_assert_int_eq(rc, 0);
+
+	/* change the device state after taking the snapshot */
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_ABS, ABS_X, 500);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, 1);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_TRACKING_ID, 3);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_X, 200);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	fd = open(uinput_device_get_devnode(uidev), O_RDONLY|O_NONBLOCK);
+	ck_assert_int_gt(fd, -1);
+
+	rc = libevdev_new_from_fd_with_snapshot(fd, snapshot, &dev2);
+	ck_assert_msg(rc == 0, "Failed to init device: %s", strerror(-rc));
+	libevdev_snapshot_free(snapshot);
+
+	ck_assert_str_eq(libevdev_get_name(dev2), libevdev_get_name(dev));
+	ck_assert_int_eq(libevdev_get_id_vendor(dev2), libevdev_get_id_vendor(dev));
+	ck_assert_int_eq(libevdev_get_id_product(dev2), libevdev_get_id_product(dev));
+	ck_assert_int_eq(libevdev_get_driver_version(dev2), libevdev_get_driver_version(dev));
+	ck_assert(libevdev_has_event_code(dev2, EV_KEY, BTN_TOUCH));
+	ck_assert(!libevdev_has_event_code(dev2, EV_KEY, BTN_RIGHT));
+	ck_assert_int_eq(libevdev_get_abs_maximum(dev2, ABS_X), 1000);
+	ck_assert_int_eq(libevdev_get_num_slots(dev2), 3);
+
+	/* state is read from the device, not the snapshot */
+	ck_assert_int_eq(libevdev_get_event_value(dev2, EV_KEY, BTN_LEFT), 1);
+	ck_assert_int_eq(libevdev_get_event_value(dev2, EV_ABS, ABS_X), 500);
+	ck_assert_int_eq(libevdev_get_current_slot(dev2), 1);
+	ck_assert_int_eq(libevdev_get_slot_value(dev2, 1, ABS_MT_TRACKING_ID), 3);
+	ck_assert_int_eq(libevdev_get_slot_value(dev2, 1, ABS_MT_POSITION_X), 200);
+	ck_assert_int_eq(libevdev_get_event_value(dev2, EV_ABS, ABS_MT_POSITION_X), 200);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 0);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(dev2, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert_int_eq(ev.type, EV_KEY);
+	ck_assert_int_eq(ev.code, BTN_LEFT);
+	ck_assert_int_eq(ev.value, 0);
+
+	libevdev_free(dev2);
+	close(fd);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_snapshot_stale)
+{
+	struct uinput_device* uidev, *uidev2;
+	struct libevdev *dev, *dev2;
+	struct libevdev_snapshot *snapshot;
+	int rc;
+
+	test_create_device(&uidev, &dev,
+			   EV_SYN, SYN_REPORT,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+	rc = libevdev_snapshot_new(dev, &snapshot);
+	ck_assert_int_eq(rc, 0);
+
+	/* same ids, different event types */
+	test_create_device(&uidev2, &dev2,
+			   EV_SYN, SYN_REPORT,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+	libevdev_free(dev2);
+
+	dev2 = libevdev_new();
+	rc = libevdev_set_fd_with_snapshot(dev2, uinput_device_get_fd(uidev2), snapshot);
+	ck_assert_int_eq(rc, -ESTALE);
+
+	/* the device is left uninitialized and can be set up normally */
+	rc = libevdev_set_fd(dev2, uinput_device_get_fd(uidev2));
+	ck_assert_int_eq(rc, 0);
+	ck_assert(!libevdev_has_event_type(dev2, EV_REL));
+
+	libevdev_snapshot_free(snapshot);
+	libevdev_snapshot_free(NULL);
+	uinput_device_free(uidev2);
+	libevdev_free(dev2);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_snapshot_modified)
+{
+	struct uinput_device* uidev;
+	struct libevdev *dev, *dev2, *dev3;
+	struct libevdev_snapshot *snapshot;
+	struct input_absinfo abs[2];
+	const struct input_absinfo *abs_y;
+	int rc;
+
+	memset(abs, 0, sizeof(abs));
+	abs[0].value = ABS_X;
+	abs[0].maximum = 1000;
+	abs[1].value = ABS_Y;
+	abs[1].maximum = 500;
+
+	test_create_abs_device(&uidev, &dev,
+			       2, abs,
+			       EV_SYN, SYN_REPORT,
+			       EV_KEY, BTN_LEFT,
+			       -1);
+
+	rc = libevdev_snapshot_new(dev, &snapshot);
+	ck_assert_int_eq(rc, 0);
+
+	rc = libevdev_new_from_fd_with_snapshot(uinput_device_get_fd(uidev),
+						snapshot, &dev2);
+	ck_assert_int_eq(rc, 0);
+	rc = libevdev_new_from_fd_with_snapshot(uinput_device_get_fd(uidev),
+						snapshot, &dev3);
+	ck_assert_int_eq(rc, 0);
+
+	/* modifying one device must not change the others or the snapshot */
+	abs_y = libevdev_get_abs_info(dev2, ABS_Y);
+	libevdev_set_name(dev2, "modified");
+	libevdev_set_id_product(dev2, 0x1234);
+	libevdev_set_abs_maximum(dev2, ABS_X, 10);
+	libevdev_disable_event_code(dev2, EV_ABS, ABS_X);
+	rc = libevdev_enable_event_code(dev2, EV_KEY, BTN_RIGHT, NULL);
+	ck_assert_int_eq(rc, 0);
+	abs[0].maximum = 20;
+	rc = libevdev_enable_event_code(dev2, EV_ABS, ABS_Z, &abs[0]);
+	ck_assert_int_eq(rc, 0);
+
+	ck_assert_str_eq(libevdev_get_name(dev2), "modified");
+	ck_assert_int_eq(libevdev_get_id_product(dev2), 0x1234);
+	ck_assert(!libevdev_has_event_code(dev2, EV_ABS, ABS_X));
+	ck_assert_int_eq(libevdev_get_abs_maximum(dev2, ABS_Y), 500);
+	ck_assert_int_eq(libevdev_get_abs_maximum(dev2, ABS_Z), 20);
+	/* enabling and disabling axes doesn't move the others */
+	ck_assert(libevdev_get_abs_info(dev2, ABS_Y) == abs_y);
+	ck_assert(libevdev_has_event_code(dev2, EV_KEY, BTN_RIGHT));
+
+	ck_assert_str_eq(libevdev_get_name(dev3), libevdev_get_name(dev));
+	ck_assert_int_eq(libevdev_get_id_product(dev3), libevdev_get_id_product(dev));
+	ck_assert_int_eq(libevdev_get_abs_maximum(dev3, ABS_X), 1000);
+	ck_assert(!libevdev_has_event_code(dev3, EV_ABS, ABS_Z));
+	ck_assert(!libevdev_has_event_code(dev3, EV_KEY, BTN_RIGHT));
+	libevdev_free(dev3);
+
+	libevdev_free(dev);
+	rc = libevdev_new_from_fd_with_snapshot(uinput_device_get_fd(uidev),
+						snapshot, &dev);
+	ck_assert_int_eq(rc, 0);
+	libevdev_snapshot_free(snapshot);
+	ck_assert_int_eq(libevdev_get_abs_maximum(dev, ABS_X), 1000);
+	ck_assert(!libevdev_has_event_code(dev, EV_KEY, BTN_RIGHT));
+
+	libevdev_free(dev2);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_description)
+{
+	struct libevdev *dev, *dev2;
+	struct input_absinfo abs;
+	int delay = 500;
+	char *data;
+	int size, rc;
+
+	dev = libevdev_new();
+	libevdev_set_name(dev, "described device");
+	libevdev_set_uniq(dev, "1234");
+	libevdev_set_id_vendor(dev, 0x1234);
+	libevdev_set_id_product(dev, 0x5678);
+	libevdev_enable_property(dev, INPUT_PROP_POINTER);
+	libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, NULL);
+	libevdev_enable_event_code(dev, EV_REL, REL_X, NULL);
+	libevdev_enable_event_code(dev, EV_REP, REP_DELAY, &delay);
+	memset(&abs, 0, sizeof(abs));
+	abs.minimum = -100;
+	abs.maximum = 100;
+	abs.resolution = 10;
+	libevdev_enable_event_code(dev, EV_ABS, ABS_X, &abs);
+
+	size = libevdev_write_description(dev, NULL, 0);
+	ck_assert_int_gt(size, 0);
+	data = calloc(1, size);
+	ck_assert_int_eq(libevdev_write_description(dev, data, size - 1), size);
+	ck_assert_int_eq(data[0], 0);
+	ck_assert_int_eq(libevdev_write_description(dev, data, size), size);
+
+	rc = libevdev_new_from_description(data, size, &dev2);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_str_eq(libevdev_get_name(dev2), "described device");
+	ck_assert(libevdev_get_phys(dev2) == NULL);
+	ck_assert_str_eq(libevdev_get_uniq(dev2), "1234");
+	ck_assert_int_eq(libevdev_get_id_vendor(dev2), 0x1234);
+	ck_assert_int_eq(libevdev_get_id_product(dev2), 0x5678);
+	ck_assert(libevdev_has_property(dev2, INPUT_PROP_POINTER));
+	ck_assert(libevdev_has_event_code(dev2, EV_KEY, BTN_LEFT));
+	ck_assert(libevdev_has_event_code(dev2, EV_REL, REL_X));
+	ck_assert(!libevdev_has_event_code(dev2, EV_REL, REL_Y));
+	ck_assert_int_eq(libevdev_get_repeat(dev2, &delay, NULL), 0);
+	ck_assert_int_eq(delay, 500);
+	ck_assert_int_eq(libevdev_get_abs_minimum(dev2, ABS_X), -100);
+	ck_assert_int_eq(libevdev_get_abs_maximum(dev2, ABS_X), 100);
+	ck_assert_int_eq(libevdev_get_abs_resolution(dev2, ABS_X), 10);
+	libevdev_free(dev2);
+
+	/* truncated or corrupted data */
+	ck_assert_int_eq(libevdev_new_from_description(data, size - 1, &dev2), -EINVAL);
+	ck_assert_int_eq(libevdev_new_from_description(data, 8, &dev2), -EINVAL);
+	data[0] = 'X';
+	ck_assert_int_eq(libevdev_new_from_description(data, size, &dev2), -EINVAL);
+
+	free(data);
+	libevdev_free(dev);
+}
+END_TEST
+
 Suite *
 libevdev_init_test(void)
 {
@@ -620,6 +912,17 @@ libevdev_init_test(void)
 	tc = tcase_create("device fd init");
 	tcase_add_test(tc, test_device_init);
 	tcase_add_test(tc, test_device_init_from_fd);
+	tcase_add_test(tc, test_queue_size);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("device snapshot");
+	tcase_add_test(tc, test_snapshot);
+	tcase_add_test(tc, test_snapshot_stale);
+	tcase_add_test(tc, test_snapshot_modified);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("device description");
+	tcase_add_test(tc, test_description);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("device grab");
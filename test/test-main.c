@@ -37,6 +37,10 @@ extern Suite *queue_suite(void);
 extern Suite *libevdev_has_event_test(void);
 extern Suite *libevdev_events(void);
 extern Suite *uinput_suite(void);
+extern Suite *libevdev_hub_test(void);
+extern Suite *libevdev_mux_test(void);
+extern Suite *libevdev_reader_test(void);
+extern Suite *libevdev_record_test(void);
 
 static int
 is_debugger_attached(void)
@@ -83,6 +87,10 @@ int main(int argc, char **argv)
 	srunner_add_suite(sr, event_name_suite());
 	srunner_add_suite(sr, event_code_suite());
 	srunner_add_suite(sr, uinput_suite());
+	srunner_add_suite(sr, libevdev_hub_test());
+	srunner_add_suite(sr, libevdev_mux_test());
+	srunner_add_suite(sr, libevdev_reader_test());
+	srunner_add_suite(sr, libevdev_record_test());
 	srunner_run_all(sr, CK_NORMAL);
 
 	failed = srunner_ntests_failed(sr);
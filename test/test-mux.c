@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+#include <config.h>
+#include <linux/input.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libevdev/libevdev-mux.h>
+
+#include "test-common.h"
+
+static void
+assert_next_event(struct libevdev *dev, unsigned int type, unsigned int code, int value)
+{
+	struct input_event ev;
+	int rc;
+
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SUCCESS);
+	ck_assert(libevdev_event_is_code(&ev, type, code));
+	ck_assert_int_eq(ev.value, value);
+}
+
+START_TEST(test_mux_union_device)
+{
+	struct uinput_device *uidev1, *uidev2;
+	struct libevdev *dev1, *dev2, *merged;
+	struct libevdev_mux *mux;
+	struct input_absinfo abs = {
+		.value = ABS_X,
+		.minimum = 0,
+		.maximum = 1000,
+		.resolution = 10,
+	};
+
+	test_create_device(&uidev1, &dev1,
+			   EV_KEY, KEY_A,
+			   EV_REL, REL_X,
+			   -1);
+	test_create_abs_device(&uidev2, &dev2,
+			       1, &abs,
+			       EV_KEY, BTN_LEFT,
+			       -1);
+
+	ck_assert_int_eq(libevdev_mux_new(&mux), 0);
+	ck_assert_int_eq(libevdev_mux_add_device(mux, dev1), 0);
+	ck_assert_int_eq(libevdev_mux_add_device(mux, dev2), 0);
+	ck_assert_int_eq(libevdev_mux_add_device(mux, dev1), -EEXIST);
+
+	ck_assert_int_eq(libevdev_mux_new_device(mux, &merged), 0);
+	ck_assert_str_eq(libevdev_get_name(merged), libevdev_get_name(dev1));
+	ck_assert(libevdev_has_event_code(merged, EV_KEY, KEY_A));
+	ck_assert(libevdev_has_event_code(merged, EV_KEY, BTN_LEFT));
+	ck_assert(libevdev_has_event_code(merged, EV_REL, REL_X));
+	ck_assert(libevdev_has_event_code(merged, EV_ABS, ABS_X));
+	ck_assert_int_eq(libevdev_get_abs_maximum(merged, ABS_X), 1000);
+	ck_assert_int_eq(libevdev_get_abs_resolution(merged, ABS_X), 10);
+
+	libevdev_free(merged);
+	libevdev_mux_free(mux);
+	libevdev_free(dev1);
+	libevdev_free(dev2);
+	uinput_device_free(uidev1);
+	uinput_device_free(uidev2);
+}
+END_TEST
+
+START_TEST(test_mux_key_merging)
+{
+	struct uinput_device *uidev1, *uidev2;
+	struct libevdev *dev1, *dev2, *merged, *out, *failed;
+	struct libevdev_uinput *uinput;
+	struct libevdev_mux *mux;
+	struct input_event ev;
+	int fd, rc;
+
+	test_create_device(&uidev1, &dev1,
+			   EV_KEY, KEY_A,
+			   EV_KEY, KEY_B,
+			   -1);
+	test_create_device(&uidev2, &dev2,
+			   EV_KEY, KEY_A,
+			   EV_KEY, KEY_B,
+			   -1);
+
+	ck_assert_int_eq(libevdev_mux_new(&mux), 0);
+	ck_assert_int_gt(libevdev_mux_get_fd(mux), -1);
+	ck_assert_int_eq(libevdev_mux_add_device(mux, dev1), 0);
+	ck_assert_int_eq(libevdev_mux_add_device(mux, dev2), 0);
+
+	ck_assert_int_eq(libevdev_mux_new_device(mux, &merged), 0);
+	rc = libevdev_uinput_create_from_device(merged,
+						LIBEVDEV_UINPUT_OPEN_MANAGED,
+						&uinput);
+	ck_assert_int_eq(rc, 0);
+	libevdev_free(merged);
+	libevdev_mux_set_uinput(mux, uinput);
+
+	fd = open(libevdev_uinput_get_devnode(uinput), O_RDONLY|O_NONBLOCK);
+	ck_assert_int_gt(fd, -1);
+	ck_assert_int_eq(libevdev_new_from_fd(fd, &out), 0);
+
+	ck_assert_int_eq(libevdev_mux_dispatch(mux, &failed), 0);
+	ck_assert(failed == NULL);
+
+	/* both sources press A, the first release is swallowed. Each
+	   source is read in batches, dispatch in between to keep the
+	   order. */
+	uinput_device_event(uidev1, EV_KEY, KEY_A, 1);
+	uinput_device_event(uidev1, EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libevdev_mux_dispatch(mux, &failed), 2);
+	uinput_device_event(uidev2, EV_KEY, KEY_A, 1);
+	uinput_device_event(uidev2, EV_KEY, KEY_B, 1);
+	uinput_device_event(uidev2, EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libevdev_mux_dispatch(mux, &failed), 2);
+	uinput_device_event(uidev1, EV_KEY, KEY_A, 0);
+	uinput_device_event(uidev1, EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libevdev_mux_dispatch(mux, &failed), 0);
+	ck_assert(failed == NULL);
+
+	assert_next_event(out, EV_KEY, KEY_A, 1);
+	assert_next_event(out, EV_SYN, SYN_REPORT, 0);
+	assert_next_event(out, EV_KEY, KEY_B, 1);
+	assert_next_event(out, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(out, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	/* removing the second source releases its keys */
+	ck_assert_int_eq(libevdev_mux_remove_device(mux, dev2), 0);
+	ck_assert_int_eq(libevdev_mux_remove_device(mux, dev2), -ENOENT);
+
+	assert_next_event(out, EV_KEY, KEY_A, 0);
+	assert_next_event(out, EV_KEY, KEY_B, 0);
+	assert_next_event(out, EV_SYN, SYN_REPORT, 0);
+	rc = libevdev_next_event(out, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	libevdev_free(out);
+	close(fd);
+	libevdev_mux_free(mux);
+	libevdev_uinput_destroy(uinput);
+	libevdev_free(dev1);
+	libevdev_free(dev2);
+	uinput_device_free(uidev1);
+	uinput_device_free(uidev2);
+}
+END_TEST
+
+Suite *
+libevdev_mux_test(void)
+{
+	Suite *s = suite_create("libevdev mux tests");
+
+	TCase *tc = tcase_create("union device");
+	tcase_add_test(tc, test_mux_union_device);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("key merging");
+	tcase_add_test(tc, test_mux_key_merging);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,304 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <linux/input.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <libevdev/libevdev-reader.h>
+
+#include "test-common.h"
+
+START_TEST(test_reader_frames)
+{
+	struct uinput_device *uidev;
+	struct libevdev *dev;
+	struct libevdev_reader *reader;
+	const struct libevdev_reader_frame *frame;
+	const struct input_event *events;
+	size_t nevents;
+	int rc;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	rc = libevdev_reader_new(dev, 4, &reader);
+	ck_assert_int_eq(rc, 0);
+
+	ck_assert_int_eq(libevdev_reader_dispatch(reader), -EAGAIN);
+	ck_assert(libevdev_reader_peek_frame(reader) == NULL);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 0);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	ck_assert_int_eq(libevdev_reader_dispatch(reader), -EAGAIN);
+
+	/* the first frame keeps its own state */
+	frame = libevdev_reader_peek_frame(reader);
+	ck_assert(frame != NULL);
+	ck_assert(frame == libevdev_reader_peek_frame(reader));
+	ck_assert(!libevdev_reader_frame_is_sync(frame));
+	events = libevdev_reader_frame_get_events(frame, &nevents);
+	ck_assert_int_eq(nevents, 3);
+	ck_assert_int_eq(events[0].type, EV_KEY);
+	ck_assert_int_eq(events[1].type, EV_REL);
+	ck_assert_int_eq(events[2].type, EV_SYN);
+	ck_assert_int_eq(libevdev_reader_frame_get_event_value(frame, EV_KEY, BTN_LEFT), 1);
+	ck_assert_int_eq(libevdev_reader_frame_get_event_value(frame, EV_REL, REL_X), 0);
+	ck_assert_int_eq(libevdev_reader_frame_get_current_slot(frame), -1);
+	libevdev_reader_release_frame(reader);
+
+	frame = libevdev_reader_peek_frame(reader);
+	ck_assert(frame != NULL);
+	events = libevdev_reader_frame_get_events(frame, &nevents);
+	ck_assert_int_eq(nevents, 2);
+	ck_assert_int_eq(libevdev_reader_frame_get_event_value(frame, EV_KEY, BTN_LEFT), 0);
+	libevdev_reader_release_frame(reader);
+
+	ck_assert(libevdev_reader_peek_frame(reader) == NULL);
+
+	libevdev_reader_free(reader);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_reader_full)
+{
+	struct uinput_device *uidev;
+	struct libevdev *dev;
+	struct libevdev_reader *reader;
+	const struct libevdev_reader_frame *frame;
+	const struct input_event *events;
+	size_t nevents;
+	int i, rc;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   -1);
+
+	/* rounded up to 4 */
+	rc = libevdev_reader_new(dev, 3, &reader);
+	ck_assert_int_eq(rc, 0);
+
+	for (i = 0; i < 6; i++) {
+		uinput_device_event(uidev, EV_REL, REL_X, i + 1);
+		uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	}
+
+	ck_assert_int_eq(libevdev_reader_dispatch(reader), -ENOSPC);
+	ck_assert_int_eq(libevdev_reader_dispatch(reader), -ENOSPC);
+
+	for (i = 0; i < 4; i++) {
+		frame = libevdev_reader_peek_frame(reader);
+		ck_assert(frame != NULL);
+		events = libevdev_reader_frame_get_events(frame, &nevents);
+		ck_assert_int_eq(events[0].value, i + 1);
+		libevdev_reader_release_frame(reader);
+	}
+	ck_assert(libevdev_reader_peek_frame(reader) == NULL);
+
+	/* nothing was lost while the ring was full */
+	ck_assert_int_eq(libevdev_reader_dispatch(reader), -EAGAIN);
+	for (i = 4; i < 6; i++) {
+		frame = libevdev_reader_peek_frame(reader);
+		ck_assert(frame != NULL);
+		events = libevdev_reader_frame_get_events(frame, &nevents);
+		ck_assert_int_eq(events[0].value, i + 1);
+		libevdev_reader_release_frame(reader);
+	}
+
+	libevdev_reader_free(reader);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_reader_long_frame)
+{
+	struct uinput_device *uidev;
+	struct libevdev *dev;
+	struct libevdev_reader *reader;
+	const struct libevdev_reader_frame *frame;
+	const struct input_event *events;
+	size_t nevents;
+	int i, rc;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   -1);
+
+	rc = libevdev_set_queue_size(dev, 16);
+	ck_assert_int_eq(rc, 0);
+	rc = libevdev_reader_new(dev, 4, &reader);
+	ck_assert_int_eq(rc, 0);
+
+	/* too long for a ring entry, dropped as a whole */
+	for (i = 0; i < 20; i++)
+		uinput_device_event(uidev, EV_REL, REL_X, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev, EV_REL, REL_X, 2);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	ck_assert_int_eq(libevdev_reader_dispatch(reader), -EAGAIN);
+	ck_assert_int_eq(libevdev_reader_get_num_dropped_frames(reader), 1);
+
+	frame = libevdev_reader_peek_frame(reader);
+	ck_assert(frame != NULL);
+	events = libevdev_reader_frame_get_events(frame, &nevents);
+	ck_assert_int_eq(nevents, 2);
+	ck_assert_int_eq(events[0].value, 2);
+	libevdev_reader_release_frame(reader);
+	ck_assert(libevdev_reader_peek_frame(reader) == NULL);
+
+	libevdev_reader_free(reader);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_reader_slots)
+{
+	struct uinput_device *uidev;
+	struct libevdev *dev;
+	struct libevdev_reader *reader;
+	const struct libevdev_reader_frame *frame;
+	struct input_absinfo abs[3];
+	int rc;
+
+	memset(abs, 0, sizeof(abs));
+	abs[0].value = ABS_X;
+	abs[0].maximum = 1000;
+	abs[1].value = ABS_MT_POSITION_X;
+	abs[1].maximum = 1000;
+	abs[2].value = ABS_MT_SLOT;
+	abs[2].maximum = 1;
+
+	test_create_abs_device(&uidev, &dev,
+			       3, abs,
+			       EV_SYN, SYN_REPORT,
+			       -1);
+
+	rc = libevdev_reader_new(dev, 4, &reader);
+	ck_assert_int_eq(rc, 0);
+
+	uinput_device_event(uidev, EV_ABS, ABS_X, 20);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_SLOT, 1);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_X, 100);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+	uinput_device_event(uidev, EV_ABS, ABS_MT_POSITION_X, 200);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	ck_assert_int_eq(libevdev_reader_dispatch(reader), -EAGAIN);
+
+	frame = libevdev_reader_peek_frame(reader);
+	ck_assert(frame != NULL);
+	ck_assert_int_eq(libevdev_reader_frame_get_event_value(frame, EV_ABS, ABS_X), 20);
+	ck_assert_int_eq(libevdev_reader_frame_get_current_slot(frame), 1);
+	ck_assert_int_eq(libevdev_reader_frame_get_slot_value(frame, 1, ABS_MT_POSITION_X), 100);
+	ck_assert_int_eq(libevdev_reader_frame_get_slot_value(frame, 2, ABS_MT_POSITION_X), 0);
+	ck_assert_int_eq(libevdev_reader_frame_get_slot_value(frame, 1, ABS_X), 0);
+	libevdev_reader_release_frame(reader);
+
+	frame = libevdev_reader_peek_frame(reader);
+	ck_assert(frame != NULL);
+	ck_assert_int_eq(libevdev_reader_frame_get_slot_value(frame, 1, ABS_MT_POSITION_X), 200);
+	libevdev_reader_release_frame(reader);
+
+	libevdev_reader_free(reader);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_reader_sync)
+{
+	struct uinput_device *uidev;
+	struct libevdev *dev;
+	struct libevdev_reader *reader;
+	const struct libevdev_reader_frame *frame;
+	const struct input_event *events;
+	struct input_event ev;
+	size_t nevents;
+	int rc;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_KEY, BTN_LEFT,
+			   -1);
+
+	uinput_device_event(uidev, EV_KEY, BTN_LEFT, 1);
+	uinput_device_event(uidev, EV_SYN, SYN_REPORT, 0);
+
+	/* pretend we missed the frame, the reader picks up the sync */
+	rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_FORCE_SYNC, &ev);
+	ck_assert_int_eq(rc, LIBEVDEV_READ_STATUS_SYNC);
+
+	rc = libevdev_reader_new(dev, 4, &reader);
+	ck_assert_int_eq(rc, 0);
+
+	ck_assert_int_eq(libevdev_reader_dispatch(reader), -EAGAIN);
+
+	frame = libevdev_reader_peek_frame(reader);
+	ck_assert(frame != NULL);
+	ck_assert(libevdev_reader_frame_is_sync(frame));
+	events = libevdev_reader_frame_get_events(frame, &nevents);
+	ck_assert_int_eq(nevents, 2);
+	ck_assert_int_eq(events[0].type, EV_KEY);
+	ck_assert_int_eq(events[0].code, BTN_LEFT);
+	ck_assert_int_eq(events[0].value, 1);
+	ck_assert_int_eq(libevdev_reader_frame_get_event_value(frame, EV_KEY, BTN_LEFT), 1);
+	libevdev_reader_release_frame(reader);
+
+	ck_assert(libevdev_reader_peek_frame(reader) == NULL);
+
+	libevdev_reader_free(reader);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+Suite *
+libevdev_reader_test(void)
+{
+	Suite *s = suite_create("libevdev reader tests");
+
+	TCase *tc = tcase_create("reader frames");
+	tcase_add_test(tc, test_reader_frames);
+	tcase_add_test(tc, test_reader_full);
+	tcase_add_test(tc, test_reader_long_frame);
+	tcase_add_test(tc, test_reader_slots);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("reader sync");
+	tcase_add_test(tc, test_reader_sync);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
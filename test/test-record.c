@@ -0,0 +1,210 @@
+/*
+ * Copyright © 2013 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <linux/input.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <libevdev/libevdev-record.h>
+
+#include "test-common.h"
+
+static int
+record_events(const struct libevdev *dev,
+	      const struct input_event *events, size_t nevents)
+{
+	struct libevdev_recorder *recorder;
+	FILE *fp;
+	int fd;
+
+	fp = tmpfile();
+	ck_assert(fp != NULL);
+	fd = dup(fileno(fp));
+	fclose(fp);
+
+	ck_assert_int_eq(libevdev_recorder_new(dev, fd, &recorder), 0);
+	ck_assert_int_eq(libevdev_recorder_write_events(recorder, events, nevents), 0);
+	ck_assert_int_eq(libevdev_recorder_flush(recorder), 0);
+	libevdev_recorder_free(recorder);
+
+	return fd;
+}
+
+START_TEST(test_record_roundtrip)
+{
+	struct libevdev *dev;
+	struct libevdev_replay *replay;
+	const struct libevdev *dev2;
+	struct input_event events[] = {
+		{ { 100, 999999 }, EV_REL, REL_X, -1 },
+		{ { 100, 999999 }, EV_REL, REL_Y, 200000 },
+		{ { 100, 999999 }, EV_SYN, SYN_REPORT, 0 },
+		{ { 101, 8 }, EV_KEY, BTN_LEFT, 1 },
+		{ { 101, 8 }, EV_SYN, SYN_REPORT, 0 },
+		/* time going backwards is still recorded as-is */
+		{ { 99, 0 }, EV_KEY, KEY_MAX, 0 },
+	};
+	struct input_event ev;
+	size_t i;
+	int fd;
+
+	dev = libevdev_new();
+	libevdev_set_name(dev, "recorded device");
+	libevdev_enable_event_code(dev, EV_REL, REL_X, NULL);
+	libevdev_enable_event_code(dev, EV_REL, REL_Y, NULL);
+	libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, NULL);
+
+	fd = record_events(dev, events, sizeof(events)/sizeof(events[0]));
+
+	ck_assert_int_eq(libevdev_replay_new(fd, &replay), 0);
+	close(fd);
+
+	dev2 = libevdev_replay_get_device(replay);
+	ck_assert_str_eq(libevdev_get_name(dev2), "recorded device");
+	ck_assert(libevdev_has_event_code(dev2, EV_REL, REL_Y));
+	ck_assert(libevdev_has_event_code(dev2, EV_KEY, BTN_LEFT));
+	ck_assert(!libevdev_has_event_code(dev2, EV_KEY, BTN_RIGHT));
+
+	for (i = 0; i < sizeof(events)/sizeof(events[0]); i++) {
+		ck_assert_int_eq(libevdev_replay_next_event(replay, &ev), 0);
+		ck_assert_int_eq(ev.time.tv_sec, events[i].time.tv_sec);
+		ck_assert_int_eq(ev.time.tv_usec, events[i].time.tv_usec);
+		ck_assert_int_eq(ev.type, events[i].type);
+		ck_assert_int_eq(ev.code, events[i].code);
+		ck_assert_int_eq(ev.value, events[i].value);
+	}
+	ck_assert_int_eq(libevdev_replay_next_event(replay, &ev), -ENODATA);
+
+	libevdev_replay_rewind(replay);
+	ck_assert_int_eq(libevdev_replay_next_event(replay, &ev), 0);
+	ck_assert_int_eq(ev.code, REL_X);
+	ck_assert_int_eq(ev.value, -1);
+
+	libevdev_replay_free(replay);
+	libevdev_free(dev);
+}
+END_TEST
+
+START_TEST(test_record_invalid)
+{
+	struct libevdev_replay *replay;
+	FILE *fp;
+	int fd;
+
+	fp = tmpfile();
+	ck_assert(fp != NULL);
+	fd = fileno(fp);
+
+	ck_assert_int_eq(libevdev_replay_new(fd, &replay), -EINVAL);
+	ck_assert(replay == NULL);
+
+	ck_assert_int_eq(write(fd, "EVRCnot a recording", 19), 19);
+	ck_assert_int_eq(libevdev_replay_new(fd, &replay), -EINVAL);
+	ck_assert(replay == NULL);
+
+	fclose(fp);
+}
+END_TEST
+
+START_TEST(test_record_replay_uinput)
+{
+	struct uinput_device *uidev;
+	struct libevdev *dev, *dev2;
+	struct libevdev_replay *replay;
+	struct libevdev_uinput *uinput;
+	struct input_event events[] = {
+		{ { 1, 0 }, EV_REL, REL_X, 1 },
+		{ { 1, 0 }, EV_SYN, SYN_REPORT, 0 },
+		{ { 1, 0 }, EV_SYN, SYN_DROPPED, 0 },
+		{ { 1, 1000 }, EV_REL, REL_X, 2 },
+		{ { 1, 1000 }, EV_SYN, SYN_REPORT, 0 },
+	};
+	struct input_event ev;
+	int fd, rc;
+
+	test_create_device(&uidev, &dev,
+			   EV_REL, REL_X,
+			   EV_REL, REL_Y,
+			   -1);
+
+	fd = record_events(dev, events, sizeof(events)/sizeof(events[0]));
+	ck_assert_int_eq(libevdev_replay_new(fd, &replay), 0);
+	close(fd);
+
+	rc = libevdev_uinput_create_from_device(libevdev_replay_get_device(replay),
+						LIBEVDEV_UINPUT_OPEN_MANAGED,
+						&uinput);
+	ck_assert_int_eq(rc, 0);
+
+	fd = open(libevdev_uinput_get_devnode(uinput), O_RDONLY|O_NONBLOCK);
+	ck_assert_int_gt(fd, -1);
+	ck_assert_int_eq(libevdev_new_from_fd(fd, &dev2), 0);
+
+	ck_assert_int_eq(libevdev_replay_run(replay, uinput, -1.0), -EINVAL);
+	ck_assert_int_eq(libevdev_replay_run(replay, uinput, 1.0), 4);
+	ck_assert_int_eq(libevdev_replay_run(replay, uinput, 0), 4);
+
+	for (rc = 0; rc < 2; rc++) {
+		ck_assert_int_eq(libevdev_next_event(dev2, LIBEVDEV_READ_FLAG_NORMAL, &ev),
+				 LIBEVDEV_READ_STATUS_SUCCESS);
+		ck_assert(libevdev_event_is_code(&ev, EV_REL, REL_X));
+		ck_assert_int_eq(ev.value, 1);
+		ck_assert_int_eq(libevdev_next_event(dev2, LIBEVDEV_READ_FLAG_NORMAL, &ev),
+				 LIBEVDEV_READ_STATUS_SUCCESS);
+		ck_assert(libevdev_event_is_code(&ev, EV_SYN, SYN_REPORT));
+		ck_assert_int_eq(libevdev_next_event(dev2, LIBEVDEV_READ_FLAG_NORMAL, &ev),
+				 LIBEVDEV_READ_STATUS_SUCCESS);
+		ck_assert(libevdev_event_is_code(&ev, EV_REL, REL_X));
+		ck_assert_int_eq(ev.value, 2);
+		ck_assert_int_eq(libevdev_next_event(dev2, LIBEVDEV_READ_FLAG_NORMAL, &ev),
+				 LIBEVDEV_READ_STATUS_SUCCESS);
+		ck_assert(libevdev_event_is_code(&ev, EV_SYN, SYN_REPORT));
+	}
+
+	libevdev_free(dev2);
+	close(fd);
+	libevdev_uinput_destroy(uinput);
+	libevdev_replay_free(replay);
+	uinput_device_free(uidev);
+	libevdev_free(dev);
+}
+END_TEST
+
+Suite *
+libevdev_record_test(void)
+{
+	Suite *s = suite_create("libevdev record tests");
+
+	TCase *tc = tcase_create("recording");
+	tcase_add_test(tc, test_record_roundtrip);
+	tcase_add_test(tc, test_record_invalid);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("replay");
+	tcase_add_test(tc, test_record_replay_uinput);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
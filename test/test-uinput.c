@@ -26,6 +26,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/stat.h>
 #include <libevdev/libevdev-uinput.h>
 
 #include "test-common.h"
@@ -269,6 +272,44 @@ START_TEST(test_uinput_check_syspath_name)
 }
 END_TEST
 
+START_TEST(test_uinput_check_devnode)
+{
+	struct libevdev *dev;
+	struct libevdev_uinput *uidev;
+	const char *syspath, *devnode;
+	char path[PATH_MAX];
+	struct stat st;
+	int rc;
+
+	dev = libevdev_new();
+	ck_assert(dev != NULL);
+	libevdev_set_name(dev, TEST_DEVICE_NAME);
+	libevdev_enable_event_code(dev, EV_REL, REL_X, NULL);
+
+	rc = libevdev_uinput_create_from_device(dev,
+						LIBEVDEV_UINPUT_OPEN_MANAGED,
+						&uidev);
+	ck_assert_int_eq(rc, 0);
+
+	/* devnode is looked up first, the syspath on the way */
+	devnode = libevdev_uinput_get_devnode(uidev);
+	ck_assert(devnode != NULL);
+	ck_assert(devnode == libevdev_uinput_get_devnode(uidev));
+	ck_assert(strncmp(devnode, "/dev/input/event", 16) == 0);
+
+	syspath = libevdev_uinput_get_syspath(uidev);
+	ck_assert(syspath != NULL);
+
+	/* the event node is a child of the input device */
+	rc = snprintf(path, sizeof(path), "%s/%s", syspath, devnode + strlen("/dev/input/"));
+	ck_assert_int_lt(rc, sizeof(path));
+	ck_assert_int_eq(stat(path, &st), 0);
+
+	libevdev_free(dev);
+	libevdev_uinput_destroy(uidev);
+}
+END_TEST
+
 START_TEST(test_uinput_events)
 {
 	struct libevdev *dev;
@@ -326,6 +367,77 @@ START_TEST(test_uinput_events)
 }
 END_TEST
 
+START_TEST(test_uinput_events_batch)
+{
+	struct libevdev *dev;
+	struct libevdev_uinput *uidev;
+	int fd, fd2;
+	int rc;
+	const char *devnode;
+	int i;
+	const int nevents = 5;
+	struct input_event events[] = { {{0, 0}, EV_REL, REL_X, 1},
+					{{0, 0}, EV_REL, REL_Y, -1},
+					{{0, 0}, EV_SYN, SYN_REPORT, 0},
+					{{0, 0}, EV_KEY, BTN_LEFT, 1},
+					{{0, 0}, EV_SYN, SYN_REPORT, 0}};
+	struct input_event invalid[] = { {{0, 0}, EV_REL, REL_X, 1},
+					 {{0, 0}, EV_REL, REL_MAX + 1, 1},
+					 {{0, 0}, EV_SYN, SYN_REPORT, 0}};
+	struct input_event events_read[nevents];
+
+	dev = libevdev_new();
+	ck_assert(dev != NULL);
+	libevdev_set_name(dev, TEST_DEVICE_NAME);
+	libevdev_enable_event_type(dev, EV_SYN);
+	libevdev_enable_event_type(dev, EV_REL);
+	libevdev_enable_event_type(dev, EV_KEY);
+	libevdev_enable_event_code(dev, EV_REL, REL_X, NULL);
+	libevdev_enable_event_code(dev, EV_REL, REL_Y, NULL);
+	libevdev_enable_event_code(dev, EV_KEY, BTN_LEFT, NULL);
+
+	fd = open(UINPUT_NODE, O_RDWR);
+	ck_assert_int_gt(fd, -1);
+
+	rc = libevdev_uinput_create_from_device(dev, fd, &uidev);
+	ck_assert_int_eq(rc, 0);
+	ck_assert(uidev != NULL);
+
+	devnode = libevdev_uinput_get_devnode(uidev);
+	ck_assert(devnode != NULL);
+
+	fd2 = open(devnode, O_RDONLY|O_NONBLOCK);
+
+	rc = libevdev_uinput_write_events(uidev, invalid, 3);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	rc = libevdev_uinput_write_events(uidev, events, 0);
+	ck_assert_int_eq(rc, 0);
+
+	/* nothing must have been posted so far */
+	rc = read(fd2, events_read, sizeof(events_read));
+	ck_assert_int_eq(rc, -1);
+	ck_assert_int_eq(errno, EAGAIN);
+
+	rc = libevdev_uinput_write_events(uidev, events, nevents);
+	ck_assert_int_eq(rc, nevents);
+
+	rc = read(fd2, events_read, sizeof(events_read));
+	ck_assert_int_eq(rc, sizeof(events_read));
+
+	for (i = 0; i < nevents; i++) {
+		ck_assert_int_eq(events[i].type, events_read[i].type);
+		ck_assert_int_eq(events[i].code, events_read[i].code);
+		ck_assert_int_eq(events[i].value, events_read[i].value);
+	}
+
+	libevdev_free(dev);
+	libevdev_uinput_destroy(uidev);
+	close(fd);
+	close(fd2);
+}
+END_TEST
+
 START_TEST(test_uinput_properties)
 {
 	struct libevdev *dev, *dev2;
@@ -379,10 +491,12 @@ uinput_suite(void)
 	tcase_add_test(tc, test_uinput_create_device_from_fd);
 	tcase_add_test(tc, test_uinput_check_syspath_time);
 	tcase_add_test(tc, test_uinput_check_syspath_name);
+	tcase_add_test(tc, test_uinput_check_devnode);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("device events");
 	tcase_add_test(tc, test_uinput_events);
+	tcase_add_test(tc, test_uinput_events_batch);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("device properties");
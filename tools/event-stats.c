@@ -0,0 +1,181 @@
+/*
+ * Copyright © 2014 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of Red Hat
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Red
+ * Hat makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include "event-stats.h"
+
+static inline uint64_t
+tv2us(const struct timeval *tv)
+{
+	return tv->tv_sec * 1000000ULL + tv->tv_usec;
+}
+
+static inline int
+msb(uint64_t v)
+{
+	return 63 - __builtin_clzll(v);
+}
+
+static inline unsigned int
+bucket_index(uint64_t us)
+{
+	int e;
+
+	if (us < (1 << EVENT_STATS_SUB_BITS))
+		return us;
+
+	e = msb(us);
+	if (e >= EVENT_STATS_MAX_BITS)
+		return EVENT_STATS_BUCKETS - 1;
+
+	return ((e - EVENT_STATS_SUB_BITS + 1) << EVENT_STATS_SUB_BITS) |
+		((us >> (e - EVENT_STATS_SUB_BITS)) & ((1 << EVENT_STATS_SUB_BITS) - 1));
+}
+
+/* the center of the range of intervals in a bucket */
+static inline double
+bucket_value(unsigned int index)
+{
+	unsigned int sub = index & ((1 << EVENT_STATS_SUB_BITS) - 1);
+	int shift = (index >> EVENT_STATS_SUB_BITS) - 1;
+
+	if (shift < 0)
+		return index;
+
+	return ((1 << EVENT_STATS_SUB_BITS) + sub + 0.5) * (1ULL << shift);
+}
+
+void
+event_stats_init(struct event_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+static void
+add_frame(struct event_stats *stats, uint64_t us)
+{
+	stats->frames++;
+	stats->period_frames++;
+	if (stats->frame_events > stats->max_frame_events)
+		stats->max_frame_events = stats->frame_events;
+	stats->frame_events = 0;
+
+	if (stats->last_frame_us && us >= stats->last_frame_us) {
+		uint64_t interval = us - stats->last_frame_us;
+
+		stats->histogram[bucket_index(interval)]++;
+		stats->intervals++;
+		if (interval > stats->max_interval_us)
+			stats->max_interval_us = interval;
+	}
+
+	/* the first period starts with the first frame */
+	if (!stats->period_start_us) {
+		stats->period_start_us = us;
+		stats->period_events = 0;
+		stats->period_frames = 0;
+	}
+	stats->period_end_us = us;
+	stats->last_frame_us = us;
+}
+
+void
+event_stats_add_event(struct event_stats *stats, const struct input_event *ev)
+{
+	if (ev->type != EV_SYN) {
+		stats->events++;
+		stats->period_events++;
+		stats->frame_events++;
+		return;
+	}
+
+	switch (ev->code) {
+	case SYN_REPORT:
+		add_frame(stats, tv2us(&ev->time));
+		break;
+	case SYN_DROPPED:
+		/* the gap to the next frame is not a real interval */
+		stats->dropped++;
+		stats->frame_events = 0;
+		stats->last_frame_us = 0;
+		break;
+	}
+}
+
+uint64_t
+event_stats_period_us(const struct event_stats *stats)
+{
+	return stats->period_end_us - stats->period_start_us;
+}
+
+double
+event_stats_percentile(const struct event_stats *stats, double percent)
+{
+	uint64_t rank, seen = 0;
+	unsigned int i;
+
+	if (stats->intervals == 0)
+		return 0;
+
+	rank = stats->intervals * percent / 100.0;
+	if (rank >= stats->intervals)
+		rank = stats->intervals - 1;
+
+	for (i = 0; i < EVENT_STATS_BUCKETS; i++) {
+		seen += stats->histogram[i];
+		if (seen > rank)
+			break;
+	}
+
+	return bucket_value(i);
+}
+
+void
+event_stats_print(struct event_stats *stats, FILE *fp)
+{
+	double period = event_stats_period_us(stats) / 1000000.0;
+	double event_rate = 0, frame_rate = 0;
+
+	if (period > 0) {
+		event_rate = stats->period_events / period;
+		frame_rate = stats->period_frames / period;
+	}
+
+	fprintf(fp, "%8.1f events/s %8.1f frames/s | interval p50 %7.1fus "
+		"p90 %7.1fus p99 %7.1fus max %7.1fus | events/frame %5.2f max %3u "
+		"| dropped %llu\n",
+		event_rate, frame_rate,
+		event_stats_percentile(stats, 50),
+		event_stats_percentile(stats, 90),
+		event_stats_percentile(stats, 99),
+		(double)stats->max_interval_us,
+		stats->frames ? (double)stats->events / stats->frames : 0.0,
+		stats->max_frame_events,
+		(unsigned long long)stats->dropped);
+
+	stats->period_events = 0;
+	stats->period_frames = 0;
+	stats->period_start_us = stats->period_end_us;
+}
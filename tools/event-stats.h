@@ -0,0 +1,93 @@
+/*
+ * Copyright © 2014 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of Red Hat
+ * not be used in advertising or publicity pertaining to distribution
+ * of the software without specific, written prior permission.  Red
+ * Hat makes no representations about the suitability of this software
+ * for any purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef EVENT_STATS_H
+#define EVENT_STATS_H
+
+#include <linux/input.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Inter-frame intervals are collected in a histogram with 16 buckets per
+ * power of two, i.e. the percentiles are accurate to about 6%. Intervals
+ * of 2^24us (16s) or more go into the last bucket. */
+#define EVENT_STATS_SUB_BITS 4
+#define EVENT_STATS_MAX_BITS 24
+#define EVENT_STATS_BUCKETS \
+	((EVENT_STATS_MAX_BITS - EVENT_STATS_SUB_BITS + 1) << EVENT_STATS_SUB_BITS)
+
+/**
+ * Streaming statistics over a sequence of events. Adding an event is O(1)
+ * and never allocates, so the statistics can be collected at the full
+ * event rate of a device.
+ *
+ * All times are taken from the event timestamps. A report period starts
+ * with the last frame before the previous call to event_stats_print(),
+ * or with the first frame.
+ */
+struct event_stats {
+	uint64_t last_frame_us;		/* last SYN_REPORT, 0 after SYN_DROPPED */
+	uint64_t period_start_us;	/* 0 until the first frame */
+	uint64_t period_end_us;
+
+	uint64_t events;		/* totals, excluding EV_SYN */
+	uint64_t frames;
+	uint64_t dropped;
+	uint64_t period_events;
+	uint64_t period_frames;
+
+	unsigned int frame_events;	/* of the current frame */
+	unsigned int max_frame_events;
+
+	uint64_t intervals;		/* in the histogram */
+	uint64_t max_interval_us;
+	uint32_t histogram[EVENT_STATS_BUCKETS];
+};
+
+void
+event_stats_init(struct event_stats *stats);
+
+void
+event_stats_add_event(struct event_stats *stats, const struct input_event *ev);
+
+/**
+ * @return the length of the current report period in us
+ */
+uint64_t
+event_stats_period_us(const struct event_stats *stats);
+
+/**
+ * @return the inter-frame interval in us that the given percentage of
+ * intervals does not exceed, or 0 if there are no intervals yet
+ */
+double
+event_stats_percentile(const struct event_stats *stats, double percent);
+
+/**
+ * Print the rates of the current report period and the overall interval
+ * and frame statistics as one line, then start a new report period.
+ */
+void
+event_stats_print(struct event_stats *stats, FILE *fp);
+
+#endif
@@ -32,6 +32,7 @@
 #include <linux/input.h>
 
 #include "libevdev.h"
+#include "event-stats.h"
 
 static void
 print_abs_bits(struct libevdev *dev, int axis)
@@ -57,11 +58,11 @@ print_abs_bits(struct libevdev *dev, int axis)
 static void
 print_code_bits(struct libevdev *dev, unsigned int type, unsigned int max)
 {
-	unsigned int i;
-	for (i = 0; i <= max; i++) {
-		if (!libevdev_has_event_code(dev, type, i))
-			continue;
+	int i;
 
+	for (i = libevdev_get_next_event_code(dev, type, 0);
+	     i != -1 && i <= (int)max;
+	     i = libevdev_get_next_event_code(dev, type, i + 1)) {
 		printf("    Event code %i (%s)\n", i, libevdev_event_code_get_name(type, i));
 		if (type == EV_ABS)
 			print_abs_bits(dev, i);
@@ -135,6 +136,38 @@ print_sync_event(struct input_event *ev)
 	return 0;
 }
 
+#define STATS_PERIOD_US 1000000
+
+static int
+print_stats(struct libevdev *dev)
+{
+	struct event_stats stats;
+	struct input_event evs[64];
+	const size_t nevs = sizeof(evs)/sizeof(evs[0]);
+	int rc, i;
+
+	event_stats_init(&stats);
+
+	do {
+		rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL|LIBEVDEV_READ_FLAG_BLOCKING,
+					  evs, nevs);
+		for (i = 0; i < rc; i++)
+			event_stats_add_event(&stats, &evs[i]);
+
+		if (rc > 0 && evs[rc - 1].type == EV_SYN && evs[rc - 1].code == SYN_DROPPED) {
+			while (libevdev_next_events(dev, LIBEVDEV_READ_FLAG_SYNC, evs, nevs) > 0)
+				;
+		}
+
+		if (event_stats_period_us(&stats) >= STATS_PERIOD_US)
+			event_stats_print(&stats, stdout);
+	} while (rc >= 0 || rc == -EAGAIN);
+
+	event_stats_print(&stats, stdout);
+
+	return rc;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -142,6 +175,13 @@ main(int argc, char **argv)
 	const char *file;
 	int fd;
 	int rc = 1;
+	int stats = 0;
+
+	if (argc > 1 && strcmp(argv[1], "--stats") == 0) {
+		stats = 1;
+		argc--;
+		argv++;
+	}
 
 	if (argc < 2)
 		goto out;
@@ -170,6 +210,13 @@ main(int argc, char **argv)
 	print_bits(dev);
 	print_props(dev);
 
+	if (stats) {
+		rc = print_stats(dev);
+		fprintf(stderr, "Failed to handle events: %s\n", strerror(-rc));
+		rc = 0;
+		goto out;
+	}
+
 	do {
 		struct input_event ev;
 		rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL|LIBEVDEV_READ_FLAG_BLOCKING, &ev);
@@ -39,6 +39,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "event-stats.h"
+
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #define max(a, b) (((a) > (b)) ? (a) : (b))
 
@@ -50,12 +52,15 @@ struct measurements {
 
 static int
 usage(void) {
-	printf("Usage: %s /dev/input/event0\n", getprogname());
+	printf("Usage: %s [--stats] /dev/input/event0\n", getprogname());
 	printf("\n");
 	printf("This tool reads relative events from the kernel and calculates\n"
 	       "the distance covered and maximum frequency of the incoming events.\n"
 	       "Some mouse devices provide dynamic frequencies, it is\n"
-	       "recommended to measure multiple times to obtain the highest value.\n");
+	       "recommended to measure multiple times to obtain the highest value.\n"
+	       "\n"
+	       "With --stats, the event rate and the distribution of the intervals\n"
+	       "between frames are printed once per second instead.\n");
 	return 1;
 }
 
@@ -201,6 +206,66 @@ mainloop(struct libevdev *dev, struct measurements *m) {
 	return 0;
 }
 
+#define STATS_PERIOD_US 1000000
+
+static int
+mainloop_stats(struct libevdev *dev)
+{
+	struct event_stats stats;
+	struct pollfd fds[2];
+	sigset_t mask;
+	int rc = 0;
+
+	event_stats_init(&stats);
+
+	fds[0].fd = libevdev_get_fd(dev);
+	fds[0].events = POLLIN;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	fds[1].fd = signalfd(-1, &mask, SFD_NONBLOCK);
+	fds[1].events = POLLIN;
+
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	while (poll(fds, 2, -1)) {
+		struct input_event evs[64];
+		int i;
+
+		if (fds[1].revents)
+			break;
+
+		do {
+			rc = libevdev_next_events(dev, LIBEVDEV_READ_FLAG_NORMAL,
+						  evs, sizeof(evs)/sizeof(evs[0]));
+			if (rc == -EAGAIN)
+				break;
+			if (rc < 0) {
+				fprintf(stderr, "Error: %s\n", strerror(-rc));
+				return 1;
+			}
+
+			for (i = 0; i < rc; i++)
+				event_stats_add_event(&stats, &evs[i]);
+
+			/* the synced state is not part of the statistics */
+			if (rc > 0 && evs[rc - 1].type == EV_SYN &&
+			    evs[rc - 1].code == SYN_DROPPED) {
+				while (libevdev_next_events(dev, LIBEVDEV_READ_FLAG_SYNC,
+							    evs, sizeof(evs)/sizeof(evs[0])) > 0)
+					;
+			}
+
+			if (event_stats_period_us(&stats) >= STATS_PERIOD_US)
+				event_stats_print(&stats, stdout);
+		} while (rc > 0);
+	}
+
+	event_stats_print(&stats, stdout);
+
+	return 0;
+}
+
 static void
 print_summary(struct measurements *m)
 {
@@ -249,6 +314,13 @@ main (int argc, char **argv) {
 	const char *path;
 	struct libevdev *dev;
 	struct measurements measurements = {0, 0, 0};
+	bool stats = false;
+
+	if (argc > 1 && strcmp(argv[1], "--stats") == 0) {
+		stats = true;
+		argc--;
+		argv++;
+	}
 
 	if (argc < 2)
 		return usage();
@@ -276,6 +348,15 @@ main (int argc, char **argv) {
 	}
 	libevdev_grab(dev, LIBEVDEV_UNGRAB);
 
+	if (stats) {
+		printf("Mouse %s on %s, Ctrl+C to exit.\n",
+		       libevdev_get_name(dev), path);
+		rc = mainloop_stats(dev);
+		libevdev_free(dev);
+		close(fd);
+		return rc;
+	}
+
 	printf("Mouse %s on %s\n", libevdev_get_name(dev), path);
 	printf("Move the device 250mm/10in or more along the x-axis.\n");
 	printf("Pause 3 seconds before movement to reset, Ctrl+C to exit.\n");